@@ -0,0 +1,120 @@
+/**
+ * @file      AdaptiveLimit.h
+ * @author    Atakan S.
+ * @version   1.0
+ * @brief     Concurrency limit adapted to the observed latency.
+ *
+ * @copyright Copyright (c) 2020 Atakan SARIOGLU ~ www.atakansarioglu.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _H_ADAPTIVELIMIT_H_
+#define _H_ADAPTIVELIMIT_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * @brief Concurrency limit adjusted by additive increase and multiplicative decrease.
+ *        Every call within the target latency raises the limit by 1/limit, i.e. by about
+ *        one per limit calls. A slower or failed call cuts it to 90%, at most once per
+ *        target latency so that the calls admitted under the previous limit can complete
+ *        first. Lock-free, meant to be fed with the latency of every datastore call.
+ */
+class AdaptiveLimit
+{
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Share of the limit kept on a decrease.
+    static constexpr double DECREASE = 0.9;
+
+    double m_minLimit;
+    double m_maxLimit;
+    uint64_t m_targetMicros;
+    std::atomic<double> m_limit;
+    std::atomic<int64_t> m_lastDecrease;
+
+    /*
+     * @brief Current time.
+     * @return Microseconds of Clock.
+     */
+    static int64_t nowMicros()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count();
+    }
+
+public:
+    /*
+     * @brief Constructor of the limit, starts at the max.
+     * @param minLimit Lowest limit.
+     * @param maxLimit Highest limit.
+     * @param targetSeconds Latency above which the limit is decreased.
+     */
+    AdaptiveLimit(const size_t minLimit, const size_t maxLimit, const double targetSeconds)
+        : m_minLimit(static_cast<double>(std::max<size_t>(minLimit, 1))),
+          m_maxLimit(static_cast<double>(std::max(std::max<size_t>(minLimit, 1), maxLimit))),
+          m_targetMicros(static_cast<uint64_t>(targetSeconds * 1e6)), m_limit(m_maxLimit), m_lastDecrease(0) {}
+
+    /*
+     * @brief Adjust the limit by the outcome of a call.
+     * @param micros Latency of the call.
+     * @param success False if the call failed, e.g. timed out.
+     */
+    void Observe(const uint64_t micros, const bool success = true)
+    {
+        double limit = m_limit.load(std::memory_order_relaxed);
+        if (success && micros <= m_targetMicros)
+        {
+            if (limit < m_maxLimit)
+            {
+                while (!m_limit.compare_exchange_weak(limit, std::min(m_maxLimit, limit + 1.0 / limit), std::memory_order_relaxed))
+                {
+                }
+            }
+            return;
+        }
+
+        auto now = nowMicros();
+        auto lastDecrease = m_lastDecrease.load(std::memory_order_relaxed);
+        if (now - lastDecrease < static_cast<int64_t>(m_targetMicros) ||
+            !m_lastDecrease.compare_exchange_strong(lastDecrease, now, std::memory_order_relaxed))
+        {
+            return;
+        }
+        while (!m_limit.compare_exchange_weak(limit, std::max(m_minLimit, limit * DECREASE), std::memory_order_relaxed))
+        {
+        }
+    }
+
+    /*
+     * @brief Getter for the limit.
+     * @return Number of concurrent requests allowed.
+     */
+    size_t Limit() const
+    {
+        return static_cast<size_t>(m_limit.load(std::memory_order_relaxed));
+    }
+};
+
+#endif
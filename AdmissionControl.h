@@ -0,0 +1,354 @@
+/**
+ * @file      AdmissionControl.h
+ * @author    Atakan S.
+ * @version   1.0
+ * @brief     Per-endpoint admission control with bounded queues.
+ *
+ * @copyright Copyright (c) 2020 Atakan SARIOGLU ~ www.atakansarioglu.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _H_ADMISSIONCONTROL_H_
+#define _H_ADMISSIONCONTROL_H_
+
+#include "AdaptiveLimit.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*
+ * @brief Priority of an endpoint, high priority requests may use the whole limit.
+ */
+enum class AdmissionPriority
+{
+    Low,
+    High
+};
+
+/*
+ * @brief Bounds the concurrent requests of each endpoint by its share of an adaptive limit.
+ *        Low priority requests together may only use a part of the limit, which keeps the
+ *        rest for the high priority ones. A request that does not fit waits in the bounded
+ *        queue of its endpoint, and a freed slot goes to the queued high priority requests
+ *        first. A request is shed if the queue is full or it waited too long.
+ */
+class AdmissionControl
+{
+public:
+    /*
+     * @brief Admission state of one endpoint, created by AddEndpoint.
+     */
+    class Endpoint
+    {
+    private:
+        friend class AdmissionControl;
+
+        // Requests waiting for a slot, enqueue time and the call that serves or sheds them.
+        using Waiter = std::pair<std::chrono::steady_clock::time_point, std::function<void(bool)>>;
+
+        std::string m_name;
+        double m_share;
+        AdmissionPriority m_priority;
+        size_t m_inFlight;
+        std::deque<Waiter> m_queue;
+
+    public:
+        Endpoint(const std::string &name, const double share, const AdmissionPriority priority)
+            : m_name(name), m_share(share), m_priority(priority), m_inFlight(0) {}
+
+        /*
+         * @brief Getter for the name.
+         * @return Endpoint name.
+         */
+        const std::string &Name() const
+        {
+            return m_name;
+        }
+    };
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Limit of the concurrent requests of all endpoints, nullptr admits every request.
+    std::shared_ptr<AdaptiveLimit> m_spLimit;
+    size_t m_queueLength;
+    std::chrono::duration<double> m_queueWait;
+    double m_lowPriorityShare;
+
+    std::mutex m_mutex;
+    size_t m_inFlight;
+    std::vector<std::unique_ptr<Endpoint>> m_endpoints;
+
+    // Sheds the requests that waited too long while no request enters or leaves.
+    std::mutex m_sweepMutex;
+    std::condition_variable m_stop;
+    bool m_stopping;
+    std::thread m_sweeper;
+
+    /*
+     * @brief Check if one more request of an endpoint fits, lock must be held.
+     * @param endpoint Endpoint
+     * @param limit Current limit.
+     * @return True if within the limit of the endpoint and of its priority.
+     */
+    bool fits(const Endpoint &endpoint, const size_t limit) const
+    {
+        size_t priorityLimit = (endpoint.m_priority == AdmissionPriority::High)
+                                   ? limit
+                                   : std::max<size_t>(1, static_cast<size_t>(limit * m_lowPriorityShare));
+        size_t endpointLimit = std::max<size_t>(1, static_cast<size_t>(limit * endpoint.m_share));
+        return m_inFlight < priorityLimit && endpoint.m_inFlight < endpointLimit;
+    }
+
+    /*
+     * @brief Admit the queued requests that fit, high priority first, and shed the ones that
+     *        waited too long. Lock must be held, the calls are made by the caller without it.
+     * @param admitted Output, calls of the admitted requests.
+     * @param shed Output, calls of the shed requests.
+     */
+    void dispatch(std::vector<std::function<void(bool)>> &admitted, std::vector<std::function<void(bool)>> &shed)
+    {
+        auto now = Clock::now();
+        size_t limit = m_spLimit->Limit();
+        for (auto priority : {AdmissionPriority::High, AdmissionPriority::Low})
+        {
+            for (auto &spEndpoint : m_endpoints)
+            {
+                auto &endpoint = *spEndpoint;
+                while (endpoint.m_priority == priority && !endpoint.m_queue.empty())
+                {
+                    auto &waiter = endpoint.m_queue.front();
+                    if (now - waiter.first > m_queueWait)
+                    {
+                        shed.push_back(std::move(waiter.second));
+                    }
+                    else if (fits(endpoint, limit))
+                    {
+                        ++m_inFlight;
+                        ++endpoint.m_inFlight;
+                        admitted.push_back(std::move(waiter.second));
+                    }
+                    else
+                    {
+                        break;
+                    }
+                    endpoint.m_queue.pop_front();
+                }
+            }
+        }
+    }
+
+    /*
+     * @brief Run the calls of the shed and the admitted requests.
+     * @param admitted Calls of the admitted requests.
+     * @param shed Calls of the shed requests.
+     */
+    static void run(std::vector<std::function<void(bool)>> &admitted, std::vector<std::function<void(bool)>> &shed)
+    {
+        for (auto &call : shed)
+        {
+            call(false);
+        }
+        for (auto &call : admitted)
+        {
+            call(true);
+        }
+    }
+
+    /*
+     * @brief Sweeper thread, dispatches the queues four times per queue wait.
+     */
+    void sweep()
+    {
+        auto period = std::max<Clock::duration>(std::chrono::duration_cast<Clock::duration>(m_queueWait / 4),
+                                                std::chrono::milliseconds(1));
+        std::unique_lock<std::mutex> lock(m_sweepMutex);
+        while (!m_stop.wait_for(lock, period, [this] { return m_stopping; }))
+        {
+            lock.unlock();
+            Expire();
+            lock.lock();
+        }
+    }
+
+public:
+    /*
+     * @brief Constructor of the admission control.
+     * @param spLimit Limit of the concurrent requests of all endpoints, nullptr admits every request.
+     * @param queueLength Max number of waiting requests of each endpoint, 0 sheds right away.
+     * @param queueWaitSeconds Max time a request waits in the queue.
+     * @param lowPriorityShare Share of the limit the low priority requests may use together.
+     */
+    AdmissionControl(std::shared_ptr<AdaptiveLimit> spLimit, const size_t queueLength = 128, const double queueWaitSeconds = 0.5,
+                     const double lowPriorityShare = 0.8)
+        : m_spLimit(spLimit), m_queueLength(queueLength), m_queueWait(queueWaitSeconds), m_lowPriorityShare(lowPriorityShare),
+          m_inFlight(0), m_stopping(false)
+    {
+        if (m_spLimit)
+        {
+            m_sweeper = std::thread(&AdmissionControl::sweep, this);
+        }
+    }
+
+    /*
+     * @brief Destructor, stops the sweeper thread.
+     */
+    ~AdmissionControl()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_sweepMutex);
+            m_stopping = true;
+        }
+        m_stop.notify_all();
+        if (m_sweeper.joinable())
+        {
+            m_sweeper.join();
+        }
+    }
+
+    /*
+     * @brief Add an endpoint.
+     * @param name Endpoint name.
+     * @param share Share of the limit the endpoint may use.
+     * @param priority Priority of the requests of the endpoint.
+     * @return Endpoint, valid as long as the admission control.
+     */
+    Endpoint &AddEndpoint(const std::string &name, const double share, const AdmissionPriority priority)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_endpoints.push_back(std::make_unique<Endpoint>(name, share, priority));
+        return *m_endpoints.back();
+    }
+
+    /*
+     * @brief Admit, queue or shed a request. Every admitted request must Leave once done.
+     * @param endpoint Endpoint of the request.
+     * @param serve Called once, with true when the request is admitted, maybe later from
+     *        another thread, or with false when it is shed.
+     */
+    void Enter(Endpoint &endpoint, std::function<void(bool)> serve)
+    {
+        if (!m_spLimit)
+        {
+            serve(true);
+            return;
+        }
+
+        std::vector<std::function<void(bool)>> admitted, shed;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            endpoint.m_queue.emplace_back(Clock::now(), std::move(serve));
+            dispatch(admitted, shed);
+
+            // Still waiting behind a full queue.
+            if (endpoint.m_queue.size() > m_queueLength)
+            {
+                shed.push_back(std::move(endpoint.m_queue.back().second));
+                endpoint.m_queue.pop_back();
+            }
+        }
+        run(admitted, shed);
+    }
+
+    /*
+     * @brief Release the slot of an admitted request and admit the queued ones that fit.
+     * @param endpoint Endpoint of the request.
+     */
+    void Leave(Endpoint &endpoint)
+    {
+        if (!m_spLimit)
+        {
+            return;
+        }
+
+        std::vector<std::function<void(bool)>> admitted, shed;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_inFlight;
+            --endpoint.m_inFlight;
+            dispatch(admitted, shed);
+        }
+        run(admitted, shed);
+    }
+
+    /*
+     * @brief Shed the queued requests that waited too long and admit the ones that fit,
+     *        e.g. after the limit was raised. Called periodically by the sweeper thread.
+     */
+    void Expire()
+    {
+        if (!m_spLimit)
+        {
+            return;
+        }
+
+        std::vector<std::function<void(bool)>> admitted, shed;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            dispatch(admitted, shed);
+        }
+        run(admitted, shed);
+    }
+
+    /*
+     * @brief Getter for the limit.
+     * @return Number of concurrent requests allowed, 0 if unlimited.
+     */
+    size_t Limit() const
+    {
+        return m_spLimit ? m_spLimit->Limit() : 0;
+    }
+
+    /*
+     * @brief Getter for the admitted requests.
+     * @return Number of requests in flight.
+     */
+    size_t InFlight()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_inFlight;
+    }
+
+    /*
+     * @brief Getter for the waiting requests.
+     * @return Number of queued requests of all endpoints.
+     */
+    size_t Queued()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t queued = 0;
+        for (const auto &spEndpoint : m_endpoints)
+        {
+            queued += spEndpoint->m_queue.size();
+        }
+        return queued;
+    }
+};
+
+#endif
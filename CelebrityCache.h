@@ -0,0 +1,197 @@
+/**
+ * @file      CelebrityCache.h
+ * @author    Atakan S.
+ * @version   1.0
+ * @brief     Cached celebrity classification of the users for the Hybrid timelines.
+ *
+ * @copyright Copyright (c) 2020 Atakan SARIOGLU ~ www.atakansarioglu.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _H_CELEBRITYCACHE_H_
+#define _H_CELEBRITYCACHE_H_
+
+#include <chrono>
+#include <iterator>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * @brief Follower counts of the users and whether their tweets are pushed or pulled.
+ *        A user dropping below the threshold has recent tweets that were never pushed,
+ *        so the user stays pulled on read until a full timeline of new tweets was pushed.
+ *        The demotions are only seen by the instance that classified the user as celebrity before.
+ */
+class CelebrityCache
+{
+private:
+    // Classification of one user.
+    struct Entry
+    {
+        int followerCount;
+        bool celebrity;
+        int pendingPushes;
+        std::chrono::steady_clock::time_point expiry;
+    };
+
+    // One stripe of the cache, guarded by its own lock.
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<int, Entry> entries;
+    };
+
+    std::vector<Shard> m_shards;
+    size_t m_shardCapacity;
+    std::chrono::duration<double> m_ttl;
+
+    /*
+     * @brief Select the shard of a user.
+     * @param userId User
+     * @return Shard reference.
+     */
+    Shard &shardOf(const int userId)
+    {
+        return m_shards[static_cast<unsigned int>(userId) % m_shards.size()];
+    }
+
+    /*
+     * @brief Classify against the threshold, a demoted user stays pulled for a timeline of pushes.
+     * @param entry Entry to update, the lock of the shard must be held.
+     * @param threshold Follower count that makes a user celebrity.
+     * @param timelineLength Length of the materialized timelines.
+     */
+    static void classify(Entry &entry, const int threshold, const int timelineLength)
+    {
+        bool celebrity = entry.followerCount >= threshold;
+        if (celebrity)
+        {
+            entry.pendingPushes = 0;
+        }
+        else if (entry.celebrity)
+        {
+            entry.pendingPushes = timelineLength;
+        }
+        entry.celebrity = celebrity;
+    }
+
+public:
+    /*
+     * @brief Constructor of the cache.
+     * @param ttl Seconds a follower count is used at most, 0 reads the counts on every request.
+     * @param capacity Max number of users, celebrities and demoted users are kept beyond it.
+     * @param shardCount Number of independently locked stripes.
+     */
+    CelebrityCache(const double ttl = 10.0, const size_t capacity = 1000000, const size_t shardCount = 16)
+        : m_shards(shardCount > 0 ? shardCount : 1), m_ttl(ttl)
+    {
+        m_shardCapacity = (capacity + m_shards.size() - 1) / m_shards.size();
+    }
+
+    /*
+     * @brief Get the classification of a user.
+     * @param userId User
+     * @param threshold Follower count that makes a user celebrity.
+     * @param timelineLength Length of the materialized timelines.
+     * @param celebrity Output, true if the tweets of the user are not pushed.
+     * @param pulled Output, true if the tweets of the user are merged on read.
+     * @return True on hit, false if unknown or expired.
+     */
+    bool Get(const int userId, const int threshold, const int timelineLength, bool &celebrity, bool &pulled)
+    {
+        auto &shard = shardOf(userId);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(userId);
+        if (it == shard.entries.end() || it->second.expiry <= std::chrono::steady_clock::now())
+        {
+            return false;
+        }
+
+        classify(it->second, threshold, timelineLength);
+        celebrity = it->second.celebrity;
+        pulled = celebrity || it->second.pendingPushes > 0;
+        return true;
+    }
+
+    /*
+     * @brief Store the follower count of a user read from the datastore.
+     * @param userId User
+     * @param followerCount Number of followers.
+     * @param threshold Follower count that makes a user celebrity.
+     * @param timelineLength Length of the materialized timelines.
+     * @param celebrity Output, true if the tweets of the user are not pushed.
+     * @param pulled Output, true if the tweets of the user are merged on read.
+     */
+    void Put(const int userId, const int followerCount, const int threshold, const int timelineLength,
+             bool &celebrity, bool &pulled)
+    {
+        auto &shard = shardOf(userId);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto expiry = std::chrono::steady_clock::now() +
+                      std::chrono::duration_cast<std::chrono::steady_clock::duration>(m_ttl);
+        auto it = shard.entries.find(userId);
+        if (it != shard.entries.end())
+        {
+            it->second.followerCount = followerCount;
+            it->second.expiry = expiry;
+            classify(it->second, threshold, timelineLength);
+            celebrity = it->second.celebrity;
+            pulled = celebrity || it->second.pendingPushes > 0;
+            return;
+        }
+
+        celebrity = followerCount >= threshold;
+        pulled = celebrity;
+
+        // Make room by dropping the expired regular users, otherwise skip caching a regular user.
+        if (shard.entries.size() >= m_shardCapacity)
+        {
+            auto now = std::chrono::steady_clock::now();
+            for (auto entry = shard.entries.begin(); entry != shard.entries.end();)
+            {
+                bool expired = entry->second.expiry <= now && !entry->second.celebrity && entry->second.pendingPushes == 0;
+                entry = expired ? shard.entries.erase(entry) : std::next(entry);
+            }
+            if (shard.entries.size() >= m_shardCapacity && !celebrity)
+            {
+                return;
+            }
+        }
+        shard.entries.emplace(userId, Entry{followerCount, celebrity, 0, expiry});
+    }
+
+    /*
+     * @brief Count a tweet of a user pushed to the timelines of the followers.
+     * @param userId Author
+     */
+    void Pushed(const int userId)
+    {
+        auto &shard = shardOf(userId);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(userId);
+        if (it != shard.entries.end() && it->second.pendingPushes > 0)
+        {
+            --it->second.pendingPushes;
+        }
+    }
+};
+
+#endif
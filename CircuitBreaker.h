@@ -0,0 +1,213 @@
+/**
+ * @file      CircuitBreaker.h
+ * @author    Atakan S.
+ * @version   1.0
+ * @brief     Circuit breaker that fails calls fast while a backend is down.
+ *
+ * @copyright Copyright (c) 2020 Atakan SARIOGLU ~ www.atakansarioglu.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _H_CIRCUITBREAKER_H_
+#define _H_CIRCUITBREAKER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+
+/*
+ * @brief State of a circuit breaker.
+ */
+enum class CircuitState
+{
+    Closed,
+    Open,
+    HalfOpen
+};
+
+/*
+ * @brief Opens after a number of consecutive failures, then calls are rejected without
+ *        touching the backend. While open, the owner probes the backend whenever ProbeDue,
+ *        the wait between probes doubles after each failed one up to the max backoff.
+ *        A successful probe half-opens the breaker, which lets one trial call through per
+ *        min backoff, the first successful call closes it and a failed one opens it again.
+ */
+class CircuitBreaker
+{
+private:
+    using Clock = std::chrono::steady_clock;
+
+    size_t m_failureThreshold;
+    std::chrono::duration<double> m_minBackoff;
+    std::chrono::duration<double> m_maxBackoff;
+
+    // Read without the lock on the hot path, changed under the lock.
+    std::atomic<CircuitState> m_state;
+    std::atomic<size_t> m_failures;
+
+    // Backoff of the open state, time of the next probe and of the next half-open trial.
+    std::mutex m_mutex;
+    std::chrono::duration<double> m_backoff;
+    Clock::time_point m_retryAt;
+    Clock::time_point m_nextTrial;
+
+    /*
+     * @brief Open the breaker, lock must be held.
+     * @param backoff Wait before the next probe.
+     */
+    void open(const std::chrono::duration<double> &backoff)
+    {
+        m_backoff = std::min(std::max(backoff, m_minBackoff), m_maxBackoff);
+        m_retryAt = Clock::now() + std::chrono::duration_cast<Clock::duration>(m_backoff);
+        m_state.store(CircuitState::Open);
+    }
+
+public:
+    /*
+     * @brief Constructor of the circuit breaker, starts closed.
+     * @param failureThreshold Consecutive failures that open the breaker.
+     * @param minBackoff Seconds before the first probe, also the interval of half-open trials.
+     * @param maxBackoff Max seconds between two probes.
+     */
+    CircuitBreaker(const size_t failureThreshold = 5, const double minBackoff = 0.1, const double maxBackoff = 10.0)
+        : m_failureThreshold(failureThreshold > 0 ? failureThreshold : 1), m_minBackoff(minBackoff),
+          m_maxBackoff(std::max(minBackoff, maxBackoff)), m_state(CircuitState::Closed), m_failures(0),
+          m_backoff(minBackoff) {}
+
+    /*
+     * @brief Check if a call may go to the backend.
+     * @return True if closed, or half-open and a trial is due.
+     */
+    bool Allow()
+    {
+        auto state = m_state.load(std::memory_order_relaxed);
+        if (state == CircuitState::Closed)
+        {
+            return true;
+        }
+        if (state == CircuitState::Open)
+        {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto now = Clock::now();
+        if (m_state.load() != CircuitState::HalfOpen || now < m_nextTrial)
+        {
+            return false;
+        }
+        m_nextTrial = now + std::chrono::duration_cast<Clock::duration>(m_minBackoff);
+        return true;
+    }
+
+    /*
+     * @brief Report a successful call, closes a half-open breaker.
+     */
+    void Success()
+    {
+        if (m_failures.load(std::memory_order_relaxed) != 0)
+        {
+            m_failures.store(0, std::memory_order_relaxed);
+        }
+        if (m_state.load(std::memory_order_relaxed) == CircuitState::HalfOpen)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_state.load() == CircuitState::HalfOpen)
+            {
+                m_backoff = m_minBackoff;
+                m_state.store(CircuitState::Closed);
+            }
+        }
+    }
+
+    /*
+     * @brief Report a failed call, e.g. a timeout. Opens the breaker at the failure threshold,
+     *        or right away if half-open.
+     */
+    void Failure()
+    {
+        auto state = m_state.load(std::memory_order_relaxed);
+        if (state == CircuitState::Open || (state == CircuitState::Closed && ++m_failures < m_failureThreshold))
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        state = m_state.load();
+        if (state == CircuitState::Closed)
+        {
+            open(m_minBackoff);
+        }
+        else if (state == CircuitState::HalfOpen)
+        {
+            open(m_backoff * 2);
+        }
+    }
+
+    /*
+     * @brief Check if the backend should be probed.
+     * @return True if open and the backoff has elapsed.
+     */
+    bool ProbeDue()
+    {
+        if (m_state.load(std::memory_order_relaxed) != CircuitState::Open)
+        {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_state.load() == CircuitState::Open && Clock::now() >= m_retryAt;
+    }
+
+    /*
+     * @brief Report the outcome of a probe of an open breaker.
+     * @param success True half-opens the breaker, false doubles the backoff.
+     */
+    void Probed(const bool success)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_state.load() != CircuitState::Open)
+        {
+            return;
+        }
+        if (success)
+        {
+            m_failures.store(0);
+            m_nextTrial = Clock::now();
+            m_state.store(CircuitState::HalfOpen);
+        }
+        else
+        {
+            open(m_backoff * 2);
+        }
+    }
+
+    /*
+     * @brief Getter for the state.
+     * @return Current state.
+     */
+    CircuitState State() const
+    {
+        return m_state.load();
+    }
+};
+
+#endif
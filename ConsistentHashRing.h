@@ -0,0 +1,127 @@
+/**
+ * @file      ConsistentHashRing.h
+ * @author    Atakan S.
+ * @version   1.0
+ * @brief     Consistent hashing of users onto datastore shards.
+ *
+ * @copyright Copyright (c) 2020 Atakan SARIOGLU ~ www.atakansarioglu.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _H_CONSISTENTHASHRING_H_
+#define _H_CONSISTENTHASHRING_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * @brief Maps users to shards on a hash ring. Each shard is placed at many points of the
+ *        ring, hashed from its name, and a user belongs to the first point after the hash
+ *        of its ID. The hashes are stable across builds and the placement depends only on
+ *        the shard names, so adding a shard moves about 1/N of the users.
+ */
+class ConsistentHashRing
+{
+private:
+    // Points of the ring, hash and shard index, sorted by hash.
+    std::vector<std::pair<uint64_t, size_t>> m_points;
+
+    // Number of shards.
+    size_t m_shardCount;
+
+    /*
+     * @brief FNV-1a hash of a string.
+     * @param str String to hash.
+     * @return Hash
+     */
+    static uint64_t hashOf(const std::string &str)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (unsigned char c : str)
+        {
+            hash = (hash ^ c) * 1099511628211ULL;
+        }
+        return mix(hash);
+    }
+
+    /*
+     * @brief Spread the bits of a value over the whole range, splitmix64 finalizer.
+     * @param value Value to mix.
+     * @return Hash
+     */
+    static uint64_t mix(uint64_t value)
+    {
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+        return value ^ (value >> 31);
+    }
+
+public:
+    /*
+     * @brief Constructor of the ring.
+     * @param shardNames Unique name of each shard, e.g. its address.
+     * @param pointsPerShard Points of each shard on the ring, more even out the load.
+     */
+    ConsistentHashRing(const std::vector<std::string> &shardNames, const size_t pointsPerShard = 160)
+        : m_shardCount(shardNames.size())
+    {
+        m_points.reserve(shardNames.size() * pointsPerShard);
+        for (size_t shard = 0; shard < shardNames.size(); ++shard)
+        {
+            for (size_t point = 0; point < pointsPerShard; ++point)
+            {
+                m_points.emplace_back(hashOf(shardNames[shard] + "#" + std::to_string(point)), shard);
+            }
+        }
+        std::sort(m_points.begin(), m_points.end());
+    }
+
+    /*
+     * @brief Getter for the number of shards.
+     * @return Shards
+     */
+    size_t ShardCount() const
+    {
+        return m_shardCount;
+    }
+
+    /*
+     * @brief Shard of a user.
+     * @param userId User
+     * @return Shard index, 0 if the ring is empty.
+     */
+    size_t ShardOf(const int userId) const
+    {
+        if (m_points.empty())
+        {
+            return 0;
+        }
+
+        uint64_t hash = mix(static_cast<uint64_t>(static_cast<uint32_t>(userId)));
+        auto it = std::lower_bound(m_points.begin(), m_points.end(), std::make_pair(hash, size_t(0)));
+        return (it == m_points.end()) ? m_points.front().second : it->second;
+    }
+};
+
+#endif
@@ -29,7 +29,10 @@
 #define _H_FOLLOWAPI_H_
 
 #include "IDatastore.h"
+#include "TimelineAPI.h"
+#include "WriteBehindQueue.h"
 #include <iostream>
+#include <memory>
 
 class FollowAPI
 {
@@ -37,42 +40,121 @@ private:
     // Datastore object.
     std::shared_ptr<IDatastore> m_spDatastore;
 
+    // Timeline service to keep materialized timelines in sync, optional.
+    std::shared_ptr<TimelineAPI> m_spTimelineApi;
+
+    // Write-behind stage, optional.
+    std::shared_ptr<WriteBehindQueue> m_spWriteQueue;
+
+    /*
+     * @brief Send a follow write to the datastore, or queue it for the next group commit.
+     * @param followerId follower
+     * @param followeeId followee
+     * @param follow True to follow, false to unfollow.
+     * @param continuation Runs on the outcome of the write, e.g. the timeline update.
+     * @return Task, true on success.
+     */
+    template <typename Continuation>
+    pplx::task<bool> write(const int followerId, const int followeeId, const bool follow, Continuation continuation)
+    {
+        pplx::task<bool> stored;
+        if (!m_spWriteQueue)
+        {
+            stored = follow ? m_spDatastore->AddFolloweeAsync(followerId, followeeId)
+                            : m_spDatastore->DelFolloweeAsync(followerId, followeeId);
+        }
+        else if (!(follow ? m_spWriteQueue->AddFollowee(followerId, followeeId, stored)
+                          : m_spWriteQueue->DelFollowee(followerId, followeeId, stored)))
+        {
+            return pplx::task_from_result(false);
+        }
+
+        // Queued is enough for ack-on-enqueue, the timeline update follows the commit.
+        auto updated = stored.then(continuation);
+        if (m_spWriteQueue && m_spWriteQueue->GetAck() == WriteAck::OnEnqueue)
+        {
+            return pplx::task_from_result(true);
+        }
+        return updated;
+    }
+
 public:
     /*
      * @brief Constructor of FollowAPI
      * @param spDatastore Dependency injection for Datastore.
+     * @param spTimelineApi Timeline service for fan-out-on-write, optional.
+     * @param spWriteQueue Write-behind stage for the follow writes, nullptr to write directly.
      */
-    FollowAPI(std::shared_ptr<IDatastore> spDatastore)
-        : m_spDatastore(spDatastore) {}
+    FollowAPI(std::shared_ptr<IDatastore> spDatastore, std::shared_ptr<TimelineAPI> spTimelineApi = nullptr,
+              std::shared_ptr<WriteBehindQueue> spWriteQueue = nullptr)
+        : m_spDatastore(spDatastore), m_spTimelineApi(spTimelineApi), m_spWriteQueue(spWriteQueue) {}
 
     /*
-     * @brief Adds follower->followee pair to datastore
-     * @param spDatastore Dependency injection for Datastore.
-     * @return True on success.
+     * @brief Adds follower->followee pair to datastore without blocking.
+     * @param followerId follower
+     * @param followeeId followee
+     * @return Task, true on success.
      */
-    bool Follow(const int followerId, const int followeeId)
+    pplx::task<bool> FollowAsync(const int followerId, const int followeeId)
     {
         if (!m_spDatastore->IsConnected() && m_spDatastore->Connect() == false)
         {
-            return false;
+            return pplx::task_from_result(false);
         }
 
-        return m_spDatastore->AddFollowee(followerId, followeeId);
+        auto spTimelineApi = m_spTimelineApi;
+        return write(followerId, followeeId, true, [spTimelineApi, followerId, followeeId](bool success) {
+            // Backfill the timeline of the follower.
+            if (success == false || !spTimelineApi)
+            {
+                return pplx::task_from_result(success);
+            }
+            return spTimelineApi->BackfillAsync(followerId, followeeId);
+        });
     }
 
     /*
-     * @brief Removes follower->followee pair if exitst.
-     * @param spDatastore Dependency injection for Datastore.
-     * @return True on success.
+     * @brief Removes follower->followee pair if exitst, without blocking.
+     * @param followerId follower
+     * @param followeeId followee
+     * @return Task, true on success.
      */
-    bool Unfollow(const int followerId, const int followeeId)
+    pplx::task<bool> UnfollowAsync(const int followerId, const int followeeId)
     {
         if (!m_spDatastore->IsConnected() && m_spDatastore->Connect() == false)
         {
-            return false;
+            return pplx::task_from_result(false);
         }
 
-        return m_spDatastore->DelFollowee(followerId, followeeId);
+        auto spTimelineApi = m_spTimelineApi;
+        return write(followerId, followeeId, false, [spTimelineApi, followerId](bool success) {
+            // Drop the tweets of the followee from the timeline of the follower.
+            if (success == false || !spTimelineApi)
+            {
+                return pplx::task_from_result(success);
+            }
+            return spTimelineApi->RebuildTimelineAsync(followerId);
+        });
+    }
+
+    /*
+     * @brief Adds follower->followee pair to datastore
+     * @param spDatastore Dependency injection for Datastore.
+     * @return True on success.
+     */
+    bool Follow(const int followerId, const int followeeId)
+    {
+        return FollowAsync(followerId, followeeId).get();
+    }
+
+    /*
+     * @brief Removes follower->followee pair if exitst.
+     * @param spDatastore Dependency injection for Datastore.
+     * @return True on success.
+     */
+    bool Unfollow(const int followerId, const int followeeId)
+    {
+        return UnfollowAsync(followerId, followeeId).get();
     }
 };
 
@@ -0,0 +1,400 @@
+/**
+ * @file      FollowGraphCache.h
+ * @author    Atakan S.
+ * @version   1.0
+ * @brief     Write-through cache of the follow graph as sorted ID arrays.
+ *
+ * @copyright Copyright (c) 2020 Atakan SARIOGLU ~ www.atakansarioglu.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _H_FOLLOWGRAPHCACHE_H_
+#define _H_FOLLOWGRAPHCACHE_H_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * @brief Direction of the cached follow relation.
+ */
+enum class FollowRelation
+{
+    Followees,
+    Followers
+};
+
+class FollowGraphCache
+{
+private:
+    // Sorted IDs of one user and one relation.
+    struct Entry
+    {
+        std::vector<int> ids;
+        std::chrono::steady_clock::time_point expiry;
+        std::list<uint64_t>::iterator position;
+    };
+
+    // One stripe of the cache, guarded by its own lock.
+    struct Shard
+    {
+        std::mutex mutex;
+        std::list<uint64_t> lru;
+        std::unordered_map<uint64_t, Entry> entries;
+    };
+
+    // Approximate bookkeeping bytes of an entry besides its IDs: map node, list node and key.
+    static constexpr size_t ENTRY_OVERHEAD = sizeof(Entry) + sizeof(uint64_t) * 2 + sizeof(void *) * 4;
+
+    std::vector<Shard> m_shards;
+    size_t m_shardCapacity;
+    std::chrono::duration<double> m_ttl;
+    std::atomic<size_t> m_entryCount;
+    std::atomic<size_t> m_bytes;
+
+    // Stamps of the last write per stripe of keys. A set read from the datastore is not cached
+    // if its key was written after the read started, writes to other users do not matter.
+    static constexpr size_t EPOCH_STRIPES = 4096;
+    std::atomic<uint64_t> m_epoch;
+    std::array<std::atomic<uint64_t>, EPOCH_STRIPES> m_written{};
+
+    /*
+     * @brief Compose the key of a user and a relation.
+     * @param relation Followees or followers.
+     * @param userId User
+     * @return Key
+     */
+    static uint64_t keyOf(const FollowRelation relation, const int userId)
+    {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(userId)) << 1) | (relation == FollowRelation::Followers ? 1 : 0);
+    }
+
+    /*
+     * @brief Select the shard of a key.
+     * @param key Key
+     * @return Shard reference.
+     */
+    Shard &shardOf(const uint64_t key)
+    {
+        return m_shards[(key >> 1) % m_shards.size()];
+    }
+
+    /*
+     * @brief Select the write stamp of a key.
+     * @param key Key
+     * @return Stamp reference.
+     */
+    std::atomic<uint64_t> &stampOf(const uint64_t key)
+    {
+        return m_written[(key * 0x9E3779B97F4A7C15ULL >> 32) % EPOCH_STRIPES];
+    }
+
+    /*
+     * @brief Record a write of a key with a new epoch.
+     * @param key Key
+     */
+    void stamp(const uint64_t key)
+    {
+        uint64_t epoch = ++m_epoch;
+        auto &stamp = stampOf(key);
+        uint64_t current = stamp;
+        while (current < epoch && !stamp.compare_exchange_weak(current, epoch))
+        {
+        }
+    }
+
+    /*
+     * @brief Drop the entry of a key after a write with an unknown outcome.
+     * @param key Key
+     */
+    void invalidate(const uint64_t key)
+    {
+        stamp(key);
+
+        auto &shard = shardOf(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end())
+        {
+            erase(shard, it);
+        }
+    }
+
+    /*
+     * @brief Memory used by an entry.
+     * @param entry Entry
+     * @return Bytes
+     */
+    static size_t bytesOf(const Entry &entry)
+    {
+        return ENTRY_OVERHEAD + entry.ids.capacity() * sizeof(int);
+    }
+
+    /*
+     * @brief Remove an entry, the lock of the shard must be held.
+     * @param shard Shard of the entry.
+     * @param it Entry to remove.
+     */
+    void erase(Shard &shard, std::unordered_map<uint64_t, Entry>::iterator it)
+    {
+        m_bytes -= bytesOf(it->second);
+        --m_entryCount;
+        shard.lru.erase(it->second.position);
+        shard.entries.erase(it);
+    }
+
+    /*
+     * @brief Apply a write to a cached entry, uncached entries are loaded on the next read.
+     * @param relation Followees or followers.
+     * @param userId Owner of the entry.
+     * @param memberId Followed or following user.
+     * @param insert True to insert, false to erase.
+     */
+    void update(const FollowRelation relation, const int userId, const int memberId, const bool insert)
+    {
+        auto key = keyOf(relation, userId);
+        stamp(key);
+
+        auto &shard = shardOf(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it == shard.entries.end())
+        {
+            return;
+        }
+
+        // Keep the array sorted, growth is accounted for.
+        auto &ids = it->second.ids;
+        m_bytes -= bytesOf(it->second);
+        auto position = std::lower_bound(ids.begin(), ids.end(), memberId);
+        bool present = position != ids.end() && *position == memberId;
+        if (insert && !present)
+        {
+            ids.insert(position, memberId);
+        }
+        else if (!insert && present)
+        {
+            ids.erase(position);
+        }
+        m_bytes += bytesOf(it->second);
+    }
+
+public:
+    /*
+     * @brief Constructor of the cache.
+     * @param capacity Max number of cached ID arrays, followees and followers counted separately, 0 disables the cache.
+     * @param ttl Seconds an array is served at most, bounds the staleness of writes made by other API instances.
+     * @param shardCount Number of independently locked stripes.
+     */
+    FollowGraphCache(const size_t capacity = 1000000, const double ttl = 60.0, const size_t shardCount = 16)
+        : m_shards(shardCount > 0 ? shardCount : 1), m_ttl(ttl), m_entryCount(0), m_bytes(0), m_epoch(0)
+    {
+        m_shardCapacity = (capacity + m_shards.size() - 1) / m_shards.size();
+    }
+
+    /*
+     * @brief Current epoch, take it before reading from the datastore and pass it to Fill.
+     * @return Epoch.
+     */
+    uint64_t Epoch() const
+    {
+        return m_epoch;
+    }
+
+    /*
+     * @brief Get the cached IDs of a user.
+     * @param relation Followees or followers.
+     * @param userId User
+     * @param ids Output vector, IDs are appended in ascending order.
+     * @return True on hit.
+     */
+    bool Get(const FollowRelation relation, const int userId, std::vector<int> &ids)
+    {
+        if (m_shardCapacity == 0)
+        {
+            return false;
+        }
+
+        auto key = keyOf(relation, userId);
+        auto &shard = shardOf(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it == shard.entries.end())
+        {
+            return false;
+        }
+        if (std::chrono::steady_clock::now() >= it->second.expiry)
+        {
+            erase(shard, it);
+            return false;
+        }
+
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second.position);
+        ids.insert(ids.end(), it->second.ids.begin(), it->second.ids.end());
+        return true;
+    }
+
+    /*
+     * @brief Cache the IDs read from the datastore, dropped if the set was written since the epoch.
+     * @param relation Followees or followers.
+     * @param userId User
+     * @param ids IDs in any order.
+     * @param epoch Epoch taken before the read.
+     */
+    void Fill(const FollowRelation relation, const int userId, std::vector<int> ids, const uint64_t epoch)
+    {
+        auto key = keyOf(relation, userId);
+        if (m_shardCapacity == 0 || stampOf(key) > epoch)
+        {
+            return;
+        }
+
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        ids.shrink_to_fit();
+
+        // A write stamps before it takes the lock, so it is either seen here or applied after.
+        auto &shard = shardOf(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (stampOf(key) > epoch)
+        {
+            return;
+        }
+
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end())
+        {
+            erase(shard, it);
+        }
+
+        shard.lru.push_front(key);
+        auto &entry = shard.entries[key];
+        entry.ids = std::move(ids);
+        entry.expiry = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(m_ttl);
+        entry.position = shard.lru.begin();
+        m_bytes += bytesOf(entry);
+        ++m_entryCount;
+
+        // Evict the least recently used.
+        while (shard.lru.size() > m_shardCapacity)
+        {
+            erase(shard, shard.entries.find(shard.lru.back()));
+        }
+    }
+
+    /*
+     * @brief Write-through of a new follow relation.
+     * @param userId Follower
+     * @param followeeId Followee
+     */
+    void AddFollowee(const int userId, const int followeeId)
+    {
+        update(FollowRelation::Followees, userId, followeeId, true);
+        update(FollowRelation::Followers, followeeId, userId, true);
+    }
+
+    /*
+     * @brief Write-through of a removed follow relation.
+     * @param userId Follower
+     * @param followeeId Followee
+     */
+    void DelFollowee(const int userId, const int followeeId)
+    {
+        update(FollowRelation::Followees, userId, followeeId, false);
+        update(FollowRelation::Followers, followeeId, userId, false);
+    }
+
+    /*
+     * @brief Write-through of one side of a follow relation.
+     * @param relation Followees for the side of the follower, Followers for the side of the followee.
+     * @param userId Follower
+     * @param followeeId Followee
+     * @param insert True if the relation was added, false if removed.
+     */
+    void UpdateEdge(const FollowRelation relation, const int userId, const int followeeId, const bool insert)
+    {
+        if (relation == FollowRelation::Followees)
+        {
+            update(FollowRelation::Followees, userId, followeeId, insert);
+        }
+        else
+        {
+            update(FollowRelation::Followers, followeeId, userId, insert);
+        }
+    }
+
+    /*
+     * @brief Drop one side of a relation, e.g. when the outcome of a write is unknown.
+     * @param relation Followees for the side of the follower, Followers for the side of the followee.
+     * @param userId Follower
+     * @param followeeId Followee
+     */
+    void InvalidateEdge(const FollowRelation relation, const int userId, const int followeeId)
+    {
+        invalidate(relation == FollowRelation::Followees ? keyOf(FollowRelation::Followees, userId)
+                                                         : keyOf(FollowRelation::Followers, followeeId));
+    }
+
+    /*
+     * @brief Drop both sides of a relation, e.g. when the outcome of a write is unknown.
+     * @param userId Follower
+     * @param followeeId Followee
+     */
+    void Invalidate(const int userId, const int followeeId)
+    {
+        invalidate(keyOf(FollowRelation::Followees, userId));
+        invalidate(keyOf(FollowRelation::Followers, followeeId));
+    }
+
+    /*
+     * @brief Number of cached ID arrays.
+     * @return Entries
+     */
+    size_t Size() const
+    {
+        return m_entryCount;
+    }
+
+    /*
+     * @brief Approximate memory footprint, IDs and bookkeeping.
+     * @return Bytes
+     */
+    size_t MemoryUsage() const
+    {
+        return m_bytes;
+    }
+
+    /*
+     * @brief Getter for the capacity.
+     * @return Max number of cached ID arrays.
+     */
+    size_t Capacity() const
+    {
+        return m_shardCapacity * m_shards.size();
+    }
+};
+
+#endif
@@ -28,7 +28,12 @@
 #ifndef _H_IDATASTORE_H_
 #define _H_IDATASTORE_H_
 
+#include "TweetArena.h"
+#include <pplx/pplxtasks.h>
 #include <iosfwd>
+#include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 
 struct IDatastore
@@ -37,12 +42,139 @@ struct IDatastore
     virtual bool Disconnect() = 0;
     virtual bool IsConnected() const = 0;
     virtual int GetUniqueNumber() = 0;
+    virtual int ReserveUniqueNumbers(const int count) = 0;
     virtual bool AddTweet(const int userId, const std::string &tweetAsString, int maxTweets = 10) = 0;
+    virtual bool AddTweets(const std::vector<std::pair<int, std::string>> &tweets, std::vector<bool> &results,
+                           int maxTweets = 10) = 0;
     virtual bool GetRecentTweets(const std::vector<int> &userIdVector,
                                  std::vector<std::string> &tweets, int numberOfTweets = -1) = 0;
+    virtual bool GetRecentTweetLists(const std::vector<int> &userIdVector,
+                                     std::vector<std::vector<std::string>> &tweetLists, int numberOfTweets = -1) = 0;
     virtual bool GetFollowees(const int userId, std::vector<int> &followees) = 0;
     virtual bool AddFollowee(const int userId, const int followeeId) = 0;
     virtual bool DelFollowee(const int userId, const int followeeId) = 0;
+    // One side of a follow each, for datastores that keep the followees and the followers apart.
+    virtual bool AddFolloweeEdge(const int userId, const int followeeId) = 0;
+    virtual bool AddFollowerEdge(const int userId, const int followeeId) = 0;
+    virtual bool DelFolloweeEdge(const int userId, const int followeeId) = 0;
+    virtual bool DelFollowerEdge(const int userId, const int followeeId) = 0;
+    virtual bool GetFollowers(const int userId, std::vector<int> &followers) = 0;
+    virtual bool GetFollowerCounts(const std::vector<int> &userIdVector, std::vector<int> &counts) = 0;
+    virtual bool PushTimelines(const std::vector<int> &userIdVector, const std::string &tweetAsString, int maxTweets = 10) = 0;
+    virtual bool GetTimelineTweets(const int userId, std::vector<std::string> &tweets, int numberOfTweets = -1) = 0;
+    virtual bool ReplaceTimelineTweets(const int userId, const std::vector<std::string> &expectedTweets,
+                                       const std::vector<std::string> &tweets, bool &replaced) = 0;
+
+    // Asynchronous variants, the outputs are filled before the task completes.
+    // The defaults run the synchronous call inline, which suits non-blocking datastores.
+    virtual pplx::task<int> GetUniqueNumberAsync()
+    {
+        return pplx::task_from_result(GetUniqueNumber());
+    }
+    virtual pplx::task<int> ReserveUniqueNumbersAsync(const int count)
+    {
+        return pplx::task_from_result(ReserveUniqueNumbers(count));
+    }
+    virtual pplx::task<bool> AddTweetAsync(const int userId, const std::string &tweetAsString, int maxTweets = 10)
+    {
+        return pplx::task_from_result(AddTweet(userId, tweetAsString, maxTweets));
+    }
+    virtual pplx::task<bool> AddTweetsAsync(const std::vector<std::pair<int, std::string>> &tweets,
+                                            std::shared_ptr<std::vector<bool>> spResults, int maxTweets = 10)
+    {
+        return pplx::task_from_result(AddTweets(tweets, *spResults, maxTweets));
+    }
+    virtual pplx::task<bool> GetRecentTweetsAsync(const std::vector<int> &userIdVector,
+                                                  std::shared_ptr<std::vector<std::string>> spTweets, int numberOfTweets = -1)
+    {
+        return pplx::task_from_result(GetRecentTweets(userIdVector, *spTweets, numberOfTweets));
+    }
+    virtual pplx::task<bool> GetRecentTweetListsAsync(const std::vector<int> &userIdVector,
+                                                      std::shared_ptr<std::vector<std::vector<std::string>>> spTweetLists,
+                                                      int numberOfTweets = -1)
+    {
+        return pplx::task_from_result(GetRecentTweetLists(userIdVector, *spTweetLists, numberOfTweets));
+    }
+    virtual pplx::task<bool> GetRecentTweetArenaAsync(const std::vector<int> &userIdVector,
+                                                      std::shared_ptr<TweetArena> spArena, int numberOfTweets = -1)
+    {
+        std::vector<std::vector<std::string>> tweetLists;
+        if (!GetRecentTweetLists(userIdVector, tweetLists, numberOfTweets))
+        {
+            return pplx::task_from_result(false);
+        }
+        for (const auto &tweetList : tweetLists)
+        {
+            for (const auto &tweet : tweetList)
+            {
+                spArena->Append(tweet);
+            }
+            spArena->EndList();
+        }
+        return pplx::task_from_result(true);
+    }
+    virtual pplx::task<bool> GetFolloweesAsync(const int userId, std::shared_ptr<std::vector<int>> spFollowees)
+    {
+        return pplx::task_from_result(GetFollowees(userId, *spFollowees));
+    }
+    virtual pplx::task<bool> AddFolloweeAsync(const int userId, const int followeeId)
+    {
+        return pplx::task_from_result(AddFollowee(userId, followeeId));
+    }
+    virtual pplx::task<bool> DelFolloweeAsync(const int userId, const int followeeId)
+    {
+        return pplx::task_from_result(DelFollowee(userId, followeeId));
+    }
+    virtual pplx::task<bool> AddFolloweeEdgeAsync(const int userId, const int followeeId)
+    {
+        return pplx::task_from_result(AddFolloweeEdge(userId, followeeId));
+    }
+    virtual pplx::task<bool> AddFollowerEdgeAsync(const int userId, const int followeeId)
+    {
+        return pplx::task_from_result(AddFollowerEdge(userId, followeeId));
+    }
+    virtual pplx::task<bool> DelFolloweeEdgeAsync(const int userId, const int followeeId)
+    {
+        return pplx::task_from_result(DelFolloweeEdge(userId, followeeId));
+    }
+    virtual pplx::task<bool> DelFollowerEdgeAsync(const int userId, const int followeeId)
+    {
+        return pplx::task_from_result(DelFollowerEdge(userId, followeeId));
+    }
+    virtual pplx::task<bool> GetFollowersAsync(const int userId, std::shared_ptr<std::vector<int>> spFollowers)
+    {
+        return pplx::task_from_result(GetFollowers(userId, *spFollowers));
+    }
+    virtual pplx::task<bool> GetFollowerCountsAsync(const std::vector<int> &userIdVector, std::shared_ptr<std::vector<int>> spCounts)
+    {
+        return pplx::task_from_result(GetFollowerCounts(userIdVector, *spCounts));
+    }
+    virtual pplx::task<bool> PushTimelinesAsync(const std::vector<int> &userIdVector, const std::string &tweetAsString, int maxTweets = 10)
+    {
+        return pplx::task_from_result(PushTimelines(userIdVector, tweetAsString, maxTweets));
+    }
+    virtual pplx::task<bool> GetTimelineTweetsAsync(const int userId, std::shared_ptr<std::vector<std::string>> spTweets, int numberOfTweets = -1)
+    {
+        return pplx::task_from_result(GetTimelineTweets(userId, *spTweets, numberOfTweets));
+    }
+    virtual pplx::task<bool> ReplaceTimelineTweetsAsync(const int userId, const std::vector<std::string> &expectedTweets,
+                                                        const std::vector<std::string> &tweets, std::shared_ptr<bool> spReplaced)
+    {
+        return pplx::task_from_result(ReplaceTimelineTweets(userId, expectedTweets, tweets, *spReplaced));
+    }
+
+    // Optional merge of the followees' recent tweets inside the datastore, one round-trip.
+    // Only used if HasServerSideMerge returns true.
+    virtual bool HasServerSideMerge() const
+    {
+        return false;
+    }
+    virtual pplx::task<bool> GetMergedTimelineAsync(const int /*userId*/, std::shared_ptr<std::vector<std::string>> /*spTweets*/,
+                                                    int /*maxTweets*/ = 10)
+    {
+        return pplx::task_from_result(false);
+    }
+
     virtual ~IDatastore() = default;
 };
 
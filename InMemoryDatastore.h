@@ -0,0 +1,610 @@
+/**
+ * @file      InMemoryDatastore.h
+ * @author    Atakan S.
+ * @version   1.0
+ * @brief     In-process lock-striped Datastore, concrete class.
+ *
+ * @copyright Copyright (c) 2020 Atakan SARIOGLU ~ www.atakansarioglu.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _H_INMEMORYDATASTORE_H_
+#define _H_INMEMORYDATASTORE_H_
+
+#include "IDatastore.h"
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class InMemoryDatastore : public IDatastore
+{
+private:
+    // One stripe of the store, guarded by its own lock.
+    struct Shard
+    {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<int, std::deque<std::string>> tweets;
+        std::unordered_map<int, std::unordered_set<int>> followees;
+        std::unordered_map<int, std::unordered_set<int>> followers;
+        std::unordered_map<int, std::deque<std::string>> timelines;
+    };
+
+    std::vector<Shard> m_shards;
+    std::atomic<int> m_uniqueNumber;
+    std::atomic<bool> m_connected;
+
+    /*
+     * @brief Select the shard that owns the records of a user.
+     * @param userId User
+     * @return Shard reference.
+     */
+    Shard &shardOf(const int userId)
+    {
+        return m_shards[static_cast<unsigned int>(userId) % m_shards.size()];
+    }
+
+    /*
+     * @brief Push to the front of a list and trim the tail, same as LPUSH and LTRIM.
+     * @param list Target list.
+     * @param value Serialized tweet.
+     * @param maxLength Keep no more than this number, -1 for unlimited.
+     */
+    static void pushTrimmed(std::deque<std::string> &list, const std::string &value, const int maxLength)
+    {
+        list.push_front(value);
+        if (maxLength > 0 && list.size() > static_cast<size_t>(maxLength))
+        {
+            list.resize(maxLength);
+        }
+    }
+
+    /*
+     * @brief Copy the head of a list, same as LRANGE 0 count-1.
+     * @param list Source list.
+     * @param output Output vector.
+     * @param count Number of elements, -1 for all.
+     */
+    static void copyHead(const std::deque<std::string> &list, std::vector<std::string> &output, const int count)
+    {
+        size_t length = list.size();
+        if (count >= 0 && static_cast<size_t>(count) < length)
+        {
+            length = count;
+        }
+        output.insert(output.end(), list.begin(), list.begin() + length);
+    }
+
+    /*
+     * @brief Remove a member from a set in a map, dropping the empty set like Redis drops empty keys.
+     * @param sets Map of sets.
+     * @param key Set key.
+     * @param member Member to remove.
+     */
+    static void eraseMember(std::unordered_map<int, std::unordered_set<int>> &sets, const int key, const int member)
+    {
+        auto it = sets.find(key);
+        if (it != sets.end())
+        {
+            it->second.erase(member);
+            if (it->second.empty())
+            {
+                sets.erase(it);
+            }
+        }
+    }
+
+public:
+    /*
+     * @brief Constructor for in-process datastore.
+     * @param shardCount Number of independently locked stripes.
+     */
+    InMemoryDatastore(const size_t shardCount = 64)
+        : m_shards(shardCount > 0 ? shardCount : 1), m_uniqueNumber(0), m_connected(false) {}
+
+    /*
+     * @brief Connect, nothing to do other than marking the state.
+     * @return True on success.
+     */
+    bool Connect()
+    {
+        m_connected = true;
+        return true;
+    }
+
+    /*
+     * @brief Disconnect, the stored records are kept.
+     * @return True on success.
+     */
+    bool Disconnect()
+    {
+        m_connected = false;
+        return true;
+    }
+
+    /*
+     * @brief Get connection state.
+     * @return True if connected.
+     */
+    bool IsConnected() const
+    {
+        return m_connected;
+    }
+
+    /*
+     * @brief Generate Unique Increasing ID Number
+     * @return Non-negative unique ID on success, -1 on error.
+     */
+    int GetUniqueNumber()
+    {
+        if (!IsConnected())
+        {
+            return -1;
+        }
+
+        // Same sequence as Redis INCR, the first ID is 1.
+        return ++m_uniqueNumber;
+    }
+
+    /*
+     * @brief Reserve a block of unique increasing ID numbers.
+     * @param count Number of IDs in the block.
+     * @return The last ID of the block on success, -1 on error.
+     */
+    int ReserveUniqueNumbers(const int count)
+    {
+        if (!IsConnected() || count < 1)
+        {
+            return -1;
+        }
+
+        // Same as Redis INCRBY.
+        return m_uniqueNumber += count;
+    }
+
+    /*
+     * @brief Adds tweet to the users list.
+     * @param userId
+     * @param tweetAsString Serialized tweet object.
+     * @param maxTweets Keep no more than this number on datastore, -1 for unlimited.
+     * @return True on success.
+     */
+    bool AddTweet(const int userId, const std::string &tweetAsString, int maxTweets = 10)
+    {
+        if (!IsConnected())
+        {
+            return false;
+        }
+
+        auto &shard = shardOf(userId);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+
+        pushTrimmed(shard.tweets[userId], tweetAsString, maxTweets);
+
+        return true;
+    }
+
+    /*
+     * @brief Adds several tweets to the lists of their authors, in order.
+     * @param tweets Author and serialized tweet object of each tweet.
+     * @param results Output vector, true for each stored tweet.
+     * @param maxTweets Keep no more than this number on datastore, -1 for unlimited.
+     * @return True if all tweets are stored.
+     */
+    bool AddTweets(const std::vector<std::pair<int, std::string>> &tweets, std::vector<bool> &results,
+                   int maxTweets = 10)
+    {
+        results.assign(tweets.size(), false);
+        if (!IsConnected())
+        {
+            return false;
+        }
+
+        for (size_t i = 0; i < tweets.size(); ++i)
+        {
+            auto &shard = shardOf(tweets[i].first);
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            pushTrimmed(shard.tweets[tweets[i].first], tweets[i].second, maxTweets);
+            results[i] = true;
+        }
+
+        return true;
+    }
+
+    /*
+     * @brief Get recent tweets of all followed users.
+     * @param userIdVector users to fetch the recent tweets.
+     * @param tweets Output vector for fetched tweets.
+     * @param numberOfTweets Number of tweets for each user, -1 for all tweets.
+     * @return True on success.
+     */
+    bool GetRecentTweets(const std::vector<int> &userIdVector,
+                         std::vector<std::string> &tweets, int numberOfTweets = -1)
+    {
+        if (!IsConnected())
+        {
+            return false;
+        }
+
+        for (auto userId : userIdVector)
+        {
+            auto &shard = shardOf(userId);
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+
+            // Copy the newest ones, the list is already ordered.
+            auto it = shard.tweets.find(userId);
+            if (it != shard.tweets.end())
+            {
+                copyHead(it->second, tweets, numberOfTweets);
+            }
+        }
+
+        return true;
+    }
+
+    /*
+     * @brief Get recent tweets of several users, one list per user.
+     * @param userIdVector users to fetch the recent tweets.
+     * @param tweetLists Output, one list per user in the same order, most recent first.
+     * @param numberOfTweets Number of tweets for each user, -1 for all tweets.
+     * @return True on success.
+     */
+    bool GetRecentTweetLists(const std::vector<int> &userIdVector,
+                             std::vector<std::vector<std::string>> &tweetLists, int numberOfTweets = -1)
+    {
+        if (!IsConnected())
+        {
+            return false;
+        }
+
+        for (auto userId : userIdVector)
+        {
+            auto &shard = shardOf(userId);
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+
+            tweetLists.emplace_back();
+            auto it = shard.tweets.find(userId);
+            if (it != shard.tweets.end())
+            {
+                copyHead(it->second, tweetLists.back(), numberOfTweets);
+            }
+        }
+
+        return true;
+    }
+
+    /*
+     * @brief Get the recent tweets of each user into a per-request arena, one list per user.
+     * @param userIdVector users to fetch the recent tweets.
+     * @param spArena Output arena, gets one list per user in the same order.
+     * @param numberOfTweets Number of tweets for each user, -1 for all tweets.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> GetRecentTweetArenaAsync(const std::vector<int> &userIdVector,
+                                              std::shared_ptr<TweetArena> spArena, int numberOfTweets = -1)
+    {
+        if (!IsConnected())
+        {
+            return pplx::task_from_result(false);
+        }
+
+        for (auto userId : userIdVector)
+        {
+            auto &shard = shardOf(userId);
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+
+            auto it = shard.tweets.find(userId);
+            if (it != shard.tweets.end())
+            {
+                size_t length = it->second.size();
+                if (numberOfTweets >= 0 && static_cast<size_t>(numberOfTweets) < length)
+                {
+                    length = numberOfTweets;
+                }
+                for (size_t i = 0; i < length; ++i)
+                {
+                    spArena->Append(it->second[i]);
+                }
+            }
+            spArena->EndList();
+        }
+
+        return pplx::task_from_result(true);
+    }
+
+    /*
+     * @brief Get followed users of userId.
+     * @param userId users to fetch the recent tweets.
+     * @param followees Output vector for followees.
+     * @return True on success.
+     */
+    bool GetFollowees(const int userId, std::vector<int> &followees)
+    {
+        if (!IsConnected())
+        {
+            return false;
+        }
+
+        auto &shard = shardOf(userId);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+
+        auto it = shard.followees.find(userId);
+        if (it != shard.followees.end())
+        {
+            followees.insert(followees.end(), it->second.begin(), it->second.end());
+        }
+
+        return true;
+    }
+
+    /*
+     * @brief Create userId->followeeId record.
+     * @param userId follower
+     * @param followeeId followee
+     * @return True on success.
+     */
+    bool AddFollowee(const int userId, const int followeeId)
+    {
+        // Reverse index lives in the shard of the followee.
+        return AddFolloweeEdge(userId, followeeId) && AddFollowerEdge(userId, followeeId);
+    }
+
+    /*
+     * @brief Remove userId->followeeId record.
+     * @param userId follower
+     * @param followeeId followee
+     * @return True on success.
+     */
+    bool DelFollowee(const int userId, const int followeeId)
+    {
+        return DelFolloweeEdge(userId, followeeId) && DelFollowerEdge(userId, followeeId);
+    }
+
+    /*
+     * @brief Add followeeId to the followees of userId.
+     * @param userId follower
+     * @param followeeId followee
+     * @return True on success.
+     */
+    bool AddFolloweeEdge(const int userId, const int followeeId)
+    {
+        if (!IsConnected())
+        {
+            return false;
+        }
+
+        auto &shard = shardOf(userId);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        shard.followees[userId].insert(followeeId);
+        return true;
+    }
+
+    /*
+     * @brief Add userId to the followers of followeeId.
+     * @param userId follower
+     * @param followeeId followee
+     * @return True on success.
+     */
+    bool AddFollowerEdge(const int userId, const int followeeId)
+    {
+        if (!IsConnected())
+        {
+            return false;
+        }
+
+        auto &shard = shardOf(followeeId);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        shard.followers[followeeId].insert(userId);
+        return true;
+    }
+
+    /*
+     * @brief Remove followeeId from the followees of userId.
+     * @param userId follower
+     * @param followeeId followee
+     * @return True on success.
+     */
+    bool DelFolloweeEdge(const int userId, const int followeeId)
+    {
+        if (!IsConnected())
+        {
+            return false;
+        }
+
+        auto &shard = shardOf(userId);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        eraseMember(shard.followees, userId, followeeId);
+        return true;
+    }
+
+    /*
+     * @brief Remove userId from the followers of followeeId.
+     * @param userId follower
+     * @param followeeId followee
+     * @return True on success.
+     */
+    bool DelFollowerEdge(const int userId, const int followeeId)
+    {
+        if (!IsConnected())
+        {
+            return false;
+        }
+
+        auto &shard = shardOf(followeeId);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        eraseMember(shard.followers, followeeId, userId);
+        return true;
+    }
+
+    /*
+     * @brief Get users following userId.
+     * @param userId followee
+     * @param followers Output vector for followers.
+     * @return True on success.
+     */
+    bool GetFollowers(const int userId, std::vector<int> &followers)
+    {
+        if (!IsConnected())
+        {
+            return false;
+        }
+
+        auto &shard = shardOf(userId);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+
+        auto it = shard.followers.find(userId);
+        if (it != shard.followers.end())
+        {
+            followers.insert(followers.end(), it->second.begin(), it->second.end());
+        }
+
+        return true;
+    }
+
+    /*
+     * @brief Get the number of followers of several users.
+     * @param userIdVector Users to count the followers of.
+     * @param counts Output vector, same order as userIdVector.
+     * @return True on success.
+     */
+    bool GetFollowerCounts(const std::vector<int> &userIdVector, std::vector<int> &counts)
+    {
+        if (!IsConnected())
+        {
+            return false;
+        }
+
+        for (auto userId : userIdVector)
+        {
+            auto &shard = shardOf(userId);
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+
+            auto it = shard.followers.find(userId);
+            counts.push_back(it == shard.followers.end() ? 0 : static_cast<int>(it->second.size()));
+        }
+
+        return true;
+    }
+
+    /*
+     * @brief Push a tweet to the materialized timelines of several users.
+     * @param userIdVector Owners of the timelines.
+     * @param tweetAsString Serialized tweet object.
+     * @param maxTweets Keep no more than this number per timeline, -1 for unlimited.
+     * @return True on success.
+     */
+    bool PushTimelines(const std::vector<int> &userIdVector, const std::string &tweetAsString, int maxTweets = 10)
+    {
+        if (!IsConnected())
+        {
+            return false;
+        }
+
+        for (auto userId : userIdVector)
+        {
+            auto &shard = shardOf(userId);
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            pushTrimmed(shard.timelines[userId], tweetAsString, maxTweets);
+        }
+
+        return true;
+    }
+
+    /*
+     * @brief Get the materialized timeline of a user.
+     * @param userId Owner of the timeline.
+     * @param tweets Output vector for fetched tweets, most recent first.
+     * @param numberOfTweets Number of tweets to read, -1 for all tweets.
+     * @return True on success.
+     */
+    bool GetTimelineTweets(const int userId, std::vector<std::string> &tweets, int numberOfTweets = -1)
+    {
+        if (!IsConnected())
+        {
+            return false;
+        }
+
+        auto &shard = shardOf(userId);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+
+        auto it = shard.timelines.find(userId);
+        if (it != shard.timelines.end())
+        {
+            copyHead(it->second, tweets, numberOfTweets);
+        }
+
+        return true;
+    }
+
+    /*
+     * @brief Replace the materialized timeline of a user if its head is still the expected one.
+     * @param userId Owner of the timeline.
+     * @param expectedTweets Head of the timeline as read before, empty if there was no timeline.
+     * @param tweets Serialized tweets, most recent first.
+     * @param replaced Output, false if a push changed the timeline since the read.
+     * @return True on success.
+     */
+    bool ReplaceTimelineTweets(const int userId, const std::vector<std::string> &expectedTweets,
+                               const std::vector<std::string> &tweets, bool &replaced)
+    {
+        if (!IsConnected())
+        {
+            return false;
+        }
+
+        auto &shard = shardOf(userId);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+
+        // Compare the head, a push always changes the front of the list.
+        auto it = shard.timelines.find(userId);
+        size_t length = (it == shard.timelines.end()) ? 0 : it->second.size();
+        if (expectedTweets.empty())
+        {
+            replaced = (length == 0);
+        }
+        else
+        {
+            replaced = length >= expectedTweets.size() &&
+                       std::equal(expectedTweets.begin(), expectedTweets.end(), it->second.begin());
+        }
+        if (!replaced)
+        {
+            return true;
+        }
+
+        if (tweets.empty())
+        {
+            shard.timelines.erase(userId);
+        }
+        else
+        {
+            shard.timelines[userId].assign(tweets.begin(), tweets.end());
+        }
+
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,226 @@
+/**
+ * @file      LatencyHistogram.h
+ * @author    Atakan S.
+ * @version   1.0
+ * @brief     Lock-free latency histogram with logarithmic buckets.
+ *
+ * @copyright Copyright (c) 2020 Atakan SARIOGLU ~ www.atakansarioglu.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _H_LATENCYHISTOGRAM_H_
+#define _H_LATENCYHISTOGRAM_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * @brief Histogram of latencies in microseconds. Each power of two range is split into
+ *        16 linear buckets, so a value is kept with a relative error of at most 1/16,
+ *        like an HDR histogram with one significant digit. Recording is a few relaxed
+ *        atomic increments, threads record concurrently without locks.
+ */
+class LatencyHistogram
+{
+private:
+    // Linear buckets in each power of two range.
+    static constexpr size_t SUB_BUCKETS = 16;
+
+    // Values below this are counted exactly.
+    static constexpr uint64_t LINEAR_LIMIT = 2 * SUB_BUCKETS;
+
+    // Largest tracked power of two, longer latencies (about 2 days) are clamped.
+    static constexpr size_t MAX_EXPONENT = 37;
+
+    // Number of buckets.
+    static constexpr size_t BUCKET_COUNT = LINEAR_LIMIT + (MAX_EXPONENT - 4) * SUB_BUCKETS;
+
+    // Count of values in each bucket.
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> m_buckets;
+
+    // Number, sum and largest of the values.
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_sum;
+    std::atomic<uint64_t> m_max;
+
+    /*
+     * @brief Index of the highest set bit.
+     * @param value Non-zero value.
+     * @return Bit index.
+     */
+    static size_t exponent(const uint64_t value)
+    {
+        return 63 - __builtin_clzll(value);
+    }
+
+    /*
+     * @brief Bucket of a value.
+     * @param value Latency in microseconds.
+     * @return Bucket index.
+     */
+    static size_t bucketOf(const uint64_t value)
+    {
+        if (value < LINEAR_LIMIT)
+        {
+            return value;
+        }
+        size_t index = LINEAR_LIMIT + (exponent(value) - 5) * SUB_BUCKETS +
+                       ((value >> (exponent(value) - 4)) - SUB_BUCKETS);
+        return (index < BUCKET_COUNT) ? index : BUCKET_COUNT - 1;
+    }
+
+    /*
+     * @brief Largest value counted in a bucket.
+     * @param index Bucket index.
+     * @return Latency in microseconds.
+     */
+    static uint64_t upperBoundOf(const size_t index)
+    {
+        if (index < LINEAR_LIMIT)
+        {
+            return index;
+        }
+        size_t shift = (index - LINEAR_LIMIT) / SUB_BUCKETS + 1;
+        uint64_t sub = SUB_BUCKETS + (index - LINEAR_LIMIT) % SUB_BUCKETS;
+        return ((sub + 1) << shift) - 1;
+    }
+
+public:
+    /*
+     * @brief Constructor of an empty histogram.
+     */
+    LatencyHistogram() : m_count(0), m_sum(0), m_max(0)
+    {
+        for (auto &bucket : m_buckets)
+        {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /*
+     * @brief Count a latency.
+     * @param micros Latency in microseconds.
+     */
+    void Record(const uint64_t micros)
+    {
+        m_buckets[bucketOf(micros)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(micros, std::memory_order_relaxed);
+        uint64_t max = m_max.load(std::memory_order_relaxed);
+        while (micros > max && !m_max.compare_exchange_weak(max, micros, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    /*
+     * @brief Add the counts of another histogram.
+     * @param other Histogram to add.
+     */
+    void Merge(const LatencyHistogram &other)
+    {
+        for (size_t i = 0; i < BUCKET_COUNT; ++i)
+        {
+            m_buckets[i].fetch_add(other.m_buckets[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        m_count.fetch_add(other.Count(), std::memory_order_relaxed);
+        m_sum.fetch_add(other.Sum(), std::memory_order_relaxed);
+        uint64_t otherMax = other.Max();
+        uint64_t max = m_max.load(std::memory_order_relaxed);
+        while (otherMax > max && !m_max.compare_exchange_weak(max, otherMax, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    /*
+     * @brief Getter for the number of values.
+     * @return Count.
+     */
+    uint64_t Count() const
+    {
+        return m_count.load(std::memory_order_relaxed);
+    }
+
+    /*
+     * @brief Getter for the sum of the values.
+     * @return Sum in microseconds.
+     */
+    uint64_t Sum() const
+    {
+        return m_sum.load(std::memory_order_relaxed);
+    }
+
+    /*
+     * @brief Getter for the largest value.
+     * @return Latency in microseconds.
+     */
+    uint64_t Max() const
+    {
+        return m_max.load(std::memory_order_relaxed);
+    }
+
+    /*
+     * @brief Number of values not larger than a limit, exact when the limit is a bucket bound
+     *        and counts the whole bucket of the limit otherwise.
+     * @param micros Limit in microseconds.
+     * @return Count.
+     */
+    uint64_t CountAtMost(const uint64_t micros) const
+    {
+        uint64_t count = 0;
+        size_t last = bucketOf(micros);
+        for (size_t i = 0; i <= last; ++i)
+        {
+            count += m_buckets[i].load(std::memory_order_relaxed);
+        }
+        return count;
+    }
+
+    /*
+     * @brief Value below which a fraction of the values fall.
+     * @param quantile Fraction in [0, 1], e.g. 0.99 for the p99.
+     * @return Upper bound of the bucket of the quantile in microseconds, 0 if empty.
+     */
+    uint64_t Percentile(const double quantile) const
+    {
+        uint64_t count = Count();
+        if (count == 0)
+        {
+            return 0;
+        }
+
+        uint64_t rank = static_cast<uint64_t>(quantile * count + 0.5);
+        rank = (rank < 1) ? 1 : (rank > count ? count : rank);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKET_COUNT; ++i)
+        {
+            seen += m_buckets[i].load(std::memory_order_relaxed);
+            if (seen >= rank)
+            {
+                uint64_t bound = upperBoundOf(i);
+                return (bound < Max()) ? bound : Max();
+            }
+        }
+        return Max();
+    }
+};
+
+#endif
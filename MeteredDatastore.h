@@ -0,0 +1,572 @@
+/**
+ * @file      MeteredDatastore.h
+ * @author    Atakan S.
+ * @version   1.0
+ * @brief     Datastore decorator that records the metrics of each method.
+ *
+ * @copyright Copyright (c) 2020 Atakan SARIOGLU ~ www.atakansarioglu.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _H_METEREDDATASTORE_H_
+#define _H_METEREDDATASTORE_H_
+
+#include "IDatastore.h"
+#include "Metrics.h"
+#include "AdaptiveLimit.h"
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * @brief Decorator that forwards every call to a datastore and records its latency,
+ *        failures and tweet payload bytes. Asynchronous calls are measured until their
+ *        task completes.
+ */
+class MeteredDatastore : public IDatastore
+{
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Measured methods, index into m_operations.
+    enum class Method : size_t
+    {
+        GetUniqueNumber,
+        ReserveUniqueNumbers,
+        AddTweet,
+        AddTweets,
+        GetRecentTweets,
+        GetRecentTweetLists,
+        GetFollowees,
+        AddFollowee,
+        DelFollowee,
+        AddFolloweeEdge,
+        AddFollowerEdge,
+        DelFolloweeEdge,
+        DelFollowerEdge,
+        GetFollowers,
+        GetFollowerCounts,
+        PushTimelines,
+        GetTimelineTweets,
+        ReplaceTimelineTweets,
+        GetUniqueNumberAsync,
+        ReserveUniqueNumbersAsync,
+        AddTweetAsync,
+        AddTweetsAsync,
+        GetRecentTweetsAsync,
+        GetRecentTweetListsAsync,
+        GetRecentTweetArenaAsync,
+        GetFolloweesAsync,
+        AddFolloweeAsync,
+        DelFolloweeAsync,
+        AddFolloweeEdgeAsync,
+        AddFollowerEdgeAsync,
+        DelFolloweeEdgeAsync,
+        DelFollowerEdgeAsync,
+        GetFollowersAsync,
+        GetFollowerCountsAsync,
+        PushTimelinesAsync,
+        GetTimelineTweetsAsync,
+        ReplaceTimelineTweetsAsync,
+        GetMergedTimelineAsync,
+        Count
+    };
+
+    // Decorated datastore.
+    std::shared_ptr<IDatastore> m_spDatastore;
+
+    // Metrics of each method, owned by the registry.
+    std::array<OperationMetrics *, static_cast<size_t>(Method::Count)> m_operations;
+
+    // Request limit fed with the latency of every call, optional.
+    std::shared_ptr<AdaptiveLimit> m_spLimit;
+
+    /*
+     * @brief Record the outcome of a call.
+     * @param pOperation Metrics of the method.
+     * @param pLimit Request limit, optional.
+     * @param micros Latency of the call.
+     * @param success True on success.
+     * @param bytes Payload bytes.
+     */
+    static void record(OperationMetrics *pOperation, AdaptiveLimit *pLimit, const uint64_t micros, const bool success,
+                       const size_t bytes = 0)
+    {
+        pOperation->Record(micros, success, bytes);
+        if (pLimit)
+        {
+            pLimit->Observe(micros, success);
+        }
+    }
+
+    /*
+     * @brief Microseconds elapsed since a point in time.
+     * @param start Start time.
+     * @return Elapsed time.
+     */
+    static uint64_t microsSince(const Clock::time_point start)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+    }
+
+    /*
+     * @brief Success of a call by its result, IDs are -1 on failure.
+     * @param result Result of the call.
+     * @return True on success.
+     */
+    static bool succeeded(const bool result)
+    {
+        return result;
+    }
+    static bool succeeded(const int result)
+    {
+        return result != -1;
+    }
+
+    /*
+     * @brief Payload bytes of serialized tweets.
+     * @param tweets Tweets.
+     * @return Bytes
+     */
+    static size_t bytesOf(const std::vector<std::string> &tweets)
+    {
+        size_t bytes = 0;
+        for (const auto &tweet : tweets)
+        {
+            bytes += tweet.size();
+        }
+        return bytes;
+    }
+    static size_t bytesOf(const std::vector<std::vector<std::string>> &tweetLists)
+    {
+        size_t bytes = 0;
+        for (const auto &tweets : tweetLists)
+        {
+            bytes += bytesOf(tweets);
+        }
+        return bytes;
+    }
+    static size_t bytesOf(const std::vector<std::pair<int, std::string>> &tweets)
+    {
+        size_t bytes = 0;
+        for (const auto &tweet : tweets)
+        {
+            bytes += tweet.second.size();
+        }
+        return bytes;
+    }
+
+    /*
+     * @brief Measure a synchronous call, a thrown exception counts as a failure.
+     * @param method Measured method.
+     * @param call Calls the decorated datastore.
+     * @param bytes Returns the payload bytes after a successful call.
+     * @return Result of the call.
+     */
+    template <typename Call, typename Bytes>
+    auto meter(const Method method, const Call &call, const Bytes &bytes) -> decltype(call())
+    {
+        auto start = Clock::now();
+        decltype(call()) result;
+        try
+        {
+            result = call();
+        }
+        catch (...)
+        {
+            record(m_operations[static_cast<size_t>(method)], m_spLimit.get(), microsSince(start), false);
+            throw;
+        }
+        bool success = succeeded(result);
+        record(m_operations[static_cast<size_t>(method)], m_spLimit.get(), microsSince(start), success, success ? bytes() : 0);
+        return result;
+    }
+
+    /*
+     * @brief Measure an asynchronous call until its task completes.
+     * @param method Measured method.
+     * @param call Calls the decorated datastore, returns its task.
+     * @param bytes Returns the payload bytes after a successful call, run on completion.
+     * @return Task of the call.
+     */
+    template <typename Call, typename Bytes>
+    auto meterAsync(const Method method, const Call &call, Bytes bytes) -> decltype(call())
+    {
+        using Result = decltype(call().get());
+        auto start = Clock::now();
+        auto pOperation = m_operations[static_cast<size_t>(method)];
+        decltype(call()) task;
+        try
+        {
+            task = call();
+        }
+        catch (...)
+        {
+            record(pOperation, m_spLimit.get(), microsSince(start), false);
+            throw;
+        }
+        return task.then([pOperation, spLimit = m_spLimit, start, bytes](pplx::task<Result> resultTask) {
+            Result result;
+            try
+            {
+                result = resultTask.get();
+            }
+            catch (...)
+            {
+                record(pOperation, spLimit.get(), microsSince(start), false);
+                throw;
+            }
+            bool success = succeeded(result);
+            record(pOperation, spLimit.get(), microsSince(start), success, success ? bytes() : 0);
+            return result;
+        });
+    }
+
+public:
+    /*
+     * @brief Constructor of the decorator.
+     * @param spDatastore Datastore to measure.
+     * @param spMetrics Registry, the methods are in the "datastore" family.
+     * @param spLimit Request limit adapted to the latency of the calls, optional.
+     */
+    MeteredDatastore(std::shared_ptr<IDatastore> spDatastore, std::shared_ptr<Metrics> spMetrics,
+                     std::shared_ptr<AdaptiveLimit> spLimit = nullptr)
+        : m_spDatastore(spDatastore), m_spLimit(spLimit)
+    {
+        static const char *names[static_cast<size_t>(Method::Count)] = {
+            "GetUniqueNumber",
+            "ReserveUniqueNumbers",
+            "AddTweet",
+            "AddTweets",
+            "GetRecentTweets",
+            "GetRecentTweetLists",
+            "GetFollowees",
+            "AddFollowee",
+            "DelFollowee",
+            "AddFolloweeEdge",
+            "AddFollowerEdge",
+            "DelFolloweeEdge",
+            "DelFollowerEdge",
+            "GetFollowers",
+            "GetFollowerCounts",
+            "PushTimelines",
+            "GetTimelineTweets",
+            "ReplaceTimelineTweets",
+            "GetUniqueNumberAsync",
+            "ReserveUniqueNumbersAsync",
+            "AddTweetAsync",
+            "AddTweetsAsync",
+            "GetRecentTweetsAsync",
+            "GetRecentTweetListsAsync",
+            "GetRecentTweetArenaAsync",
+            "GetFolloweesAsync",
+            "AddFolloweeAsync",
+            "DelFolloweeAsync",
+            "AddFolloweeEdgeAsync",
+            "AddFollowerEdgeAsync",
+            "DelFolloweeEdgeAsync",
+            "DelFollowerEdgeAsync",
+            "GetFollowersAsync",
+            "GetFollowerCountsAsync",
+            "PushTimelinesAsync",
+            "GetTimelineTweetsAsync",
+            "ReplaceTimelineTweetsAsync",
+            "GetMergedTimelineAsync",
+        };
+        for (size_t method = 0; method < m_operations.size(); ++method)
+        {
+            m_operations[method] = &spMetrics->Operation("datastore", names[method]);
+        }
+    }
+
+    // The connection state is forwarded without measuring.
+    bool Connect()
+    {
+        return m_spDatastore->Connect();
+    }
+
+    bool Disconnect()
+    {
+        return m_spDatastore->Disconnect();
+    }
+
+    bool IsConnected() const
+    {
+        return m_spDatastore->IsConnected();
+    }
+
+    bool HasServerSideMerge() const
+    {
+        return m_spDatastore->HasServerSideMerge();
+    }
+
+    // Measured calls, see IDatastore.
+    int GetUniqueNumber()
+    {
+        return meter(Method::GetUniqueNumber, [&]() { return m_spDatastore->GetUniqueNumber(); },
+                     []() { return size_t(0); });
+    }
+
+    int ReserveUniqueNumbers(const int count)
+    {
+        return meter(Method::ReserveUniqueNumbers, [&]() { return m_spDatastore->ReserveUniqueNumbers(count); },
+                     []() { return size_t(0); });
+    }
+
+    bool AddTweet(const int userId, const std::string &tweetAsString, int maxTweets = 10)
+    {
+        return meter(Method::AddTweet, [&]() { return m_spDatastore->AddTweet(userId, tweetAsString, maxTweets); },
+                     [&]() { return tweetAsString.size(); });
+    }
+
+    bool AddTweets(const std::vector<std::pair<int, std::string>> &tweets, std::vector<bool> &results,
+                   int maxTweets = 10)
+    {
+        return meter(Method::AddTweets, [&]() { return m_spDatastore->AddTweets(tweets, results, maxTweets); },
+                     [&]() { return bytesOf(tweets); });
+    }
+
+    bool GetRecentTweets(const std::vector<int> &userIdVector, std::vector<std::string> &tweets, int numberOfTweets = -1)
+    {
+        return meter(Method::GetRecentTweets, [&]() { return m_spDatastore->GetRecentTweets(userIdVector, tweets, numberOfTweets); },
+                     [&]() { return bytesOf(tweets); });
+    }
+
+    bool GetRecentTweetLists(const std::vector<int> &userIdVector, std::vector<std::vector<std::string>> &tweetLists,
+                             int numberOfTweets = -1)
+    {
+        return meter(Method::GetRecentTweetLists, [&]() { return m_spDatastore->GetRecentTweetLists(userIdVector, tweetLists, numberOfTweets); },
+                     [&]() { return bytesOf(tweetLists); });
+    }
+
+    bool GetFollowees(const int userId, std::vector<int> &followees)
+    {
+        return meter(Method::GetFollowees, [&]() { return m_spDatastore->GetFollowees(userId, followees); },
+                     []() { return size_t(0); });
+    }
+
+    bool AddFollowee(const int userId, const int followeeId)
+    {
+        return meter(Method::AddFollowee, [&]() { return m_spDatastore->AddFollowee(userId, followeeId); },
+                     []() { return size_t(0); });
+    }
+
+    bool DelFollowee(const int userId, const int followeeId)
+    {
+        return meter(Method::DelFollowee, [&]() { return m_spDatastore->DelFollowee(userId, followeeId); },
+                     []() { return size_t(0); });
+    }
+
+    bool AddFolloweeEdge(const int userId, const int followeeId)
+    {
+        return meter(Method::AddFolloweeEdge, [&]() { return m_spDatastore->AddFolloweeEdge(userId, followeeId); },
+                     []() { return size_t(0); });
+    }
+
+    bool AddFollowerEdge(const int userId, const int followeeId)
+    {
+        return meter(Method::AddFollowerEdge, [&]() { return m_spDatastore->AddFollowerEdge(userId, followeeId); },
+                     []() { return size_t(0); });
+    }
+
+    bool DelFolloweeEdge(const int userId, const int followeeId)
+    {
+        return meter(Method::DelFolloweeEdge, [&]() { return m_spDatastore->DelFolloweeEdge(userId, followeeId); },
+                     []() { return size_t(0); });
+    }
+
+    bool DelFollowerEdge(const int userId, const int followeeId)
+    {
+        return meter(Method::DelFollowerEdge, [&]() { return m_spDatastore->DelFollowerEdge(userId, followeeId); },
+                     []() { return size_t(0); });
+    }
+
+    bool GetFollowers(const int userId, std::vector<int> &followers)
+    {
+        return meter(Method::GetFollowers, [&]() { return m_spDatastore->GetFollowers(userId, followers); },
+                     []() { return size_t(0); });
+    }
+
+    bool GetFollowerCounts(const std::vector<int> &userIdVector, std::vector<int> &counts)
+    {
+        return meter(Method::GetFollowerCounts, [&]() { return m_spDatastore->GetFollowerCounts(userIdVector, counts); },
+                     []() { return size_t(0); });
+    }
+
+    bool PushTimelines(const std::vector<int> &userIdVector, const std::string &tweetAsString, int maxTweets = 10)
+    {
+        return meter(Method::PushTimelines, [&]() { return m_spDatastore->PushTimelines(userIdVector, tweetAsString, maxTweets); },
+                     [&]() { return tweetAsString.size() * userIdVector.size(); });
+    }
+
+    bool GetTimelineTweets(const int userId, std::vector<std::string> &tweets, int numberOfTweets = -1)
+    {
+        return meter(Method::GetTimelineTweets, [&]() { return m_spDatastore->GetTimelineTweets(userId, tweets, numberOfTweets); },
+                     [&]() { return bytesOf(tweets); });
+    }
+
+    bool ReplaceTimelineTweets(const int userId, const std::vector<std::string> &expectedTweets,
+                               const std::vector<std::string> &tweets, bool &replaced)
+    {
+        return meter(Method::ReplaceTimelineTweets,
+                     [&]() { return m_spDatastore->ReplaceTimelineTweets(userId, expectedTweets, tweets, replaced); },
+                     [&]() { return bytesOf(expectedTweets) + bytesOf(tweets); });
+    }
+
+    pplx::task<int> GetUniqueNumberAsync()
+    {
+        return meterAsync(Method::GetUniqueNumberAsync, [&]() { return m_spDatastore->GetUniqueNumberAsync(); },
+                          []() { return size_t(0); });
+    }
+
+    pplx::task<int> ReserveUniqueNumbersAsync(const int count)
+    {
+        return meterAsync(Method::ReserveUniqueNumbersAsync, [&]() { return m_spDatastore->ReserveUniqueNumbersAsync(count); },
+                          []() { return size_t(0); });
+    }
+
+    pplx::task<bool> AddTweetAsync(const int userId, const std::string &tweetAsString, int maxTweets = 10)
+    {
+        size_t bytes = tweetAsString.size();
+        return meterAsync(Method::AddTweetAsync, [&]() { return m_spDatastore->AddTweetAsync(userId, tweetAsString, maxTweets); },
+                          [bytes]() { return bytes; });
+    }
+
+    pplx::task<bool> AddTweetsAsync(const std::vector<std::pair<int, std::string>> &tweets,
+                                    std::shared_ptr<std::vector<bool>> spResults, int maxTweets = 10)
+    {
+        size_t bytes = bytesOf(tweets);
+        return meterAsync(Method::AddTweetsAsync, [&]() { return m_spDatastore->AddTweetsAsync(tweets, spResults, maxTweets); },
+                          [bytes]() { return bytes; });
+    }
+
+    pplx::task<bool> GetRecentTweetsAsync(const std::vector<int> &userIdVector, std::shared_ptr<std::vector<std::string>> spTweets,
+                                          int numberOfTweets = -1)
+    {
+        return meterAsync(Method::GetRecentTweetsAsync, [&]() { return m_spDatastore->GetRecentTweetsAsync(userIdVector, spTweets, numberOfTweets); },
+                          [spTweets]() { return bytesOf(*spTweets); });
+    }
+
+    pplx::task<bool> GetRecentTweetListsAsync(const std::vector<int> &userIdVector,
+                                              std::shared_ptr<std::vector<std::vector<std::string>>> spTweetLists,
+                                              int numberOfTweets = -1)
+    {
+        return meterAsync(Method::GetRecentTweetListsAsync, [&]() { return m_spDatastore->GetRecentTweetListsAsync(userIdVector, spTweetLists, numberOfTweets); },
+                          [spTweetLists]() { return bytesOf(*spTweetLists); });
+    }
+
+    pplx::task<bool> GetRecentTweetArenaAsync(const std::vector<int> &userIdVector, std::shared_ptr<TweetArena> spArena,
+                                              int numberOfTweets = -1)
+    {
+        size_t initialBytes = spArena->Bytes();
+        return meterAsync(Method::GetRecentTweetArenaAsync, [&]() { return m_spDatastore->GetRecentTweetArenaAsync(userIdVector, spArena, numberOfTweets); },
+                          [spArena, initialBytes]() { return spArena->Bytes() - initialBytes; });
+    }
+
+    pplx::task<bool> GetFolloweesAsync(const int userId, std::shared_ptr<std::vector<int>> spFollowees)
+    {
+        return meterAsync(Method::GetFolloweesAsync, [&]() { return m_spDatastore->GetFolloweesAsync(userId, spFollowees); },
+                          []() { return size_t(0); });
+    }
+
+    pplx::task<bool> AddFolloweeAsync(const int userId, const int followeeId)
+    {
+        return meterAsync(Method::AddFolloweeAsync, [&]() { return m_spDatastore->AddFolloweeAsync(userId, followeeId); },
+                          []() { return size_t(0); });
+    }
+
+    pplx::task<bool> DelFolloweeAsync(const int userId, const int followeeId)
+    {
+        return meterAsync(Method::DelFolloweeAsync, [&]() { return m_spDatastore->DelFolloweeAsync(userId, followeeId); },
+                          []() { return size_t(0); });
+    }
+
+    pplx::task<bool> AddFolloweeEdgeAsync(const int userId, const int followeeId)
+    {
+        return meterAsync(Method::AddFolloweeEdgeAsync, [&]() { return m_spDatastore->AddFolloweeEdgeAsync(userId, followeeId); },
+                          []() { return size_t(0); });
+    }
+
+    pplx::task<bool> AddFollowerEdgeAsync(const int userId, const int followeeId)
+    {
+        return meterAsync(Method::AddFollowerEdgeAsync, [&]() { return m_spDatastore->AddFollowerEdgeAsync(userId, followeeId); },
+                          []() { return size_t(0); });
+    }
+
+    pplx::task<bool> DelFolloweeEdgeAsync(const int userId, const int followeeId)
+    {
+        return meterAsync(Method::DelFolloweeEdgeAsync, [&]() { return m_spDatastore->DelFolloweeEdgeAsync(userId, followeeId); },
+                          []() { return size_t(0); });
+    }
+
+    pplx::task<bool> DelFollowerEdgeAsync(const int userId, const int followeeId)
+    {
+        return meterAsync(Method::DelFollowerEdgeAsync, [&]() { return m_spDatastore->DelFollowerEdgeAsync(userId, followeeId); },
+                          []() { return size_t(0); });
+    }
+
+    pplx::task<bool> GetFollowersAsync(const int userId, std::shared_ptr<std::vector<int>> spFollowers)
+    {
+        return meterAsync(Method::GetFollowersAsync, [&]() { return m_spDatastore->GetFollowersAsync(userId, spFollowers); },
+                          []() { return size_t(0); });
+    }
+
+    pplx::task<bool> GetFollowerCountsAsync(const std::vector<int> &userIdVector, std::shared_ptr<std::vector<int>> spCounts)
+    {
+        return meterAsync(Method::GetFollowerCountsAsync, [&]() { return m_spDatastore->GetFollowerCountsAsync(userIdVector, spCounts); },
+                          []() { return size_t(0); });
+    }
+
+    pplx::task<bool> PushTimelinesAsync(const std::vector<int> &userIdVector, const std::string &tweetAsString, int maxTweets = 10)
+    {
+        size_t bytes = tweetAsString.size() * userIdVector.size();
+        return meterAsync(Method::PushTimelinesAsync, [&]() { return m_spDatastore->PushTimelinesAsync(userIdVector, tweetAsString, maxTweets); },
+                          [bytes]() { return bytes; });
+    }
+
+    pplx::task<bool> GetTimelineTweetsAsync(const int userId, std::shared_ptr<std::vector<std::string>> spTweets, int numberOfTweets = -1)
+    {
+        return meterAsync(Method::GetTimelineTweetsAsync, [&]() { return m_spDatastore->GetTimelineTweetsAsync(userId, spTweets, numberOfTweets); },
+                          [spTweets]() { return bytesOf(*spTweets); });
+    }
+
+    pplx::task<bool> ReplaceTimelineTweetsAsync(const int userId, const std::vector<std::string> &expectedTweets,
+                                                const std::vector<std::string> &tweets, std::shared_ptr<bool> spReplaced)
+    {
+        size_t bytes = bytesOf(expectedTweets) + bytesOf(tweets);
+        return meterAsync(Method::ReplaceTimelineTweetsAsync,
+                          [&]() { return m_spDatastore->ReplaceTimelineTweetsAsync(userId, expectedTweets, tweets, spReplaced); },
+                          [bytes]() { return bytes; });
+    }
+
+    pplx::task<bool> GetMergedTimelineAsync(const int userId, std::shared_ptr<std::vector<std::string>> spTweets,
+                                            int maxTweets = 10)
+    {
+        return meterAsync(Method::GetMergedTimelineAsync, [&]() { return m_spDatastore->GetMergedTimelineAsync(userId, spTweets, maxTweets); },
+                          [spTweets]() { return bytesOf(*spTweets); });
+    }
+};
+
+#endif
@@ -0,0 +1,284 @@
+/**
+ * @file      Metrics.h
+ * @author    Atakan S.
+ * @version   1.0
+ * @brief     Latency histograms and counters exported in Prometheus text format.
+ *
+ * @copyright Copyright (c) 2020 Atakan SARIOGLU ~ www.atakansarioglu.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _H_METRICS_H_
+#define _H_METRICS_H_
+
+#include "LatencyHistogram.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * @brief Latencies, failures, timeouts and bytes of one operation, e.g. an endpoint.
+ *        The latencies are striped over several histograms so threads rarely share
+ *        a cache line, recording takes no lock.
+ */
+class OperationMetrics
+{
+private:
+    // Number of latency histograms, threads pick one round robin.
+    static constexpr size_t STRIPES = 8;
+
+    // Latencies in microseconds, the count is the number of calls.
+    std::array<LatencyHistogram, STRIPES> m_latency;
+
+    // Counters.
+    std::atomic<uint64_t> m_failures;
+    std::atomic<uint64_t> m_timeouts;
+    std::atomic<uint64_t> m_bytes;
+
+    /*
+     * @brief Stripe of the calling thread.
+     * @return Index of the histogram.
+     */
+    static size_t stripe()
+    {
+        static std::atomic<size_t> nextStripe(0);
+        thread_local size_t threadStripe = nextStripe.fetch_add(1, std::memory_order_relaxed) % STRIPES;
+        return threadStripe;
+    }
+
+public:
+    /*
+     * @brief Constructor with zero counts.
+     */
+    OperationMetrics() : m_failures(0), m_timeouts(0), m_bytes(0) {}
+
+    /*
+     * @brief Count a call.
+     * @param micros Latency in microseconds.
+     * @param success False to count a failure.
+     * @param bytes Payload bytes of the call.
+     */
+    void Record(const uint64_t micros, const bool success = true, const size_t bytes = 0)
+    {
+        m_latency[stripe()].Record(micros);
+        if (!success)
+        {
+            m_failures.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (bytes > 0)
+        {
+            m_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        }
+    }
+
+    /*
+     * @brief Count a timeout, which is counted as a failure by Record too.
+     */
+    void RecordTimeout()
+    {
+        m_timeouts.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /*
+     * @brief Merge the latencies of all threads.
+     * @param latency Output histogram, counts are added.
+     */
+    void GetLatency(LatencyHistogram &latency) const
+    {
+        for (const auto &histogram : m_latency)
+        {
+            latency.Merge(histogram);
+        }
+    }
+
+    /*
+     * @brief Getter for the number of failures.
+     * @return Count.
+     */
+    uint64_t Failures() const
+    {
+        return m_failures.load(std::memory_order_relaxed);
+    }
+
+    /*
+     * @brief Getter for the number of timeouts.
+     * @return Count.
+     */
+    uint64_t Timeouts() const
+    {
+        return m_timeouts.load(std::memory_order_relaxed);
+    }
+
+    /*
+     * @brief Getter for the number of payload bytes.
+     * @return Bytes.
+     */
+    uint64_t Bytes() const
+    {
+        return m_bytes.load(std::memory_order_relaxed);
+    }
+};
+
+/*
+ * @brief Registry of the operation metrics, grouped in families like "http" or "datastore".
+ *        Operations are registered once and recorded through the returned reference,
+ *        which stays valid for the lifetime of the registry.
+ */
+class Metrics
+{
+private:
+    // Operations of each family by name.
+    std::map<std::string, std::map<std::string, std::unique_ptr<OperationMetrics>>> m_families;
+
+    // Sampled values, e.g. cache sizes, by name with their help text.
+    std::map<std::string, std::pair<std::string, std::function<double()>>> m_gauges;
+
+    // Guards the registration and the export, not the recording.
+    mutable std::mutex m_mutex;
+
+    // Upper bounds of the exported latency buckets in microseconds.
+    static const std::vector<uint64_t> &bucketBounds()
+    {
+        static const std::vector<uint64_t> bounds = {100, 250, 500, 1000, 2500, 5000, 10000, 25000,
+                                                     50000, 100000, 250000, 500000, 1000000, 2500000, 10000000};
+        return bounds;
+    }
+
+    /*
+     * @brief Write the HELP and TYPE lines of a metric.
+     * @param output Output stream.
+     * @param name Metric name.
+     * @param type Prometheus metric type.
+     * @param help Description.
+     */
+    static void writeHeader(std::ostringstream &output, const std::string &name, const std::string &type,
+                            const std::string &help)
+    {
+        output << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+    }
+
+public:
+    /*
+     * @brief Get the metrics of an operation, registered on first use.
+     *        Takes a lock, so look up once and keep the reference on hot paths.
+     * @param family Family, e.g. "http".
+     * @param operation Operation in the family, e.g. "timeline".
+     * @return Metrics of the operation.
+     */
+    OperationMetrics &Operation(const std::string &family, const std::string &operation)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto &spOperation = m_families[family][operation];
+        if (!spOperation)
+        {
+            spOperation = std::make_unique<OperationMetrics>();
+        }
+        return *spOperation;
+    }
+
+    /*
+     * @brief Register a value sampled on export.
+     * @param name Metric name without the prefix.
+     * @param help Description.
+     * @param sample Returns the current value, called from the exporting thread.
+     */
+    void AddGauge(const std::string &name, const std::string &help, std::function<double()> sample)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_gauges[name] = std::make_pair(help, std::move(sample));
+    }
+
+    /*
+     * @brief Export all metrics in the Prometheus text format. The latency bucket counts are
+     *        approximate, a bucket may include values up to 1/16 above its bound.
+     * @return Text exposition.
+     */
+    std::string Prometheus() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::ostringstream output;
+        output.precision(12);
+        for (const auto &family : m_families)
+        {
+            std::string prefix = "babybird_" + family.first;
+
+            // Merge the latencies once per operation.
+            std::vector<std::unique_ptr<LatencyHistogram>> latencies;
+            for (const auto &operation : family.second)
+            {
+                latencies.push_back(std::make_unique<LatencyHistogram>());
+                operation.second->GetLatency(*latencies.back());
+            }
+
+            writeHeader(output, prefix + "_duration_seconds", "histogram", "Latency of the " + family.first + " operations.");
+            size_t index = 0;
+            for (const auto &operation : family.second)
+            {
+                const auto &latency = *latencies[index++];
+                std::string label = "{operation=\"" + operation.first + "\"";
+                for (auto bound : bucketBounds())
+                {
+                    output << prefix << "_duration_seconds_bucket" << label << ",le=\"" << bound / 1e6 << "\"} "
+                           << latency.CountAtMost(bound) << "\n";
+                }
+                output << prefix << "_duration_seconds_bucket" << label << ",le=\"+Inf\"} " << latency.Count() << "\n";
+                output << prefix << "_duration_seconds_sum" << label << "} " << latency.Sum() / 1e6 << "\n";
+                output << prefix << "_duration_seconds_count" << label << "} " << latency.Count() << "\n";
+            }
+
+            writeHeader(output, prefix + "_failures_total", "counter", "Failed " + family.first + " operations.");
+            for (const auto &operation : family.second)
+            {
+                output << prefix << "_failures_total{operation=\"" << operation.first << "\"} " << operation.second->Failures() << "\n";
+            }
+
+            writeHeader(output, prefix + "_timeouts_total", "counter", "Timed out " + family.first + " operations.");
+            for (const auto &operation : family.second)
+            {
+                output << prefix << "_timeouts_total{operation=\"" << operation.first << "\"} " << operation.second->Timeouts() << "\n";
+            }
+
+            writeHeader(output, prefix + "_bytes_total", "counter", "Payload bytes of the " + family.first + " operations.");
+            for (const auto &operation : family.second)
+            {
+                output << prefix << "_bytes_total{operation=\"" << operation.first << "\"} " << operation.second->Bytes() << "\n";
+            }
+        }
+
+        for (const auto &gauge : m_gauges)
+        {
+            std::string name = "babybird_" + gauge.first;
+            writeHeader(output, name, "gauge", gauge.second.first);
+            output << name << " " << gauge.second.second() << "\n";
+        }
+        return output.str();
+    }
+};
+
+#endif
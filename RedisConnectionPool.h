@@ -0,0 +1,356 @@
+/**
+ * @file      RedisConnectionPool.h
+ * @author    Atakan S.
+ * @version   1.0
+ * @brief     Pool of independent Redis connections, each with its own pipeline.
+ *
+ * @copyright Copyright (c) 2020 Atakan SARIOGLU ~ www.atakansarioglu.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _H_REDISCONNECTIONPOOL_H_
+#define _H_REDISCONNECTIONPOOL_H_
+
+#include <cpp_redis/cpp_redis>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class RedisConnectionPool
+{
+private:
+    // One connection of the pool.
+    struct Connection
+    {
+        cpp_redis::client client;
+        std::chrono::steady_clock::time_point lastUsed;
+        bool healthy = false;
+    };
+
+    std::string m_endpoint;
+    int m_port;
+    std::string m_credentials;
+    std::chrono::duration<double> m_timeout;
+    std::chrono::duration<double> m_idleCheck;
+    std::vector<std::unique_ptr<Connection>> m_connections;
+
+    // Indices of the connections that are not checked out.
+    std::vector<size_t> m_idle;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_released;
+
+    /*
+     * @brief (Re)open a single connection and authenticate.
+     * @param connection Connection to open.
+     * @return True on success.
+     */
+    bool open(Connection &connection)
+    {
+        try
+        {
+            if (connection.client.is_connected())
+            {
+                connection.client.disconnect(true);
+            }
+            // Bounded connect, an unreachable host would otherwise block until the OS gives up.
+            auto timeoutMs = std::chrono::duration_cast<std::chrono::milliseconds>(m_timeout).count();
+            connection.client.connect(m_endpoint, m_port, nullptr, static_cast<std::uint32_t>(timeoutMs));
+            connection.client.auth(m_credentials);
+            connection.client.sync_commit(m_timeout);
+        }
+        catch (...)
+        {
+            connection.healthy = false;
+            return false;
+        }
+
+        connection.healthy = connection.client.is_connected();
+        connection.lastUsed = std::chrono::steady_clock::now();
+        return connection.healthy;
+    }
+
+    /*
+     * @brief Check a connection before handing it out, reconnect if needed.
+     *        A connection idle for longer than the idle check period is pinged.
+     * @param connection Connection to check.
+     * @return True if the connection is usable.
+     */
+    bool check(Connection &connection)
+    {
+        if (!connection.healthy || !connection.client.is_connected())
+        {
+            return open(connection);
+        }
+
+        if (std::chrono::steady_clock::now() - connection.lastUsed > m_idleCheck)
+        {
+            try
+            {
+                auto request = connection.client.ping();
+                connection.client.sync_commit(m_timeout);
+                if (request.wait_for(std::chrono::seconds(0)) != std::future_status::ready || !request.get().ok())
+                {
+                    return open(connection);
+                }
+            }
+            catch (...)
+            {
+                return open(connection);
+            }
+        }
+
+        return true;
+    }
+
+    /*
+     * @brief Connection state without locking.
+     * @return True if at least one connection is up.
+     */
+    bool isConnected() const
+    {
+        for (const auto &connection : m_connections)
+        {
+            if (connection->client.is_connected())
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*
+     * @brief Put a connection back to the idle list.
+     * @param index Index of the connection.
+     * @param healthy False if the connection must be reopened before the next use.
+     */
+    void release(const size_t index, const bool healthy)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_connections[index]->healthy = m_connections[index]->healthy && healthy;
+            m_connections[index]->lastUsed = std::chrono::steady_clock::now();
+            m_idle.push_back(index);
+        }
+        m_released.notify_one();
+    }
+
+public:
+    /*
+     * @brief Exclusive use of one pooled connection, returned to the pool on destruction.
+     */
+    class Lease
+    {
+    private:
+        RedisConnectionPool *m_pPool;
+        size_t m_index;
+        bool m_healthy;
+
+    public:
+        Lease() : m_pPool(nullptr), m_index(0), m_healthy(false) {}
+        Lease(RedisConnectionPool *pPool, const size_t index) : m_pPool(pPool), m_index(index), m_healthy(true) {}
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+        Lease(Lease &&other) : m_pPool(other.m_pPool), m_index(other.m_index), m_healthy(other.m_healthy)
+        {
+            other.m_pPool = nullptr;
+        }
+
+        /*
+         * @brief Check if a connection was obtained.
+         * @return True if usable.
+         */
+        explicit operator bool() const
+        {
+            return m_pPool != nullptr;
+        }
+
+        /*
+         * @brief Getter for the leased client.
+         * @return Client reference.
+         */
+        cpp_redis::client &Client()
+        {
+            return m_pPool->m_connections[m_index]->client;
+        }
+
+        /*
+         * @brief Mark the connection broken, e.g. after a commit timeout left replies in flight.
+         */
+        void Invalidate()
+        {
+            m_healthy = false;
+        }
+
+        /*
+         * @brief Destructor. Return the connection to the pool.
+         */
+        ~Lease()
+        {
+            if (m_pPool)
+            {
+                m_pPool->release(m_index, m_healthy);
+            }
+        }
+    };
+
+    /*
+     * @brief Constructor of the pool, lazy connection.
+     * @param endpoint Endpoint address.
+     * @param port Port number of Redis.
+     * @param credentials Database password.
+     * @param size Number of connections.
+     * @param timeout Time to wait for a free connection and for a connect.
+     * @param idleCheck Idle time after which a connection is pinged before use.
+     */
+    RedisConnectionPool(const std::string &endpoint, const int port, const std::string &credentials,
+                        const size_t size = 8, const double timeout = 1.0, const double idleCheck = 30.0)
+        : m_endpoint(endpoint), m_port(port), m_credentials(credentials), m_timeout(timeout), m_idleCheck(idleCheck)
+    {
+        for (size_t i = 0; i < (size > 0 ? size : 1); ++i)
+        {
+            m_connections.push_back(std::make_unique<Connection>());
+            m_idle.push_back(i);
+        }
+    }
+
+    /*
+     * @brief Open all idle connections.
+     * @return True if at least one connection is up.
+     */
+    bool Connect()
+    {
+        // Check out the closed connections, the open ones stay available meanwhile.
+        std::vector<size_t> closed;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto it = m_idle.begin(); it != m_idle.end();)
+            {
+                if (m_connections[*it]->client.is_connected())
+                {
+                    ++it;
+                    continue;
+                }
+                closed.push_back(*it);
+                it = m_idle.erase(it);
+            }
+        }
+
+        // Connect and authenticate out of the lock, then put them back.
+        for (auto index : closed)
+        {
+            release(index, open(*m_connections[index]));
+        }
+
+        return IsConnected();
+    }
+
+    /*
+     * @brief Close all idle connections, leased ones are closed on their next check.
+     */
+    void Disconnect()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto index : m_idle)
+        {
+            m_connections[index]->client.disconnect();
+            m_connections[index]->healthy = false;
+        }
+    }
+
+    /*
+     * @brief Get connection state.
+     * @return True if at least one connection is up.
+     */
+    bool IsConnected() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return isConnected();
+    }
+
+    /*
+     * @brief Getter for the pool size.
+     * @return Number of connections.
+     */
+    size_t Size() const
+    {
+        return m_connections.size();
+    }
+
+    /*
+     * @brief Check out a healthy connection, waits until one is free.
+     * @return Lease, empty if no connection could be obtained within the timeout.
+     */
+    Lease Acquire()
+    {
+        bool openFailed = false;
+        return Acquire(openFailed);
+    }
+
+    /*
+     * @brief Check out a healthy connection, waits until one is free.
+     * @param openFailed Output, true if the connection could not be opened, false if none was free in time.
+     * @return Lease, empty if no connection could be obtained within the timeout.
+     */
+    Lease Acquire(bool &openFailed)
+    {
+        openFailed = false;
+        size_t index = 0;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (!m_released.wait_for(lock, m_timeout, [this] { return !m_idle.empty(); }))
+            {
+                return Lease();
+            }
+            index = m_idle.back();
+            m_idle.pop_back();
+        }
+
+        // Health check out of the lock, other connections stay available.
+        Lease lease(this, index);
+        if (!check(*m_connections[index]))
+        {
+            openFailed = true;
+            lease.Invalidate();
+            return Lease();
+        }
+        return lease;
+    }
+
+    /*
+     * @brief Destructor. Close all connections.
+     */
+    ~RedisConnectionPool()
+    {
+        for (auto &connection : m_connections)
+        {
+            if (connection->client.is_connected())
+            {
+                connection->client.disconnect();
+            }
+        }
+    }
+
+};
+
+#endif
@@ -29,267 +29,1881 @@
 #define _H_REDISDATASTORE_H_
 
 #include "IDatastore.h"
+#include "CircuitBreaker.h"
+#include "FollowGraphCache.h"
+#include "Metrics.h"
+#include "RequestTrace.h"
+#include "RedisConnectionPool.h"
 #include <cpp_redis/cpp_redis>
-#include <string>
+#include <pplx/pplxtasks.h>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
 #include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 
 class RedisDatastore : public IDatastore
 {
 private:
-    std::string m_endpoint;
-    int m_port;
-    std::string m_credentials;
-    cpp_redis::client m_client;
+    RedisConnectionPool m_pool;
     std::chrono::duration<double> m_commitTimeout;
 
-public:
+    // Server side timeline merge, SHA1 of the loaded script, empty until loaded.
+    bool m_serverSideMerge;
+    std::string m_timelineScriptSha;
+    std::mutex m_scriptMutex;
+
+    // Write-through cache of the follow graph, optional.
+    std::shared_ptr<FollowGraphCache> m_spFollowCache;
+
+    // False for a replica, its reads may lag behind the writes, so they use the cache but never fill it.
+    bool m_fillFollowCache;
+
+    // Round-trips to Redis, waited for or not, both nullptr without a metrics registry.
+    std::shared_ptr<Metrics> m_spMetrics;
+    OperationMetrics *m_pCommits;
+    OperationMetrics *m_pAsyncCommits;
+
+    // Calls rejected by the open circuit breaker, nullptr without a metrics registry.
+    OperationMetrics *m_pRejected;
+
+    // Deadline of the reads, the writes wait up to the commit timeout.
+    std::chrono::duration<double> m_readTimeout;
+
+    // Fails the calls fast after consecutive timeouts until a probe gets through again.
+    CircuitBreaker m_breaker;
+
+    // Replies of a pipeline sent without waiting, collected by the callbacks of the Redis client.
+    struct Batch
+    {
+        std::vector<cpp_redis::reply> replies;
+        std::atomic<size_t> pending;
+        std::atomic<bool> finished;
+        pplx::task_completion_event<std::vector<cpp_redis::reply>> done;
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point deadline;
+        size_t bytes;
+        OperationMetrics *pMetrics;
+        CircuitBreaker *pBreaker;
+        RequestTrace *pTrace;
+    };
+
+    // Batches sent without waiting, failed by the expiry thread once past their deadline.
+    std::mutex m_pendingMutex;
+    std::vector<std::weak_ptr<Batch>> m_pending;
+
+    // Period of the background threads. The expiry thread fails the batches past their deadline,
+    // the maintenance thread probes Redis while the breaker is open. A slow probe never delays a deadline.
+    static constexpr std::chrono::milliseconds MAINTENANCE_PERIOD{10};
+    std::mutex m_maintenanceMutex;
+    std::condition_variable m_stop;
+    bool m_stopping;
+    std::thread m_expiry;
+    std::thread m_maintenance;
+
     /*
-     * @brief Constructor for Redis connector.
-     * @param endpoint Endpoint address.
-     * @param port Port number of Redis.
-     * @param credentials Database password.
-     * @param timeout Time to wait for a request.
+     * @brief Name of an operation of one node, the shards, replicas and primary are exported apart.
+     * @param operation Operation, e.g. "commit".
+     * @param endpoint Endpoint address of the node.
+     * @param port Port number of the node.
+     * @return Operation name, e.g. "commit@10.0.0.1:6379".
      */
-    RedisDatastore(const std::string &endpoint, const int port, const std::string &credentials, const double timeout = 1.0)
-        : m_endpoint(endpoint), m_port(port), m_credentials(credentials), m_commitTimeout(timeout) {}
+    static std::string nodeOperation(const std::string &operation, const std::string &endpoint, const int port)
+    {
+        return operation + "@" + endpoint + ":" + std::to_string(port);
+    }
 
     /*
-     * @brief Connect to Redis
-     * @return True on success.
+     * @brief Lua script that merges the recent tweets of the followees by tweet ID, malformed tweets are skipped.
+     *        KEYS[1] is the followees set, ARGV[1] the user ID, ARGV[2] the number of tweets.
+     * @return Script source.
      */
-    bool Connect()
+    static const std::string &timelineScript()
     {
-        if (IsConnected())
-        {
-            return true;
-        }
-
-        // Connect to Redis.
-        m_client.connect(m_endpoint, m_port);
-
-        // Authenticate using the provided credentials.
-        m_client.auth(m_credentials);
-
-        // Return the connection state.
-        return IsConnected();
+        static const std::string script = R"lua(
+local limit = tonumber(ARGV[2])
+local users = redis.call('SMEMBERS', KEYS[1])
+users[#users + 1] = ARGV[1]
+local entries = {}
+for _, user in ipairs(users) do
+    local tweets = redis.call('LRANGE', 'tweets:' .. user, 0, limit - 1)
+    for _, tweet in ipairs(tweets) do
+        local id
+        if string.byte(tweet, 1) == 1 then
+            -- Header of 13 bytes, the content length must match as in Tweet::View.
+            if #tweet >= 13 and struct.unpack('<i4', tweet, 10) == #tweet - 13 then
+                id = struct.unpack('<i4', tweet, 2)
+            end
+        else
+            id = tonumber(string.match(tweet, '"tweetId":(%-?%d+)'))
+            if id == nil then
+                local ok, decoded = pcall(cjson.decode, tweet)
+                if ok and type(decoded) == 'table' then
+                    id = tonumber(decoded['tweetId'])
+                end
+            end
+        end
+        if id ~= nil then
+            entries[#entries + 1] = {id, tweet}
+        end
+    end
+end
+table.sort(entries, function(a, b) return a[1] > b[1] end)
+local result = {}
+for i = 1, math.min(limit, #entries) do
+    result[i] = entries[i][2]
+end
+return result
+)lua";
+        return script;
     }
 
     /*
-     * @brief Disconnect from Redis
-     * @return True on success.
+     * @brief Lua script that replaces a timeline only if its head is still the expected one.
+     *        KEYS[1] is the timeline, ARGV[1] the number N of expected tweets,
+     *        ARGV[2..N+1] the expected head and the rest the new timeline.
+     * @return Script source.
      */
-    bool Disconnect()
+    static const std::string &replaceTimelineScript()
     {
-        // Disconnect.
-        m_client.disconnect();
-        return true;
+        static const std::string script = R"lua(
+local count = tonumber(ARGV[1])
+if count == 0 then
+    if redis.call('EXISTS', KEYS[1]) == 1 then
+        return 0
+    end
+else
+    local head = redis.call('LRANGE', KEYS[1], 0, count - 1)
+    if #head ~= count then
+        return 0
+    end
+    for i = 1, count do
+        if head[i] ~= ARGV[i + 1] then
+            return 0
+        end
+    end
+end
+redis.call('DEL', KEYS[1])
+if #ARGV > count + 1 then
+    redis.call('RPUSH', KEYS[1], unpack(ARGV, count + 2))
+end
+return 1
+)lua";
+        return script;
     }
 
     /*
-     * @brief Get connection state.
-     * @return True if connected.
+     * @brief Arguments of the replace timeline script.
+     * @param expectedTweets Expected head of the timeline.
+     * @param tweets New timeline.
+     * @return Script arguments.
      */
-    bool IsConnected() const
+    static std::vector<std::string> replaceTimelineArguments(const std::vector<std::string> &expectedTweets,
+                                                             const std::vector<std::string> &tweets)
     {
-        // Return the connection state.
-        return m_client.is_connected();
+        std::vector<std::string> arguments;
+        arguments.reserve(1 + expectedTweets.size() + tweets.size());
+        arguments.push_back(std::to_string(expectedTweets.size()));
+        arguments.insert(arguments.end(), expectedTweets.begin(), expectedTweets.end());
+        arguments.insert(arguments.end(), tweets.begin(), tweets.end());
+        return arguments;
     }
 
     /*
-     * @brief Generate Unique Increasing ID Number
-     * @return Non-negative unique ID on success, -1 on error.
+     * @brief Check out a connection unless the circuit breaker is open.
+     * @return Lease, empty if rejected or no connection could be obtained.
      */
-    int GetUniqueNumber()
+    RedisConnectionPool::Lease acquire()
     {
-        if (!IsConnected())
+        if (!m_breaker.Allow())
         {
-            return -1;
+            if (m_pRejected)
+            {
+                m_pRejected->Record(0, false);
+            }
+            return RedisConnectionPool::Lease();
         }
 
-        // Increment and get the value on Redis.
-        auto request = m_client.incr("uniqueNumber");
-        m_client.sync_commit(m_commitTimeout);
+        // A busy pool is load, not a failure of Redis.
+        bool openFailed = false;
+        auto lease = m_pool.Acquire(openFailed);
+        if (!lease && openFailed)
+        {
+            m_breaker.Failure();
+        }
+        return lease;
+    }
 
-        auto response = request.get();
-        if (response.ok() && response.is_integer())
+    /*
+     * @brief Commit the pipeline of a write and wait for the replies.
+     * @param lease Leased connection.
+     * @param lastRequest Reply of the last command in the pipeline.
+     * @return True if all replies arrived within the commit timeout, otherwise the connection is dropped.
+     */
+    bool commit(RedisConnectionPool::Lease &lease, const std::future<cpp_redis::reply> &lastRequest)
+    {
+        return commit(lease, lastRequest, m_commitTimeout);
+    }
+
+    /*
+     * @brief Commit the pipeline of a leased connection and wait for the replies.
+     *        The outcome is reported to the circuit breaker.
+     * @param lease Leased connection.
+     * @param lastRequest Reply of the last command in the pipeline.
+     * @param timeout Deadline of the operation.
+     * @return True if all replies arrived in time, otherwise the connection is dropped.
+     */
+    bool commit(RedisConnectionPool::Lease &lease, const std::future<cpp_redis::reply> &lastRequest,
+                const std::chrono::duration<double> &timeout)
+    {
+        auto start = std::chrono::steady_clock::now();
+        lease.Client().sync_commit(timeout);
+        bool success = (lastRequest.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+        if (success)
         {
-            // Success.
-            return response.as_integer();
+            m_breaker.Success();
+        }
+        else
+        {
+            // Late replies would be read by the next user of the connection.
+            lease.Invalidate();
+            m_breaker.Failure();
         }
 
-        // Failure.
-        return -1;
+        if (m_pCommits)
+        {
+            m_pCommits->Record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count(),
+                               success);
+            if (!success)
+            {
+                m_pCommits->RecordTimeout();
+            }
+        }
+        return success;
     }
 
     /*
-     * @brief Adds tweet to Redis memory cache.
-     * @param userId
-     * @param tweetAsString Serialized tweet object.
-     * @param maxTweets Keep no more than this number on datastore, -1 for unlimited.
+     * @brief Append the elements of an array reply as strings.
+     * @param response Reply of a list or set command.
+     * @param output Output vector.
      * @return True on success.
      */
-    bool AddTweet(const int userId, const std::string &tweetAsString, int maxTweets = 10)
+    static bool appendStrings(const cpp_redis::reply &response, std::vector<std::string> &output)
     {
-        if (!IsConnected())
+        if (response.ok() == false || response.is_array() == false)
         {
             return false;
         }
 
-        // Push the new tweet to the corresponding users tweets list.
-        auto request1 = m_client.lpush("tweets:" + std::to_string(userId), {tweetAsString});
-        if(maxTweets > 0) {
-            auto request2 = m_client.ltrim("tweets:" + std::to_string(userId), 0, maxTweets - 1);
+        for (const auto &element : response.as_array())
+        {
+            output.push_back(element.as_string());
         }
-
-        // Commit.
-        m_client.sync_commit(m_commitTimeout);
-
-        // Return.
-        return request1.get().ok();
+        return true;
     }
 
     /*
-     * @brief Get recent tweets of all followed users.
-     * @param userIdVector users to fetch the recent tweets.
-     * @param tweets Output vector for fetched tweets.
-     * @param numberOfTweets Number of tweets for each user, -1 for all tweets.
-     * @return True on success.
+     * @brief Append the elements of an array reply as integers.
+     * @param response Reply of a set command.
+     * @param output Output vector.
+     * @return True on success, elements that are not integers are skipped.
      */
-    bool GetRecentTweets(const std::vector<int> &userIdVector,
-                         std::vector<std::string> &tweets, int numberOfTweets = -1)
+    static bool appendIntegers(const cpp_redis::reply &response, std::vector<int> &output)
     {
-        if (!IsConnected())
+        if (response.ok() == false || response.is_array() == false)
         {
             return false;
         }
 
-        // Issue all requests in a loop.
-        std::vector<std::future<cpp_redis::reply>> requestVector;
-        for (auto userId : userIdVector)
+        // Cast the returned strings into integer and push to output vector.
+        output.reserve(output.size() + response.as_array().size());
+        for (const auto &element : response.as_array())
         {
-            // Get left items of Redis List object.
-            requestVector.push_back(m_client.lrange("tweets:" + std::to_string(userId),
-                                                    0, (numberOfTweets == -1) ? -1 : numberOfTweets - 1));
+            if (element.is_string())
+            {
+                const auto &str = element.as_string();
+                int value = 0;
+                auto result = std::from_chars(str.data(), str.data() + str.size(), value);
+                if (result.ec == std::errc() && result.ptr == str.data() + str.size())
+                {
+                    output.push_back(value);
+                }
+            }
         }
+        return true;
+    }
 
-        // Commit once.
-        m_client.sync_commit(m_commitTimeout);
+    /*
+     * @brief Get followees or followers from the cache, or from Redis filling the cache.
+     * @param relation Followees or followers.
+     * @param userId User
+     * @param spIds Output vector.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> getFollowsAsync(const FollowRelation relation, const int userId, std::shared_ptr<std::vector<int>> spIds)
+    {
+        if (m_spFollowCache && m_spFollowCache->Get(relation, userId, *spIds))
+        {
+            return pplx::task_from_result(true);
+        }
 
-        // Add the returned tweets to the output vector.
-        for (auto &request : requestVector)
+        uint64_t epoch = m_spFollowCache ? m_spFollowCache->Epoch() : 0;
+        auto key = (relation == FollowRelation::Followees ? "followees:" : "followers:") + std::to_string(userId);
+        return commitAsync({{"SMEMBERS", key}}, m_readTimeout)
+            .then([this, relation, userId, epoch, spIds](std::vector<cpp_redis::reply> replies) {
+                if (replies.size() != 1 || !appendIntegers(replies[0], *spIds))
+                {
+                    return false;
+                }
+                if (m_spFollowCache && m_fillFollowCache)
+                {
+                    m_spFollowCache->Fill(relation, userId, *spIds, epoch);
+                }
+                return true;
+            });
+    }
+
+    /*
+     * @brief Apply a follow write to the cache once its outcome is known.
+     * @param userId follower
+     * @param followeeId followee
+     * @param added True for a follow, false for an unfollow.
+     * @param success Outcome of the write.
+     * @return The outcome.
+     */
+    bool writeThrough(const int userId, const int followeeId, const bool added, const bool success)
+    {
+        if (m_spFollowCache)
         {
-            auto response = request.get();
-            if (response.ok() == false || response.is_array() == false)
+            if (!success)
             {
-                return false;
+                // Partially applied or timed out, reload on the next read.
+                m_spFollowCache->Invalidate(userId, followeeId);
+            }
+            else if (added)
+            {
+                m_spFollowCache->AddFollowee(userId, followeeId);
+            }
+            else
+            {
+                m_spFollowCache->DelFollowee(userId, followeeId);
             }
+        }
+        return success;
+    }
 
-            for (const auto &element : response.as_array())
+    /*
+     * @brief Apply a write of one side of a follow to the cache once its outcome is known.
+     * @param relation Followees for the side of the follower, Followers for the side of the followee.
+     * @param userId follower
+     * @param followeeId followee
+     * @param added True for a follow, false for an unfollow.
+     * @param success Outcome of the write.
+     * @return The outcome.
+     */
+    bool writeThroughEdge(const FollowRelation relation, const int userId, const int followeeId, const bool added,
+                          const bool success)
+    {
+        if (m_spFollowCache)
+        {
+            if (!success)
+            {
+                m_spFollowCache->InvalidateEdge(relation, userId, followeeId);
+            }
+            else
             {
-                tweets.push_back(element.as_string());
+                m_spFollowCache->UpdateEdge(relation, userId, followeeId, added);
             }
         }
+        return success;
+    }
 
-        // Return.
-        return true;
+    /*
+     * @brief Command writing one side of a follow.
+     * @param relation Followees for the side of the follower, Followers for the side of the followee.
+     * @param userId follower
+     * @param followeeId followee
+     * @param added True for a follow, false for an unfollow.
+     * @return Command as its arguments.
+     */
+    static std::vector<std::string> edgeCommand(const FollowRelation relation, const int userId, const int followeeId,
+                                                const bool added)
+    {
+        if (relation == FollowRelation::Followees)
+        {
+            return {added ? "SADD" : "SREM", "followees:" + std::to_string(userId), std::to_string(followeeId)};
+        }
+        return {added ? "SADD" : "SREM", "followers:" + std::to_string(followeeId), std::to_string(userId)};
     }
 
     /*
-     * @brief Get followed users of userId.
-     * @param userId users to fetch the recent tweets.
-     * @param followees Output vector for followees.
+     * @brief Write one side of a follow.
+     * @param relation Followees for the side of the follower, Followers for the side of the followee.
+     * @param userId follower
+     * @param followeeId followee
+     * @param added True for a follow, false for an unfollow.
      * @return True on success.
      */
-    bool GetFollowees(const int userId, std::vector<int> &followees)
+    bool writeEdge(const FollowRelation relation, const int userId, const int followeeId, const bool added)
     {
-        if (!IsConnected())
+        auto lease = acquire();
+        if (!lease)
         {
             return false;
         }
 
-        // Get all members of Redis Hash Set object.
-        auto request = m_client.smembers("followees:" + std::to_string(userId));
+        auto request = lease.Client().send(edgeCommand(relation, userId, followeeId, added));
+        if (!commit(lease, request))
+        {
+            return writeThroughEdge(relation, userId, followeeId, added, false);
+        }
+        return writeThroughEdge(relation, userId, followeeId, added, request.get().ok());
+    }
 
-        // Commit.
-        m_client.sync_commit(m_commitTimeout);
+    /*
+     * @brief Asynchronous writeEdge.
+     * @param relation Followees for the side of the follower, Followers for the side of the followee.
+     * @param userId follower
+     * @param followeeId followee
+     * @param added True for a follow, false for an unfollow.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> writeEdgeAsync(const FollowRelation relation, const int userId, const int followeeId,
+                                    const bool added)
+    {
+        return commitAsync({edgeCommand(relation, userId, followeeId, added)})
+            .then([this, relation, userId, followeeId, added](std::vector<cpp_redis::reply> replies) {
+                return writeThroughEdge(relation, userId, followeeId, added, replies.size() == 1 && replies[0].ok());
+            });
+    }
 
-        // Check the response.
-        auto response = request.get();
-        if (response.ok() == false || response.is_array() == false)
+    /*
+     * @brief Send the pipeline of a write and return without waiting for the replies.
+     * @param commands Commands, each as its arguments.
+     * @return Task completed with the replies in order, empty on failure or after the commit timeout.
+     */
+    pplx::task<std::vector<cpp_redis::reply>> commitAsync(const std::vector<std::vector<std::string>> &commands)
+    {
+        return commitAsync(commands, m_commitTimeout);
+    }
+
+    /*
+     * @brief Send a pipeline of commands and return without waiting for the replies.
+     *        The connection goes back to the pool right after the commit. The expiry thread
+     *        fails the task at the deadline. The outcome is reported to the circuit breaker.
+     * @param commands Commands, each as its arguments.
+     * @param timeout Deadline of the operation, late replies are dropped.
+     * @return Task completed with the replies in order, empty on failure or after the deadline.
+     */
+    pplx::task<std::vector<cpp_redis::reply>> commitAsync(const std::vector<std::vector<std::string>> &commands,
+                                                          const std::chrono::duration<double> &timeout)
+    {
+        if (commands.empty())
         {
-            return false;
+            return pplx::task_from_result(std::vector<cpp_redis::reply>());
         }
 
-        // Cast the returned strings into integer and push to output vector.
-        for (const auto &element : response.as_array())
+        // The wait for a free connection and the round-trip are stages of the traced request.
+        auto pTrace = RequestTrace::Current();
+        auto acquireStart = std::chrono::steady_clock::now();
+        auto lease = acquire();
+        if (pTrace)
+        {
+            pTrace->Add("redis_pool", acquireStart);
+        }
+        if (!lease)
+        {
+            if (m_pAsyncCommits)
+            {
+                m_pAsyncCommits->Record(0, false);
+            }
+            return pplx::task_from_result(std::vector<cpp_redis::reply>());
+        }
+
+        auto spBatch = std::make_shared<Batch>();
+        spBatch->replies.resize(commands.size());
+        spBatch->pending = commands.size();
+        spBatch->finished = false;
+        spBatch->start = std::chrono::steady_clock::now();
+        spBatch->deadline = spBatch->start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout);
+        spBatch->bytes = 0;
+        spBatch->pMetrics = m_pAsyncCommits;
+        spBatch->pBreaker = &m_breaker;
+        spBatch->pTrace = pTrace;
+
+        try
         {
-            try
+            for (size_t i = 0; i < commands.size(); ++i)
             {
-                int followeeId = std::stoi(element.as_string());
-                followees.push_back(followeeId);
+                for (const auto &argument : commands[i])
+                {
+                    spBatch->bytes += argument.size();
+                }
+                lease.Client().send(commands[i], [spBatch, i](cpp_redis::reply &reply) {
+                    spBatch->replies[i] = reply;
+                    if (--spBatch->pending == 0 && !spBatch->finished.exchange(true))
+                    {
+                        if (spBatch->pMetrics)
+                        {
+                            spBatch->pMetrics->Record(std::chrono::duration_cast<std::chrono::microseconds>(
+                                                          std::chrono::steady_clock::now() - spBatch->start).count(),
+                                                      true, spBatch->bytes);
+                        }
+                        if (spBatch->pTrace)
+                        {
+                            spBatch->pTrace->Add("redis", spBatch->start);
+                        }
+                        spBatch->pBreaker->Success();
+                        spBatch->done.set(std::move(spBatch->replies));
+                    }
+                });
             }
-            catch (...)
+            lease.Client().commit();
+        }
+        catch (...)
+        {
+            lease.Invalidate();
+            m_breaker.Failure();
+            if (m_pAsyncCommits)
             {
-                return false;
+                m_pAsyncCommits->Record(0, false);
             }
+            return pplx::task_from_result(std::vector<cpp_redis::reply>());
         }
 
-        // Return.
-        return true;
+        {
+            std::lock_guard<std::mutex> lock(m_pendingMutex);
+            m_pending.push_back(spBatch);
+        }
+        return pplx::create_task(spBatch->done);
     }
 
     /*
-     * @brief Create userId->followeeId record.
-     * @param userId follower
-     * @param followeeId followee
-     * @return True on success.
+     * @brief Fail the batches that are past their deadline, or all of them.
+     * @param all True to fail all pending batches, e.g. on destruction.
      */
-    bool AddFollowee(const int userId, const int followeeId)
+    void expireBatches(const bool all = false)
     {
-        if (!IsConnected())
+        auto now = std::chrono::steady_clock::now();
+        std::vector<std::shared_ptr<Batch>> expired;
+        {
+            std::lock_guard<std::mutex> lock(m_pendingMutex);
+            m_pending.erase(std::remove_if(m_pending.begin(), m_pending.end(), [&](const std::weak_ptr<Batch> &wpBatch) {
+                                auto spBatch = wpBatch.lock();
+                                if (!spBatch || spBatch->finished)
+                                {
+                                    return true;
+                                }
+                                if (all || spBatch->deadline <= now)
+                                {
+                                    expired.push_back(spBatch);
+                                    return true;
+                                }
+                                return false;
+                            }),
+                            m_pending.end());
+        }
+
+        for (auto &spBatch : expired)
+        {
+            if (!spBatch->finished.exchange(true))
+            {
+                if (m_pAsyncCommits)
+                {
+                    m_pAsyncCommits->Record(std::chrono::duration_cast<std::chrono::microseconds>(now - spBatch->start).count(), false);
+                    m_pAsyncCommits->RecordTimeout();
+                }
+                m_breaker.Failure();
+                spBatch->done.set(std::vector<cpp_redis::reply>());
+            }
+        }
+    }
+
+    /*
+     * @brief Send a PING over a pooled connection, bypassing the circuit breaker.
+     *        A broken connection is reopened on checkout.
+     * @return True if Redis answered in time.
+     */
+    bool probe()
+    {
+        auto lease = m_pool.Acquire();
+        if (!lease)
         {
             return false;
         }
 
-        // Add to Hash Set.
-        auto request = m_client.sadd("followees:" + std::to_string(userId), {std::to_string(followeeId)});
+        try
+        {
+            auto request = lease.Client().ping();
+            return commit(lease, request, m_readTimeout) && request.get().ok();
+        }
+        catch (...)
+        {
+            lease.Invalidate();
+            return false;
+        }
+    }
 
-        // Commit.
-        m_client.sync_commit(m_commitTimeout);
+    /*
+     * @brief Expiry thread. Fails the batches past their deadline.
+     */
+    void expire()
+    {
+        std::unique_lock<std::mutex> lock(m_maintenanceMutex);
+        while (!m_stop.wait_for(lock, MAINTENANCE_PERIOD, [this] { return m_stopping; }))
+        {
+            lock.unlock();
+            expireBatches();
+            lock.lock();
+        }
+    }
 
-        // Return the result.
-        return request.get().ok();
+    /*
+     * @brief Maintenance thread. While the circuit breaker is open, probes Redis with exponential backoff.
+     */
+    void maintain()
+    {
+        std::unique_lock<std::mutex> lock(m_maintenanceMutex);
+        while (!m_stop.wait_for(lock, MAINTENANCE_PERIOD, [this] { return m_stopping; }))
+        {
+            if (m_breaker.ProbeDue())
+            {
+                lock.unlock();
+                m_breaker.Probed(probe());
+                lock.lock();
+            }
+        }
     }
 
     /*
-     * @brief Remove userId->followeeId record.
-     * @param userId follower
-     * @param followeeId followee
-     * @return True on success.
+     * @brief Run the timeline script.
+     * @param userId User
+     * @param spTweets Output vector for the merged tweets, most recent first.
+     * @param maxTweets Number of max tweets to return.
+     * @param retry Retry once with EVAL if the script is not in the cache.
+     * @return Task, true on success.
      */
-    bool DelFollowee(const int userId, const int followeeId)
+    pplx::task<bool> mergeTimelineAsync(const int userId, std::shared_ptr<std::vector<std::string>> spTweets,
+                                        const int maxTweets, const bool retry)
     {
-        if (!IsConnected())
+        std::string sha;
         {
-            return false;
+            std::lock_guard<std::mutex> lock(m_scriptMutex);
+            sha = m_timelineScriptSha;
         }
 
-        // Remove from Hash Set.
-        auto request = m_client.srem("followees:" + std::to_string(userId), {std::to_string(followeeId)});
+        std::vector<std::string> arguments = {"1", "followees:" + std::to_string(userId),
+                                              std::to_string(userId), std::to_string(maxTweets)};
+        std::vector<std::vector<std::string>> commands;
+        if (sha.empty())
+        {
+            // Load for the next calls and evaluate the source this time.
+            commands.push_back({"SCRIPT", "LOAD", timelineScript()});
+            commands.push_back({"EVAL", timelineScript()});
+        }
+        else
+        {
+            commands.push_back({"EVALSHA", sha});
+        }
+        commands.back().insert(commands.back().end(), arguments.begin(), arguments.end());
 
-        // Commit.
-        m_client.sync_commit(m_commitTimeout);
+        return commitAsync(commands, m_readTimeout).then([this, userId, spTweets, maxTweets, retry, count = commands.size()](std::vector<cpp_redis::reply> replies) {
+            if (replies.size() != count)
+            {
+                return pplx::task_from_result(false);
+            }
 
-        // Return the result.
-        return request.get().ok();
+            // Remember the SHA1 of the loaded script.
+            if (count == 2 && replies[0].ok() && replies[0].is_string())
+            {
+                std::lock_guard<std::mutex> lock(m_scriptMutex);
+                m_timelineScriptSha = replies[0].as_string();
+            }
+
+            // Script cache flushed, e.g. SCRIPT FLUSH or a restart, load it again.
+            const auto &response = replies.back();
+            if (response.is_error() && response.error().compare(0, 8, "NOSCRIPT") == 0 && retry)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_scriptMutex);
+                    m_timelineScriptSha.clear();
+                }
+                return mergeTimelineAsync(userId, spTweets, maxTweets, false);
+            }
+
+            return pplx::task_from_result(appendStrings(response, *spTweets));
+        });
     }
 
+public:
     /*
-     * @brief Destructor. Disconnect if necessary.
+     * @brief Constructor for Redis connector.
+     * @param endpoint Endpoint address.
+     * @param port Port number of Redis.
+     * @param credentials Database password.
+     * @param timeout Time to wait for a request.
+     * @param poolSize Number of connections, one request uses one connection at a time.
+     * @param serverSideMerge Merge the timelines on Redis with a Lua script.
+     * @param spFollowCache Cache of the follow graph, nullptr disables caching.
+     * @param spMetrics Registry for the round-trips in the "redis" family, optional.
+     * @param readTimeout Time to wait for a read request.
+     * @param breakerFailures Consecutive timeouts after which the calls fail fast until Redis answers a probe.
+     * @param breakerBackoff Max seconds between two probes, the wait doubles from 0.1 seconds after each failed one.
+     * @param fillFollowCache False to only read the follow cache, e.g. for a replica that may lag behind the writes.
      */
-    ~RedisDatastore()
+    RedisDatastore(const std::string &endpoint, const int port, const std::string &credentials,
+                   const double timeout = 1.0, const size_t poolSize = 8, const bool serverSideMerge = false,
+                   std::shared_ptr<FollowGraphCache> spFollowCache = nullptr, std::shared_ptr<Metrics> spMetrics = nullptr,
+                   const double readTimeout = 0.25, const size_t breakerFailures = 5, const double breakerBackoff = 10.0,
+                   const bool fillFollowCache = true)
+        : m_pool(endpoint, port, credentials, poolSize, timeout), m_commitTimeout(timeout),
+          m_serverSideMerge(serverSideMerge), m_spFollowCache(spFollowCache), m_fillFollowCache(fillFollowCache),
+          m_spMetrics(spMetrics),
+          m_pCommits(spMetrics ? &spMetrics->Operation("redis", nodeOperation("commit", endpoint, port)) : nullptr),
+          m_pAsyncCommits(spMetrics ? &spMetrics->Operation("redis", nodeOperation("commit_async", endpoint, port)) : nullptr),
+          m_pRejected(spMetrics ? &spMetrics->Operation("redis", nodeOperation("rejected", endpoint, port)) : nullptr),
+          m_readTimeout(readTimeout), m_breaker(breakerFailures, 0.1, breakerBackoff), m_stopping(false)
     {
-        if (!IsConnected())
+        m_expiry = std::thread(&RedisDatastore::expire, this);
+        m_maintenance = std::thread(&RedisDatastore::maintain, this);
+    }
+
+    /*
+     * @brief Connect to Redis
+     * @return True on success.
+     */
+    bool Connect()
+    {
+        // While the breaker is open the maintenance thread reconnects, fail fast.
+        if (m_breaker.State() == CircuitState::Open)
+        {
+            return false;
+        }
+
+        // Open all connections of the pool, broken ones are retried on checkout.
+        if (!m_pool.Connect())
+        {
+            m_breaker.Failure();
+            return false;
+        }
+        return true;
+    }
+
+    /*
+     * @brief Disconnect from Redis
+     * @return True on success.
+     */
+    bool Disconnect()
+    {
+        // Disconnect.
+        m_pool.Disconnect();
+        return true;
+    }
+
+    /*
+     * @brief Get connection state. Closed connections are reopened on checkout and the
+     *        maintenance thread reconnects while the breaker is open, so the callers need
+     *        not Connect before each request.
+     * @return True unless the circuit breaker is open.
+     */
+    bool IsConnected() const
+    {
+        // Return the connection state.
+        return m_breaker.State() != CircuitState::Open;
+    }
+
+    /*
+     * @brief Generate Unique Increasing ID Number
+     * @return Non-negative unique ID on success, -1 on error.
+     */
+    int GetUniqueNumber()
+    {
+        auto lease = acquire();
+        if (!lease)
+        {
+            return -1;
+        }
+        auto &client = lease.Client();
+
+        // Increment and get the value on Redis.
+        auto request = client.incr("uniqueNumber");
+        if (!commit(lease, request))
+        {
+            return -1;
+        }
+
+        auto response = request.get();
+        if (response.ok() && response.is_integer())
+        {
+            // Success.
+            return response.as_integer();
+        }
+
+        // Failure.
+        return -1;
+    }
+
+    /*
+     * @brief Reserve a block of unique increasing ID numbers with one INCRBY.
+     * @param count Number of IDs in the block.
+     * @return The last ID of the block on success, -1 on error.
+     */
+    int ReserveUniqueNumbers(const int count)
+    {
+        if (count < 1)
+        {
+            return -1;
+        }
+
+        auto lease = acquire();
+        if (!lease)
+        {
+            return -1;
+        }
+        auto &client = lease.Client();
+
+        // Increment by the block size and get the end of the block.
+        auto request = client.incrby("uniqueNumber", count);
+        if (!commit(lease, request))
+        {
+            return -1;
+        }
+
+        auto response = request.get();
+        if (response.ok() && response.is_integer())
+        {
+            // Success.
+            return response.as_integer();
+        }
+
+        // Failure.
+        return -1;
+    }
+
+    /*
+     * @brief Adds tweet to Redis memory cache.
+     * @param userId
+     * @param tweetAsString Serialized tweet object.
+     * @param maxTweets Keep no more than this number on datastore, -1 for unlimited.
+     * @return True on success.
+     */
+    bool AddTweet(const int userId, const std::string &tweetAsString, int maxTweets = 10)
+    {
+        auto lease = acquire();
+        if (!lease)
+        {
+            return false;
+        }
+        auto &client = lease.Client();
+
+        // Push the new tweet to the corresponding users tweets list, LTRIM 0 -1 keeps all.
+        auto request1 = client.lpush("tweets:" + std::to_string(userId), {tweetAsString});
+        auto request2 = client.ltrim("tweets:" + std::to_string(userId), 0, (maxTweets > 0) ? maxTweets - 1 : -1);
+
+        // Commit.
+        if (!commit(lease, request2))
+        {
+            return false;
+        }
+
+        // Return.
+        return request1.get().ok();
+    }
+
+    /*
+     * @brief Adds several tweets to Redis memory cache with a single commit.
+     * @param tweets Author and serialized tweet object of each tweet, pushed in order.
+     * @param results Output vector, true for each stored tweet.
+     * @param maxTweets Keep no more than this number on datastore, -1 for unlimited.
+     * @return True if all tweets are stored.
+     */
+    bool AddTweets(const std::vector<std::pair<int, std::string>> &tweets, std::vector<bool> &results,
+                   int maxTweets = 10)
+    {
+        results.assign(tweets.size(), false);
+        if (tweets.empty())
+        {
+            return true;
+        }
+
+        auto lease = acquire();
+        if (!lease)
+        {
+            return false;
+        }
+        auto &client = lease.Client();
+
+        // Pipeline the LPUSH and LTRIM of every tweet.
+        std::vector<std::future<cpp_redis::reply>> requests;
+        requests.reserve(tweets.size());
+        std::future<cpp_redis::reply> lastRequest;
+        for (const auto &tweet : tweets)
+        {
+            auto key = "tweets:" + std::to_string(tweet.first);
+            requests.push_back(client.lpush(key, {tweet.second}));
+            lastRequest = client.ltrim(key, 0, (maxTweets > 0) ? maxTweets - 1 : -1);
+        }
+
+        // Commit.
+        if (!commit(lease, lastRequest))
+        {
+            return false;
+        }
+
+        // Collect the result of each tweet.
+        bool allStored = true;
+        for (size_t i = 0; i < requests.size(); ++i)
+        {
+            results[i] = requests[i].get().ok();
+            allStored = allStored && results[i];
+        }
+        return allStored;
+    }
+
+    /*
+     * @brief Get recent tweets of all followed users.
+     * @param userIdVector users to fetch the recent tweets.
+     * @param tweets Output vector for fetched tweets.
+     * @param numberOfTweets Number of tweets for each user, -1 for all tweets.
+     * @return True on success.
+     */
+    bool GetRecentTweets(const std::vector<int> &userIdVector,
+                         std::vector<std::string> &tweets, int numberOfTweets = -1)
+    {
+        auto lease = acquire();
+        if (!lease)
+        {
+            return false;
+        }
+        auto &client = lease.Client();
+
+        // Issue all requests in a loop.
+        std::vector<std::future<cpp_redis::reply>> requestVector;
+        for (auto userId : userIdVector)
+        {
+            // Get left items of Redis List object.
+            requestVector.push_back(client.lrange("tweets:" + std::to_string(userId),
+                                                  0, (numberOfTweets == -1) ? -1 : numberOfTweets - 1));
+        }
+
+        // Commit once.
+        if (requestVector.empty() || !commit(lease, requestVector.back(), m_readTimeout))
+        {
+            return requestVector.empty();
+        }
+
+        // Add the returned tweets to the output vector.
+        for (auto &request : requestVector)
+        {
+            if (appendStrings(request.get(), tweets) == false)
+            {
+                return false;
+            }
+        }
+
+        // Return.
+        return true;
+    }
+
+    /*
+     * @brief Get recent tweets of several users, one list per user.
+     * @param userIdVector users to fetch the recent tweets.
+     * @param tweetLists Output, one list per user in the same order, most recent first.
+     * @param numberOfTweets Number of tweets for each user, -1 for all tweets.
+     * @return True on success.
+     */
+    bool GetRecentTweetLists(const std::vector<int> &userIdVector,
+                             std::vector<std::vector<std::string>> &tweetLists, int numberOfTweets = -1)
+    {
+        if (userIdVector.empty())
+        {
+            return true;
+        }
+
+        auto lease = acquire();
+        if (!lease)
+        {
+            return false;
+        }
+        auto &client = lease.Client();
+
+        // Issue all requests in a loop.
+        std::vector<std::future<cpp_redis::reply>> requestVector;
+        for (auto userId : userIdVector)
+        {
+            requestVector.push_back(client.lrange("tweets:" + std::to_string(userId),
+                                                  0, (numberOfTweets == -1) ? -1 : numberOfTweets - 1));
+        }
+
+        // Commit once.
+        if (!commit(lease, requestVector.back(), m_readTimeout))
+        {
+            return false;
+        }
+
+        // One output list per request.
+        for (auto &request : requestVector)
+        {
+            tweetLists.emplace_back();
+            if (appendStrings(request.get(), tweetLists.back()) == false)
+            {
+                return false;
+            }
+        }
+
+        // Return.
+        return true;
+    }
+
+    /*
+     * @brief Get followed users of userId.
+     * @param userId users to fetch the recent tweets.
+     * @param followees Output vector for followees.
+     * @return True on success.
+     */
+    bool GetFollowees(const int userId, std::vector<int> &followees)
+    {
+        if (m_spFollowCache && m_spFollowCache->Get(FollowRelation::Followees, userId, followees))
+        {
+            return true;
+        }
+
+        uint64_t epoch = m_spFollowCache ? m_spFollowCache->Epoch() : 0;
+        auto lease = acquire();
+        if (!lease)
+        {
+            return false;
+        }
+        auto &client = lease.Client();
+
+        // Get all members of Redis Hash Set object.
+        auto request = client.smembers("followees:" + std::to_string(userId));
+
+        // Commit.
+        if (!commit(lease, request, m_readTimeout))
+        {
+            return false;
+        }
+
+        // Check the response and cast to integers.
+        std::vector<int> ids;
+        if (!appendIntegers(request.get(), ids))
+        {
+            return false;
+        }
+        if (m_spFollowCache && m_fillFollowCache)
+        {
+            m_spFollowCache->Fill(FollowRelation::Followees, userId, ids, epoch);
+        }
+        followees.insert(followees.end(), ids.begin(), ids.end());
+        return true;
+    }
+
+    /*
+     * @brief Create userId->followeeId record.
+     * @param userId follower
+     * @param followeeId followee
+     * @return True on success.
+     */
+    bool AddFollowee(const int userId, const int followeeId)
+    {
+        auto lease = acquire();
+        if (!lease)
+        {
+            return false;
+        }
+        auto &client = lease.Client();
+
+        // Add to Hash Set and to the reverse index.
+        auto request1 = client.sadd("followees:" + std::to_string(userId), {std::to_string(followeeId)});
+        auto request2 = client.sadd("followers:" + std::to_string(followeeId), {std::to_string(userId)});
+
+        // Commit.
+        if (!commit(lease, request2))
+        {
+            return writeThrough(userId, followeeId, true, false);
+        }
+
+        // Return the result.
+        return writeThrough(userId, followeeId, true, request1.get().ok() && request2.get().ok());
+    }
+
+    /*
+     * @brief Remove userId->followeeId record.
+     * @param userId follower
+     * @param followeeId followee
+     * @return True on success.
+     */
+    bool DelFollowee(const int userId, const int followeeId)
+    {
+        auto lease = acquire();
+        if (!lease)
+        {
+            return false;
+        }
+        auto &client = lease.Client();
+
+        // Remove from Hash Set and from the reverse index.
+        auto request1 = client.srem("followees:" + std::to_string(userId), {std::to_string(followeeId)});
+        auto request2 = client.srem("followers:" + std::to_string(followeeId), {std::to_string(userId)});
+
+        // Commit.
+        if (!commit(lease, request2))
+        {
+            return writeThrough(userId, followeeId, false, false);
+        }
+
+        // Return the result.
+        return writeThrough(userId, followeeId, false, request1.get().ok() && request2.get().ok());
+    }
+
+    /*
+     * @brief Add followeeId to the followees of userId.
+     * @param userId follower
+     * @param followeeId followee
+     * @return True on success.
+     */
+    bool AddFolloweeEdge(const int userId, const int followeeId)
+    {
+        return writeEdge(FollowRelation::Followees, userId, followeeId, true);
+    }
+
+    /*
+     * @brief Add userId to the followers of followeeId.
+     * @param userId follower
+     * @param followeeId followee
+     * @return True on success.
+     */
+    bool AddFollowerEdge(const int userId, const int followeeId)
+    {
+        return writeEdge(FollowRelation::Followers, userId, followeeId, true);
+    }
+
+    /*
+     * @brief Remove followeeId from the followees of userId.
+     * @param userId follower
+     * @param followeeId followee
+     * @return True on success.
+     */
+    bool DelFolloweeEdge(const int userId, const int followeeId)
+    {
+        return writeEdge(FollowRelation::Followees, userId, followeeId, false);
+    }
+
+    /*
+     * @brief Remove userId from the followers of followeeId.
+     * @param userId follower
+     * @param followeeId followee
+     * @return True on success.
+     */
+    bool DelFollowerEdge(const int userId, const int followeeId)
+    {
+        return writeEdge(FollowRelation::Followers, userId, followeeId, false);
+    }
+
+    /*
+     * @brief Get users following userId.
+     * @param userId followee
+     * @param followers Output vector for followers.
+     * @return True on success.
+     */
+    bool GetFollowers(const int userId, std::vector<int> &followers)
+    {
+        if (m_spFollowCache && m_spFollowCache->Get(FollowRelation::Followers, userId, followers))
+        {
+            return true;
+        }
+
+        uint64_t epoch = m_spFollowCache ? m_spFollowCache->Epoch() : 0;
+        auto lease = acquire();
+        if (!lease)
+        {
+            return false;
+        }
+        auto &client = lease.Client();
+
+        // Get all members of the reverse index.
+        auto request = client.smembers("followers:" + std::to_string(userId));
+
+        // Commit.
+        if (!commit(lease, request, m_readTimeout))
+        {
+            return false;
+        }
+
+        // Check the response and cast to integers.
+        std::vector<int> ids;
+        if (!appendIntegers(request.get(), ids))
+        {
+            return false;
+        }
+        if (m_spFollowCache && m_fillFollowCache)
+        {
+            m_spFollowCache->Fill(FollowRelation::Followers, userId, ids, epoch);
+        }
+        followers.insert(followers.end(), ids.begin(), ids.end());
+        return true;
+    }
+
+    /*
+     * @brief Get the number of followers of several users.
+     * @param userIdVector Users to count the followers of.
+     * @param counts Output vector, same order as userIdVector.
+     * @return True on success.
+     */
+    bool GetFollowerCounts(const std::vector<int> &userIdVector, std::vector<int> &counts)
+    {
+        auto lease = acquire();
+        if (!lease)
+        {
+            return false;
+        }
+        auto &client = lease.Client();
+
+        // Issue all requests in a loop.
+        std::vector<std::future<cpp_redis::reply>> requestVector;
+        for (auto userId : userIdVector)
+        {
+            requestVector.push_back(client.scard("followers:" + std::to_string(userId)));
+        }
+
+        // Commit once.
+        if (requestVector.empty() || !commit(lease, requestVector.back(), m_readTimeout))
+        {
+            return requestVector.empty();
+        }
+
+        // Add the returned counts to the output vector.
+        for (auto &request : requestVector)
+        {
+            auto response = request.get();
+            if (response.ok() == false || response.is_integer() == false)
+            {
+                return false;
+            }
+            counts.push_back(static_cast<int>(response.as_integer()));
+        }
+
+        // Return.
+        return true;
+    }
+
+    /*
+     * @brief Push a tweet to the materialized timelines of several users.
+     * @param userIdVector Owners of the timelines.
+     * @param tweetAsString Serialized tweet object.
+     * @param maxTweets Keep no more than this number per timeline, -1 for unlimited.
+     * @return True on success.
+     */
+    bool PushTimelines(const std::vector<int> &userIdVector, const std::string &tweetAsString, int maxTweets = 10)
+    {
+        auto lease = acquire();
+        if (!lease)
+        {
+            return false;
+        }
+        auto &client = lease.Client();
+
+        // Issue all requests in a loop, LTRIM 0 -1 keeps all.
+        std::vector<std::future<cpp_redis::reply>> requestVector;
+        for (auto userId : userIdVector)
+        {
+            requestVector.push_back(client.lpush("timeline:" + std::to_string(userId), {tweetAsString}));
+            requestVector.push_back(client.ltrim("timeline:" + std::to_string(userId),
+                                                 0, (maxTweets > 0) ? maxTweets - 1 : -1));
+        }
+
+        // Commit once.
+        if (requestVector.empty() || !commit(lease, requestVector.back()))
+        {
+            return requestVector.empty();
+        }
+
+        // Check all pushes.
+        bool success = true;
+        for (auto &request : requestVector)
+        {
+            success = request.get().ok() && success;
+        }
+
+        // Return.
+        return success;
+    }
+
+    /*
+     * @brief Get the materialized timeline of a user.
+     * @param userId Owner of the timeline.
+     * @param tweets Output vector for fetched tweets, most recent first.
+     * @param numberOfTweets Number of tweets to read, -1 for all tweets.
+     * @return True on success.
+     */
+    bool GetTimelineTweets(const int userId, std::vector<std::string> &tweets, int numberOfTweets = -1)
+    {
+        auto lease = acquire();
+        if (!lease)
+        {
+            return false;
+        }
+        auto &client = lease.Client();
+
+        // Single range read.
+        auto request = client.lrange("timeline:" + std::to_string(userId),
+                                     0, (numberOfTweets == -1) ? -1 : numberOfTweets - 1);
+
+        // Commit.
+        if (!commit(lease, request, m_readTimeout))
+        {
+            return false;
+        }
+
+        // Check the response.
+        return appendStrings(request.get(), tweets);
+    }
+
+    /*
+     * @brief Replace the materialized timeline of a user if its head is still the expected one.
+     *        Compared and replaced by a script, so a fan-out push since the read is never lost.
+     * @param userId Owner of the timeline.
+     * @param expectedTweets Head of the timeline as read before, empty if there was no timeline.
+     * @param tweets Serialized tweets, most recent first.
+     * @param replaced Output, false if a push changed the timeline since the read.
+     * @return True on success.
+     */
+    bool ReplaceTimelineTweets(const int userId, const std::vector<std::string> &expectedTweets,
+                               const std::vector<std::string> &tweets, bool &replaced)
+    {
+        auto lease = acquire();
+        if (!lease)
+        {
+            return false;
+        }
+        auto &client = lease.Client();
+
+        // Compare and replace in one script.
+        auto request = client.eval(replaceTimelineScript(), 1, {"timeline:" + std::to_string(userId)},
+                                   replaceTimelineArguments(expectedTweets, tweets));
+
+        // Commit.
+        if (!commit(lease, request))
+        {
+            return false;
+        }
+
+        // Check the response.
+        auto response = request.get();
+        if (!response.ok() || !response.is_integer())
+        {
+            return false;
+        }
+        replaced = (response.as_integer() == 1);
+        return true;
+    }
+
+    /*
+     * @brief Asynchronous GetUniqueNumber.
+     * @return Task with the unique ID, -1 on error.
+     */
+    pplx::task<int> GetUniqueNumberAsync()
+    {
+        return commitAsync({{"INCR", "uniqueNumber"}}).then([](std::vector<cpp_redis::reply> replies) {
+            if (replies.size() == 1 && replies[0].ok() && replies[0].is_integer())
+            {
+                return static_cast<int>(replies[0].as_integer());
+            }
+            return -1;
+        });
+    }
+
+    /*
+     * @brief Asynchronous ReserveUniqueNumbers.
+     * @param count Number of IDs in the block.
+     * @return Task with the last ID of the block, -1 on error.
+     */
+    pplx::task<int> ReserveUniqueNumbersAsync(const int count)
+    {
+        if (count < 1)
+        {
+            return pplx::task_from_result(-1);
+        }
+
+        return commitAsync({{"INCRBY", "uniqueNumber", std::to_string(count)}}).then([](std::vector<cpp_redis::reply> replies) {
+            if (replies.size() == 1 && replies[0].ok() && replies[0].is_integer())
+            {
+                return static_cast<int>(replies[0].as_integer());
+            }
+            return -1;
+        });
+    }
+
+    /*
+     * @brief Asynchronous AddTweet.
+     * @param userId
+     * @param tweetAsString Serialized tweet object.
+     * @param maxTweets Keep no more than this number on datastore, -1 for unlimited.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> AddTweetAsync(const int userId, const std::string &tweetAsString, int maxTweets = 10)
+    {
+        auto key = "tweets:" + std::to_string(userId);
+        return commitAsync({{"LPUSH", key, tweetAsString},
+                            {"LTRIM", key, "0", std::to_string((maxTweets > 0) ? maxTweets - 1 : -1)}})
+            .then([](std::vector<cpp_redis::reply> replies) {
+                return replies.size() == 2 && replies[0].ok();
+            });
+    }
+
+    /*
+     * @brief Asynchronous AddTweets, single pipeline.
+     * @param tweets Author and serialized tweet object of each tweet, pushed in order.
+     * @param spResults Output vector, true for each stored tweet.
+     * @param maxTweets Keep no more than this number on datastore, -1 for unlimited.
+     * @return Task, true if all tweets are stored.
+     */
+    pplx::task<bool> AddTweetsAsync(const std::vector<std::pair<int, std::string>> &tweets,
+                                    std::shared_ptr<std::vector<bool>> spResults, int maxTweets = 10)
+    {
+        spResults->assign(tweets.size(), false);
+        if (tweets.empty())
+        {
+            return pplx::task_from_result(true);
+        }
+
+        std::vector<std::vector<std::string>> commands;
+        commands.reserve(tweets.size() * 2);
+        for (const auto &tweet : tweets)
+        {
+            auto key = "tweets:" + std::to_string(tweet.first);
+            commands.push_back({"LPUSH", key, tweet.second});
+            commands.push_back({"LTRIM", key, "0", std::to_string((maxTweets > 0) ? maxTweets - 1 : -1)});
+        }
+
+        return commitAsync(commands).then([spResults](std::vector<cpp_redis::reply> replies) {
+            if (replies.size() != spResults->size() * 2)
+            {
+                return false;
+            }
+
+            bool allStored = true;
+            for (size_t i = 0; i < spResults->size(); ++i)
+            {
+                (*spResults)[i] = replies[i * 2].ok();
+                allStored = allStored && (*spResults)[i];
+            }
+            return allStored;
+        });
+    }
+
+    /*
+     * @brief Asynchronous GetRecentTweets.
+     * @param userIdVector users to fetch the recent tweets.
+     * @param spTweets Output vector for fetched tweets.
+     * @param numberOfTweets Number of tweets for each user, -1 for all tweets.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> GetRecentTweetsAsync(const std::vector<int> &userIdVector,
+                                          std::shared_ptr<std::vector<std::string>> spTweets, int numberOfTweets = -1)
+    {
+        if (userIdVector.empty())
+        {
+            return pplx::task_from_result(true);
+        }
+
+        std::vector<std::vector<std::string>> commands;
+        for (auto userId : userIdVector)
+        {
+            commands.push_back({"LRANGE", "tweets:" + std::to_string(userId), "0",
+                                std::to_string((numberOfTweets == -1) ? -1 : numberOfTweets - 1)});
+        }
+
+        return commitAsync(commands, m_readTimeout).then([spTweets, count = commands.size()](std::vector<cpp_redis::reply> replies) {
+            if (replies.size() != count)
+            {
+                return false;
+            }
+            for (const auto &response : replies)
+            {
+                if (appendStrings(response, *spTweets) == false)
+                {
+                    return false;
+                }
+            }
+            return true;
+        });
+    }
+
+    /*
+     * @brief Asynchronous GetRecentTweetLists.
+     * @param userIdVector users to fetch the recent tweets.
+     * @param spTweetLists Output, one list per user in the same order, most recent first.
+     * @param numberOfTweets Number of tweets for each user, -1 for all tweets.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> GetRecentTweetListsAsync(const std::vector<int> &userIdVector,
+                                              std::shared_ptr<std::vector<std::vector<std::string>>> spTweetLists,
+                                              int numberOfTweets = -1)
+    {
+        if (userIdVector.empty())
+        {
+            return pplx::task_from_result(true);
+        }
+
+        std::vector<std::vector<std::string>> commands;
+        for (auto userId : userIdVector)
+        {
+            commands.push_back({"LRANGE", "tweets:" + std::to_string(userId), "0",
+                                std::to_string((numberOfTweets == -1) ? -1 : numberOfTweets - 1)});
+        }
+
+        return commitAsync(commands, m_readTimeout).then([spTweetLists, count = commands.size()](std::vector<cpp_redis::reply> replies) {
+            if (replies.size() != count)
+            {
+                return false;
+            }
+            for (const auto &response : replies)
+            {
+                spTweetLists->emplace_back();
+                if (appendStrings(response, spTweetLists->back()) == false)
+                {
+                    return false;
+                }
+            }
+            return true;
+        });
+    }
+
+    /*
+     * @brief Asynchronous GetRecentTweetLists into a per-request arena. The Redis client still
+     *        allocates one string per tweet for the replies, those are copied into one buffer sized
+     *        up front and released with the replies, so only the merge and the response are free
+     *        of per-tweet allocations on this path.
+     * @param userIdVector users to fetch the recent tweets.
+     * @param spArena Output arena, gets one list per user in the same order.
+     * @param numberOfTweets Number of tweets for each user, -1 for all tweets.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> GetRecentTweetArenaAsync(const std::vector<int> &userIdVector,
+                                              std::shared_ptr<TweetArena> spArena, int numberOfTweets = -1)
+    {
+        if (userIdVector.empty())
+        {
+            return pplx::task_from_result(true);
+        }
+
+        std::vector<std::vector<std::string>> commands;
+        for (auto userId : userIdVector)
+        {
+            commands.push_back({"LRANGE", "tweets:" + std::to_string(userId), "0",
+                                std::to_string((numberOfTweets == -1) ? -1 : numberOfTweets - 1)});
+        }
+
+        return commitAsync(commands, m_readTimeout).then([spArena, count = commands.size()](std::vector<cpp_redis::reply> replies) {
+            if (replies.size() != count)
+            {
+                return false;
+            }
+
+            // Size the arena, then copy.
+            size_t bytes = 0, tweets = 0;
+            for (const auto &response : replies)
+            {
+                if (response.ok() == false || response.is_array() == false)
+                {
+                    return false;
+                }
+                for (const auto &element : response.as_array())
+                {
+                    bytes += element.as_string().size();
+                    ++tweets;
+                }
+            }
+            spArena->Reserve(bytes, tweets, replies.size());
+
+            for (const auto &response : replies)
+            {
+                for (const auto &element : response.as_array())
+                {
+                    spArena->Append(element.as_string());
+                }
+                spArena->EndList();
+            }
+            return true;
+        });
+    }
+
+    /*
+     * @brief Asynchronous GetFollowees.
+     * @param userId users to fetch the recent tweets.
+     * @param spFollowees Output vector for followees.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> GetFolloweesAsync(const int userId, std::shared_ptr<std::vector<int>> spFollowees)
+    {
+        return getFollowsAsync(FollowRelation::Followees, userId, spFollowees);
+    }
+
+    /*
+     * @brief Asynchronous AddFollowee.
+     * @param userId follower
+     * @param followeeId followee
+     * @return Task, true on success.
+     */
+    pplx::task<bool> AddFolloweeAsync(const int userId, const int followeeId)
+    {
+        return commitAsync({{"SADD", "followees:" + std::to_string(userId), std::to_string(followeeId)},
+                            {"SADD", "followers:" + std::to_string(followeeId), std::to_string(userId)}})
+            .then([this, userId, followeeId](std::vector<cpp_redis::reply> replies) {
+                return writeThrough(userId, followeeId, true, replies.size() == 2 && replies[0].ok() && replies[1].ok());
+            });
+    }
+
+    /*
+     * @brief Asynchronous DelFollowee.
+     * @param userId follower
+     * @param followeeId followee
+     * @return Task, true on success.
+     */
+    pplx::task<bool> DelFolloweeAsync(const int userId, const int followeeId)
+    {
+        return commitAsync({{"SREM", "followees:" + std::to_string(userId), std::to_string(followeeId)},
+                            {"SREM", "followers:" + std::to_string(followeeId), std::to_string(userId)}})
+            .then([this, userId, followeeId](std::vector<cpp_redis::reply> replies) {
+                return writeThrough(userId, followeeId, false, replies.size() == 2 && replies[0].ok() && replies[1].ok());
+            });
+    }
+
+    /*
+     * @brief Asynchronous AddFolloweeEdge.
+     * @param userId follower
+     * @param followeeId followee
+     * @return Task, true on success.
+     */
+    pplx::task<bool> AddFolloweeEdgeAsync(const int userId, const int followeeId)
+    {
+        return writeEdgeAsync(FollowRelation::Followees, userId, followeeId, true);
+    }
+
+    /*
+     * @brief Asynchronous AddFollowerEdge.
+     * @param userId follower
+     * @param followeeId followee
+     * @return Task, true on success.
+     */
+    pplx::task<bool> AddFollowerEdgeAsync(const int userId, const int followeeId)
+    {
+        return writeEdgeAsync(FollowRelation::Followers, userId, followeeId, true);
+    }
+
+    /*
+     * @brief Asynchronous DelFolloweeEdge.
+     * @param userId follower
+     * @param followeeId followee
+     * @return Task, true on success.
+     */
+    pplx::task<bool> DelFolloweeEdgeAsync(const int userId, const int followeeId)
+    {
+        return writeEdgeAsync(FollowRelation::Followees, userId, followeeId, false);
+    }
+
+    /*
+     * @brief Asynchronous DelFollowerEdge.
+     * @param userId follower
+     * @param followeeId followee
+     * @return Task, true on success.
+     */
+    pplx::task<bool> DelFollowerEdgeAsync(const int userId, const int followeeId)
+    {
+        return writeEdgeAsync(FollowRelation::Followers, userId, followeeId, false);
+    }
+
+    /*
+     * @brief Asynchronous GetFollowers.
+     * @param userId followee
+     * @param spFollowers Output vector for followers.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> GetFollowersAsync(const int userId, std::shared_ptr<std::vector<int>> spFollowers)
+    {
+        return getFollowsAsync(FollowRelation::Followers, userId, spFollowers);
+    }
+
+    /*
+     * @brief Asynchronous GetFollowerCounts.
+     * @param userIdVector Users to count the followers of.
+     * @param spCounts Output vector, same order as userIdVector.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> GetFollowerCountsAsync(const std::vector<int> &userIdVector, std::shared_ptr<std::vector<int>> spCounts)
+    {
+        if (userIdVector.empty())
+        {
+            return pplx::task_from_result(true);
+        }
+
+        std::vector<std::vector<std::string>> commands;
+        for (auto userId : userIdVector)
+        {
+            commands.push_back({"SCARD", "followers:" + std::to_string(userId)});
+        }
+
+        return commitAsync(commands, m_readTimeout).then([spCounts, count = commands.size()](std::vector<cpp_redis::reply> replies) {
+            if (replies.size() != count)
+            {
+                return false;
+            }
+            for (const auto &response : replies)
+            {
+                if (response.ok() == false || response.is_integer() == false)
+                {
+                    return false;
+                }
+                spCounts->push_back(static_cast<int>(response.as_integer()));
+            }
+            return true;
+        });
+    }
+
+    /*
+     * @brief Asynchronous PushTimelines.
+     * @param userIdVector Owners of the timelines.
+     * @param tweetAsString Serialized tweet object.
+     * @param maxTweets Keep no more than this number per timeline, -1 for unlimited.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> PushTimelinesAsync(const std::vector<int> &userIdVector, const std::string &tweetAsString, int maxTweets = 10)
+    {
+        if (userIdVector.empty())
+        {
+            return pplx::task_from_result(true);
+        }
+
+        std::vector<std::vector<std::string>> commands;
+        for (auto userId : userIdVector)
+        {
+            auto key = "timeline:" + std::to_string(userId);
+            commands.push_back({"LPUSH", key, tweetAsString});
+            commands.push_back({"LTRIM", key, "0", std::to_string((maxTweets > 0) ? maxTweets - 1 : -1)});
+        }
+
+        return commitAsync(commands).then([count = commands.size()](std::vector<cpp_redis::reply> replies) {
+            if (replies.size() != count)
+            {
+                return false;
+            }
+            for (const auto &response : replies)
+            {
+                if (response.ok() == false)
+                {
+                    return false;
+                }
+            }
+            return true;
+        });
+    }
+
+    /*
+     * @brief Asynchronous GetTimelineTweets.
+     * @param userId Owner of the timeline.
+     * @param spTweets Output vector for fetched tweets, most recent first.
+     * @param numberOfTweets Number of tweets to read, -1 for all tweets.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> GetTimelineTweetsAsync(const int userId, std::shared_ptr<std::vector<std::string>> spTweets, int numberOfTweets = -1)
+    {
+        return commitAsync({{"LRANGE", "timeline:" + std::to_string(userId), "0",
+                             std::to_string((numberOfTweets == -1) ? -1 : numberOfTweets - 1)}},
+                           m_readTimeout)
+            .then([spTweets](std::vector<cpp_redis::reply> replies) {
+                return replies.size() == 1 && appendStrings(replies[0], *spTweets);
+            });
+    }
+
+    /*
+     * @brief Asynchronous ReplaceTimelineTweets.
+     * @param userId Owner of the timeline.
+     * @param expectedTweets Head of the timeline as read before, empty if there was no timeline.
+     * @param tweets Serialized tweets, most recent first.
+     * @param spReplaced Output, false if a push changed the timeline since the read.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> ReplaceTimelineTweetsAsync(const int userId, const std::vector<std::string> &expectedTweets,
+                                                const std::vector<std::string> &tweets, std::shared_ptr<bool> spReplaced)
+    {
+        std::vector<std::string> eval = {"EVAL", replaceTimelineScript(), "1", "timeline:" + std::to_string(userId)};
+        auto arguments = replaceTimelineArguments(expectedTweets, tweets);
+        eval.insert(eval.end(), arguments.begin(), arguments.end());
+
+        return commitAsync({eval}).then([spReplaced](std::vector<cpp_redis::reply> replies) {
+            if (replies.size() != 1 || !replies[0].ok() || !replies[0].is_integer())
+            {
+                return false;
+            }
+            *spReplaced = (replies[0].as_integer() == 1);
+            return true;
+        });
+    }
+
+    /*
+     * @brief Check if the timeline merge runs on Redis.
+     * @return True if enabled.
+     */
+    bool HasServerSideMerge() const
+    {
+        return m_serverSideMerge;
+    }
+
+    /*
+     * @brief Merge the recent tweets of the followees and the user on Redis, single round-trip.
+     *        Runs the cached script with EVALSHA, the first call and a flushed script cache
+     *        fall back to EVAL and load the script again.
+     * @param userId User
+     * @param spTweets Output vector for the merged tweets, most recent first.
+     * @param maxTweets Number of max tweets to return.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> GetMergedTimelineAsync(const int userId, std::shared_ptr<std::vector<std::string>> spTweets,
+                                            int maxTweets = 10)
+    {
+        return mergeTimelineAsync(userId, spTweets, maxTweets, true);
+    }
+
+    /*
+     * @brief Merge the recent tweets of the followees and the user on Redis.
+     * @param userId User
+     * @param tweets Output vector for the merged tweets, most recent first.
+     * @param maxTweets Number of max tweets to return.
+     * @return True on success.
+     */
+    bool GetMergedTimeline(const int userId, std::vector<std::string> &tweets, int maxTweets = 10)
+    {
+        auto spTweets = std::make_shared<std::vector<std::string>>();
+        if (GetMergedTimelineAsync(userId, spTweets, maxTweets).get() == false)
+        {
+            return false;
+        }
+
+        tweets.insert(tweets.end(), spTweets->begin(), spTweets->end());
+        return true;
+    }
+
+    /*
+     * @brief Destructor. Stop the background threads, fail the pending batches and disconnect if necessary.
+     */
+    ~RedisDatastore()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_maintenanceMutex);
+            m_stopping = true;
+        }
+        m_stop.notify_all();
+        m_expiry.join();
+        m_maintenance.join();
+        expireBatches(true);
+
+        if (m_pool.IsConnected())
         {
             Disconnect();
         }
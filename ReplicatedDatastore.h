@@ -0,0 +1,659 @@
+/**
+ * @file      ReplicatedDatastore.h
+ * @author    Atakan S.
+ * @version   1.0
+ * @brief     Datastore that sends reads to replicas and writes to the primary.
+ *
+ * @copyright Copyright (c) 2020 Atakan SARIOGLU ~ www.atakansarioglu.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _H_REPLICATEDDATASTORE_H_
+#define _H_REPLICATEDDATASTORE_H_
+
+#include "IDatastore.h"
+#include "TweetArena.h"
+#include <pplx/pplxtasks.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * @brief Sends the writes to the primary datastore and spreads the reads over its replicas
+ *        round-robin, skipping the disconnected ones. A user who wrote within the
+ *        read-your-writes window is read from the primary, so the replication lag does not
+ *        hide a tweet or a follow from its author. The write times are kept in a fixed table
+ *        of hashed slots, a collision only sends a read to the primary. A read of several
+ *        users, e.g. the tweets of the followees, is split: the users who wrote within the
+ *        window are read from the primary, the others from a replica, both in parallel.
+ */
+class ReplicatedDatastore : public IDatastore
+{
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Number of write time slots, a power of two.
+    static constexpr size_t WRITE_SLOTS = 1 << 16;
+
+    // Datastore that takes the writes.
+    std::shared_ptr<IDatastore> m_spPrimary;
+
+    // Datastores that serve the reads.
+    std::vector<std::shared_ptr<IDatastore>> m_replicas;
+
+    // Round-robin position among the replicas.
+    std::atomic<size_t> m_next;
+
+    // Read-your-writes window in microseconds, 0 disables it.
+    int64_t m_windowMicros;
+
+    // Time of the last write of the users hashed to each slot, microseconds of Clock.
+    std::unique_ptr<std::atomic<int64_t>[]> m_writeTimes;
+
+    /*
+     * @brief Current time.
+     * @return Microseconds of Clock.
+     */
+    static int64_t nowMicros()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count();
+    }
+
+    /*
+     * @brief Write time slot of a user.
+     * @param userId User
+     * @return Slot
+     */
+    std::atomic<int64_t> &slotOf(const int userId) const
+    {
+        uint64_t hash = static_cast<uint32_t>(userId) * 0x9E3779B97F4A7C15ull;
+        return m_writeTimes[(hash >> 32) & (WRITE_SLOTS - 1)];
+    }
+
+    /*
+     * @brief Remember that a user wrote now.
+     * @param userId User
+     */
+    void wrote(const int userId)
+    {
+        if (m_windowMicros > 0)
+        {
+            slotOf(userId).store(nowMicros(), std::memory_order_relaxed);
+        }
+    }
+
+    /*
+     * @brief Check if a user wrote within the read-your-writes window.
+     * @param userId User
+     * @return True if recently written.
+     */
+    bool wroteRecently(const int userId) const
+    {
+        return m_windowMicros > 0 && nowMicros() - slotOf(userId).load(std::memory_order_relaxed) < m_windowMicros;
+    }
+
+    /*
+     * @brief Datastore to read the records of a user from.
+     * @param userId User
+     * @return Primary if the user wrote recently, the next connected replica otherwise.
+     */
+    IDatastore &readerOf(const int userId)
+    {
+        return wroteRecently(userId) ? *m_spPrimary : nextReplica();
+    }
+
+    // Users of a read that go to the same datastore, and their positions in the read.
+    struct Partition
+    {
+        std::vector<int> userIds;
+        std::vector<size_t> positions;
+    };
+
+    /*
+     * @brief Split the users of a read into the ones who wrote recently and the others.
+     * @param userIdVector Users
+     * @param primary Output, users read from the primary.
+     * @param replica Output, users read from a replica.
+     * @return True if both parts have users, the read is then split.
+     */
+    bool split(const std::vector<int> &userIdVector, Partition &primary, Partition &replica) const
+    {
+        for (size_t i = 0; i < userIdVector.size(); ++i)
+        {
+            auto &part = wroteRecently(userIdVector[i]) ? primary : replica;
+            part.userIds.push_back(userIdVector[i]);
+            part.positions.push_back(i);
+        }
+        return !primary.userIds.empty() && !replica.userIds.empty();
+    }
+
+    /*
+     * @brief Datastore to read the records of several users from, if the read is not split.
+     * @param primary Users read from the primary.
+     * @return Primary if any user wrote recently, the next connected replica otherwise.
+     */
+    IDatastore &readerOf(const Partition &primary)
+    {
+        return primary.userIds.empty() ? nextReplica() : *m_spPrimary;
+    }
+
+    /*
+     * @brief Wait for both parts of a split read.
+     * @param primary Read from the primary.
+     * @param replica Read from a replica.
+     * @return Task, true if both succeeded.
+     */
+    static pplx::task<bool> whenBoth(pplx::task<bool> primary, pplx::task<bool> replica)
+    {
+        std::vector<pplx::task<bool>> tasks = {primary, replica};
+        return pplx::when_all(tasks.begin(), tasks.end()).then([](std::vector<bool> results) {
+            return results[0] && results[1];
+        });
+    }
+
+    /*
+     * @brief Next connected replica in round-robin order.
+     * @return Replica, the primary if none is connected.
+     */
+    IDatastore &nextReplica()
+    {
+        for (size_t attempt = 0; attempt < m_replicas.size(); ++attempt)
+        {
+            auto &replica = *m_replicas[m_next.fetch_add(1, std::memory_order_relaxed) % m_replicas.size()];
+            if (replica.IsConnected())
+            {
+                return replica;
+            }
+        }
+        return *m_spPrimary;
+    }
+
+    /*
+     * @brief Remember the write of a user once its task completes.
+     * @param userId User
+     * @param outcome Write task.
+     * @return Task of the same outcome.
+     */
+    template <typename T>
+    pplx::task<T> wroteWhenDone(const int userId, pplx::task<T> outcome)
+    {
+        wrote(userId);
+        return outcome.then([this, userId](T result) {
+            wrote(userId);
+            return result;
+        });
+    }
+
+public:
+    /*
+     * @brief Constructor of the replicated datastore.
+     * @param spPrimary Datastore that takes the writes.
+     * @param replicas Datastores that replicate the primary and serve the reads.
+     * @param readYourWritesSeconds Seconds after a write in which the writer is read from the primary, 0 disables it.
+     */
+    ReplicatedDatastore(std::shared_ptr<IDatastore> spPrimary, const std::vector<std::shared_ptr<IDatastore>> &replicas,
+                        const double readYourWritesSeconds = 1.0)
+        : m_spPrimary(spPrimary), m_replicas(replicas), m_next(0),
+          m_windowMicros(static_cast<int64_t>(readYourWritesSeconds * 1e6)),
+          m_writeTimes(new std::atomic<int64_t>[WRITE_SLOTS])
+    {
+        // Slots start outside of any window.
+        for (size_t slot = 0; slot < WRITE_SLOTS; ++slot)
+        {
+            m_writeTimes[slot].store(nowMicros() - m_windowMicros, std::memory_order_relaxed);
+        }
+    }
+
+    /*
+     * @brief Connect the primary and the replicas, the replicas are optional.
+     * @return True if the primary is connected.
+     */
+    bool Connect()
+    {
+        for (auto &spReplica : m_replicas)
+        {
+            if (!spReplica->IsConnected())
+            {
+                spReplica->Connect();
+            }
+        }
+        return m_spPrimary->IsConnected() || m_spPrimary->Connect();
+    }
+
+    /*
+     * @brief Disconnect the primary and the replicas.
+     * @return True on success.
+     */
+    bool Disconnect()
+    {
+        bool disconnected = true;
+        for (auto &spReplica : m_replicas)
+        {
+            disconnected = spReplica->Disconnect() && disconnected;
+        }
+        return m_spPrimary->Disconnect() && disconnected;
+    }
+
+    /*
+     * @brief Get connection state.
+     * @return True if the primary is connected.
+     */
+    bool IsConnected() const
+    {
+        return m_spPrimary->IsConnected();
+    }
+
+    // Writes go to the primary, reads to the replicas unless the users wrote recently, see IDatastore.
+    int GetUniqueNumber()
+    {
+        return m_spPrimary->GetUniqueNumber();
+    }
+
+    int ReserveUniqueNumbers(const int count)
+    {
+        return m_spPrimary->ReserveUniqueNumbers(count);
+    }
+
+    bool AddTweet(const int userId, const std::string &tweetAsString, int maxTweets = 10)
+    {
+        wrote(userId);
+        bool success = m_spPrimary->AddTweet(userId, tweetAsString, maxTweets);
+        wrote(userId);
+        return success;
+    }
+
+    bool AddTweets(const std::vector<std::pair<int, std::string>> &tweets, std::vector<bool> &results, int maxTweets = 10)
+    {
+        for (const auto &tweet : tweets)
+        {
+            wrote(tweet.first);
+        }
+        bool success = m_spPrimary->AddTweets(tweets, results, maxTweets);
+        for (const auto &tweet : tweets)
+        {
+            wrote(tweet.first);
+        }
+        return success;
+    }
+
+    bool GetRecentTweets(const std::vector<int> &userIdVector, std::vector<std::string> &tweets, int numberOfTweets = -1)
+    {
+        Partition primary, replica;
+        if (!split(userIdVector, primary, replica))
+        {
+            return readerOf(primary).GetRecentTweets(userIdVector, tweets, numberOfTweets);
+        }
+
+        auto spTweets = std::make_shared<std::vector<std::string>>();
+        bool success = GetRecentTweetsAsync(userIdVector, spTweets, numberOfTweets).get();
+        tweets.insert(tweets.end(), std::make_move_iterator(spTweets->begin()), std::make_move_iterator(spTweets->end()));
+        return success;
+    }
+
+    bool GetRecentTweetLists(const std::vector<int> &userIdVector, std::vector<std::vector<std::string>> &tweetLists,
+                             int numberOfTweets = -1)
+    {
+        Partition primary, replica;
+        if (!split(userIdVector, primary, replica))
+        {
+            return readerOf(primary).GetRecentTweetLists(userIdVector, tweetLists, numberOfTweets);
+        }
+
+        auto spTweetLists = std::make_shared<std::vector<std::vector<std::string>>>();
+        bool success = GetRecentTweetListsAsync(userIdVector, spTweetLists, numberOfTweets).get();
+        tweetLists.insert(tweetLists.end(), std::make_move_iterator(spTweetLists->begin()),
+                          std::make_move_iterator(spTweetLists->end()));
+        return success;
+    }
+
+    bool GetFollowees(const int userId, std::vector<int> &followees)
+    {
+        return readerOf(userId).GetFollowees(userId, followees);
+    }
+
+    bool AddFollowee(const int userId, const int followeeId)
+    {
+        wrote(userId);
+        bool success = m_spPrimary->AddFollowee(userId, followeeId);
+        wrote(userId);
+        return success;
+    }
+
+    bool DelFollowee(const int userId, const int followeeId)
+    {
+        wrote(userId);
+        bool success = m_spPrimary->DelFollowee(userId, followeeId);
+        wrote(userId);
+        return success;
+    }
+
+    bool AddFolloweeEdge(const int userId, const int followeeId)
+    {
+        wrote(userId);
+        bool success = m_spPrimary->AddFolloweeEdge(userId, followeeId);
+        wrote(userId);
+        return success;
+    }
+
+    bool AddFollowerEdge(const int userId, const int followeeId)
+    {
+        wrote(followeeId);
+        bool success = m_spPrimary->AddFollowerEdge(userId, followeeId);
+        wrote(followeeId);
+        return success;
+    }
+
+    bool DelFolloweeEdge(const int userId, const int followeeId)
+    {
+        wrote(userId);
+        bool success = m_spPrimary->DelFolloweeEdge(userId, followeeId);
+        wrote(userId);
+        return success;
+    }
+
+    bool DelFollowerEdge(const int userId, const int followeeId)
+    {
+        wrote(followeeId);
+        bool success = m_spPrimary->DelFollowerEdge(userId, followeeId);
+        wrote(followeeId);
+        return success;
+    }
+
+    bool GetFollowers(const int userId, std::vector<int> &followers)
+    {
+        return readerOf(userId).GetFollowers(userId, followers);
+    }
+
+    bool GetFollowerCounts(const std::vector<int> &userIdVector, std::vector<int> &counts)
+    {
+        Partition primary, replica;
+        if (!split(userIdVector, primary, replica))
+        {
+            return readerOf(primary).GetFollowerCounts(userIdVector, counts);
+        }
+
+        auto spCounts = std::make_shared<std::vector<int>>();
+        bool success = GetFollowerCountsAsync(userIdVector, spCounts).get();
+        counts.insert(counts.end(), spCounts->begin(), spCounts->end());
+        return success;
+    }
+
+    bool PushTimelines(const std::vector<int> &userIdVector, const std::string &tweetAsString, int maxTweets = 10)
+    {
+        return m_spPrimary->PushTimelines(userIdVector, tweetAsString, maxTweets);
+    }
+
+    bool GetTimelineTweets(const int userId, std::vector<std::string> &tweets, int numberOfTweets = -1)
+    {
+        return readerOf(userId).GetTimelineTweets(userId, tweets, numberOfTweets);
+    }
+
+    bool ReplaceTimelineTweets(const int userId, const std::vector<std::string> &expectedTweets,
+                               const std::vector<std::string> &tweets, bool &replaced)
+    {
+        wrote(userId);
+        bool success = m_spPrimary->ReplaceTimelineTweets(userId, expectedTweets, tweets, replaced);
+        wrote(userId);
+        return success;
+    }
+
+    pplx::task<int> GetUniqueNumberAsync()
+    {
+        return m_spPrimary->GetUniqueNumberAsync();
+    }
+
+    pplx::task<int> ReserveUniqueNumbersAsync(const int count)
+    {
+        return m_spPrimary->ReserveUniqueNumbersAsync(count);
+    }
+
+    pplx::task<bool> AddTweetAsync(const int userId, const std::string &tweetAsString, int maxTweets = 10)
+    {
+        return wroteWhenDone(userId, m_spPrimary->AddTweetAsync(userId, tweetAsString, maxTweets));
+    }
+
+    pplx::task<bool> AddTweetsAsync(const std::vector<std::pair<int, std::string>> &tweets,
+                                    std::shared_ptr<std::vector<bool>> spResults, int maxTweets = 10)
+    {
+        auto spAuthors = std::make_shared<std::vector<int>>();
+        spAuthors->reserve(tweets.size());
+        for (const auto &tweet : tweets)
+        {
+            spAuthors->push_back(tweet.first);
+            wrote(tweet.first);
+        }
+        return m_spPrimary->AddTweetsAsync(tweets, spResults, maxTweets).then([this, spAuthors](bool success) {
+            for (auto userId : *spAuthors)
+            {
+                wrote(userId);
+            }
+            return success;
+        });
+    }
+
+    pplx::task<bool> GetRecentTweetsAsync(const std::vector<int> &userIdVector, std::shared_ptr<std::vector<std::string>> spTweets,
+                                          int numberOfTweets = -1)
+    {
+        Partition primary, replica;
+        if (!split(userIdVector, primary, replica))
+        {
+            return readerOf(primary).GetRecentTweetsAsync(userIdVector, spTweets, numberOfTweets);
+        }
+
+        auto spTweetLists = std::make_shared<std::vector<std::vector<std::string>>>();
+        return GetRecentTweetListsAsync(userIdVector, spTweetLists, numberOfTweets).then([spTweets, spTweetLists](bool success) {
+            for (auto &tweetList : *spTweetLists)
+            {
+                spTweets->insert(spTweets->end(), std::make_move_iterator(tweetList.begin()),
+                                 std::make_move_iterator(tweetList.end()));
+            }
+            return success;
+        });
+    }
+
+    pplx::task<bool> GetRecentTweetListsAsync(const std::vector<int> &userIdVector,
+                                              std::shared_ptr<std::vector<std::vector<std::string>>> spTweetLists,
+                                              int numberOfTweets = -1)
+    {
+        Partition primary, replica;
+        if (!split(userIdVector, primary, replica))
+        {
+            return readerOf(primary).GetRecentTweetListsAsync(userIdVector, spTweetLists, numberOfTweets);
+        }
+
+        auto spLists = std::make_shared<std::vector<std::vector<std::string>>>(userIdVector.size());
+        auto read = [spLists, numberOfTweets](IDatastore &reader, const Partition &part) {
+            auto spPartLists = std::make_shared<std::vector<std::vector<std::string>>>();
+            return reader.GetRecentTweetListsAsync(part.userIds, spPartLists, numberOfTweets)
+                .then([spLists, spPartLists, positions = part.positions](bool success) {
+                    for (size_t i = 0; i < positions.size() && i < spPartLists->size(); ++i)
+                    {
+                        (*spLists)[positions[i]] = std::move((*spPartLists)[i]);
+                    }
+                    return success;
+                });
+        };
+        return whenBoth(read(*m_spPrimary, primary), read(nextReplica(), replica)).then([spLists, spTweetLists](bool success) {
+            if (success)
+            {
+                spTweetLists->insert(spTweetLists->end(), std::make_move_iterator(spLists->begin()),
+                                     std::make_move_iterator(spLists->end()));
+            }
+            return success;
+        });
+    }
+
+    pplx::task<bool> GetRecentTweetArenaAsync(const std::vector<int> &userIdVector, std::shared_ptr<TweetArena> spArena,
+                                              int numberOfTweets = -1)
+    {
+        Partition primary, replica;
+        if (!split(userIdVector, primary, replica))
+        {
+            return readerOf(primary).GetRecentTweetArenaAsync(userIdVector, spArena, numberOfTweets);
+        }
+
+        // Each part into an arena of its own, copied in order once both are done.
+        auto spPrimaryArena = std::make_shared<TweetArena>();
+        auto spReplicaArena = std::make_shared<TweetArena>();
+        auto spPlaces = std::make_shared<std::vector<std::pair<bool, size_t>>>(userIdVector.size());
+        for (size_t i = 0; i < primary.positions.size(); ++i)
+        {
+            (*spPlaces)[primary.positions[i]] = {true, i};
+        }
+        for (size_t i = 0; i < replica.positions.size(); ++i)
+        {
+            (*spPlaces)[replica.positions[i]] = {false, i};
+        }
+
+        return whenBoth(m_spPrimary->GetRecentTweetArenaAsync(primary.userIds, spPrimaryArena, numberOfTweets),
+                        nextReplica().GetRecentTweetArenaAsync(replica.userIds, spReplicaArena, numberOfTweets))
+            .then([spArena, spPrimaryArena, spReplicaArena, spPlaces](bool success) {
+                if (!success)
+                {
+                    return false;
+                }
+
+                size_t tweets = 0;
+                for (const auto &spPartArena : {spPrimaryArena, spReplicaArena})
+                {
+                    for (size_t list = 0; list < spPartArena->ListCount(); ++list)
+                    {
+                        tweets += spPartArena->ListSize(list);
+                    }
+                }
+                spArena->Reserve(spPrimaryArena->Bytes() + spReplicaArena->Bytes(), tweets, spPlaces->size());
+
+                for (const auto &place : *spPlaces)
+                {
+                    const auto &partArena = place.first ? *spPrimaryArena : *spReplicaArena;
+                    for (size_t position = 0; position < partArena.ListSize(place.second); ++position)
+                    {
+                        spArena->Append(partArena.At(place.second, position));
+                    }
+                    spArena->EndList();
+                }
+                return true;
+            });
+    }
+
+    pplx::task<bool> GetFolloweesAsync(const int userId, std::shared_ptr<std::vector<int>> spFollowees)
+    {
+        return readerOf(userId).GetFolloweesAsync(userId, spFollowees);
+    }
+
+    pplx::task<bool> AddFolloweeAsync(const int userId, const int followeeId)
+    {
+        return wroteWhenDone(userId, m_spPrimary->AddFolloweeAsync(userId, followeeId));
+    }
+
+    pplx::task<bool> DelFolloweeAsync(const int userId, const int followeeId)
+    {
+        return wroteWhenDone(userId, m_spPrimary->DelFolloweeAsync(userId, followeeId));
+    }
+
+    pplx::task<bool> AddFolloweeEdgeAsync(const int userId, const int followeeId)
+    {
+        return wroteWhenDone(userId, m_spPrimary->AddFolloweeEdgeAsync(userId, followeeId));
+    }
+
+    pplx::task<bool> AddFollowerEdgeAsync(const int userId, const int followeeId)
+    {
+        return wroteWhenDone(followeeId, m_spPrimary->AddFollowerEdgeAsync(userId, followeeId));
+    }
+
+    pplx::task<bool> DelFolloweeEdgeAsync(const int userId, const int followeeId)
+    {
+        return wroteWhenDone(userId, m_spPrimary->DelFolloweeEdgeAsync(userId, followeeId));
+    }
+
+    pplx::task<bool> DelFollowerEdgeAsync(const int userId, const int followeeId)
+    {
+        return wroteWhenDone(followeeId, m_spPrimary->DelFollowerEdgeAsync(userId, followeeId));
+    }
+
+    pplx::task<bool> GetFollowersAsync(const int userId, std::shared_ptr<std::vector<int>> spFollowers)
+    {
+        return readerOf(userId).GetFollowersAsync(userId, spFollowers);
+    }
+
+    pplx::task<bool> GetFollowerCountsAsync(const std::vector<int> &userIdVector, std::shared_ptr<std::vector<int>> spCounts)
+    {
+        Partition primary, replica;
+        if (!split(userIdVector, primary, replica))
+        {
+            return readerOf(primary).GetFollowerCountsAsync(userIdVector, spCounts);
+        }
+
+        auto spAllCounts = std::make_shared<std::vector<int>>(userIdVector.size(), 0);
+        auto read = [spAllCounts](IDatastore &reader, const Partition &part) {
+            auto spPartCounts = std::make_shared<std::vector<int>>();
+            return reader.GetFollowerCountsAsync(part.userIds, spPartCounts)
+                .then([spAllCounts, spPartCounts, positions = part.positions](bool success) {
+                    for (size_t i = 0; i < positions.size() && i < spPartCounts->size(); ++i)
+                    {
+                        (*spAllCounts)[positions[i]] = (*spPartCounts)[i];
+                    }
+                    return success;
+                });
+        };
+        return whenBoth(read(*m_spPrimary, primary), read(nextReplica(), replica)).then([spAllCounts, spCounts](bool success) {
+            if (success)
+            {
+                spCounts->insert(spCounts->end(), spAllCounts->begin(), spAllCounts->end());
+            }
+            return success;
+        });
+    }
+
+    pplx::task<bool> PushTimelinesAsync(const std::vector<int> &userIdVector, const std::string &tweetAsString, int maxTweets = 10)
+    {
+        return m_spPrimary->PushTimelinesAsync(userIdVector, tweetAsString, maxTweets);
+    }
+
+    pplx::task<bool> GetTimelineTweetsAsync(const int userId, std::shared_ptr<std::vector<std::string>> spTweets, int numberOfTweets = -1)
+    {
+        return readerOf(userId).GetTimelineTweetsAsync(userId, spTweets, numberOfTweets);
+    }
+
+    pplx::task<bool> ReplaceTimelineTweetsAsync(const int userId, const std::vector<std::string> &expectedTweets,
+                                                const std::vector<std::string> &tweets, std::shared_ptr<bool> spReplaced)
+    {
+        return wroteWhenDone(userId, m_spPrimary->ReplaceTimelineTweetsAsync(userId, expectedTweets, tweets, spReplaced));
+    }
+
+    bool HasServerSideMerge() const
+    {
+        return m_spPrimary->HasServerSideMerge();
+    }
+
+    pplx::task<bool> GetMergedTimelineAsync(const int userId, std::shared_ptr<std::vector<std::string>> spTweets,
+                                            int maxTweets = 10)
+    {
+        return readerOf(userId).GetMergedTimelineAsync(userId, spTweets, maxTweets);
+    }
+};
+
+#endif
@@ -0,0 +1,297 @@
+/**
+ * @file      RequestTrace.h
+ * @author    Atakan S.
+ * @version   1.0
+ * @brief     Per-request span tracing with monotonic timestamps.
+ *
+ * @copyright Copyright (c) 2020 Atakan SARIOGLU ~ www.atakansarioglu.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _H_REQUESTTRACE_H_
+#define _H_REQUESTTRACE_H_
+
+#include <pplx/pplxtasks.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+
+/*
+ * @brief Context of one request that collects the time spent in each stage, e.g. a datastore
+ *        round-trip or the response creation. Stages of a request may run on different threads,
+ *        a span is added with one atomic increment and no allocation.
+ */
+class RequestTrace
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Max number of spans of a request, later ones are dropped.
+    static constexpr size_t MAX_SPANS = 16;
+
+    // Stage of a request, relative to the start of the request.
+    struct Span
+    {
+        const char *name;
+        uint32_t startMicros;
+        uint32_t durationMicros;
+    };
+
+    /*
+     * @brief Makes a trace the current one of the calling thread, for the code that is
+     *        called synchronously but does not take the trace, e.g. a datastore.
+     */
+    class Scope
+    {
+    private:
+        RequestTrace *m_pPrevious;
+
+    public:
+        Scope(RequestTrace *pTrace) : m_pPrevious(current())
+        {
+            current() = pTrace;
+        }
+
+        ~Scope()
+        {
+            current() = m_pPrevious;
+        }
+    };
+
+private:
+    // Request name, a string literal.
+    const char *m_name;
+
+    // Start of the request.
+    Clock::time_point m_start;
+
+    // Spans in the order their slots were claimed, each published by its ready flag,
+    // so stages completing after the reply do not race with reading the trace.
+    std::array<Span, MAX_SPANS> m_spans;
+    std::array<std::atomic<bool>, MAX_SPANS> m_ready;
+    std::atomic<size_t> m_spanCount;
+
+    /*
+     * @brief Current trace of the calling thread.
+     * @return Reference to the pointer, nullptr if none.
+     */
+    static RequestTrace *&current()
+    {
+        thread_local RequestTrace *pCurrent = nullptr;
+        return pCurrent;
+    }
+
+    /*
+     * @brief Microseconds between two points in time.
+     * @param from Earlier time.
+     * @param to Later time.
+     * @return Elapsed time, clamped to 32 bits.
+     */
+    static uint32_t microsBetween(const Clock::time_point from, const Clock::time_point to)
+    {
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(to - from).count();
+        return static_cast<uint32_t>(micros < 0 ? 0 : (micros > UINT32_MAX ? UINT32_MAX : micros));
+    }
+
+public:
+    /*
+     * @brief Constructor, starts the request.
+     * @param name Request name, a string literal.
+     */
+    RequestTrace(const char *name) : m_name(name), m_start(Clock::now()), m_spanCount(0)
+    {
+        for (auto &ready : m_ready)
+        {
+            ready.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    /*
+     * @brief Getter for the request name.
+     * @return Name
+     */
+    const char *GetName() const
+    {
+        return m_name;
+    }
+
+    /*
+     * @brief Time since the start of the request.
+     * @return Microseconds
+     */
+    uint32_t ElapsedMicros() const
+    {
+        return microsBetween(m_start, Clock::now());
+    }
+
+    /*
+     * @brief Add a completed stage.
+     * @param name Stage name, a string literal.
+     * @param start Start of the stage.
+     * @param end End of the stage.
+     */
+    void Add(const char *name, const Clock::time_point start, const Clock::time_point end = Clock::now())
+    {
+        size_t index = m_spanCount.fetch_add(1, std::memory_order_relaxed);
+        if (index < MAX_SPANS)
+        {
+            m_spans[index] = Span{name, microsBetween(m_start, start), microsBetween(start, end)};
+            m_ready[index].store(true, std::memory_order_release);
+        }
+    }
+
+    /*
+     * @brief Number of completed spans, up to the first one still being added.
+     * @return Spans
+     */
+    size_t SpanCount() const
+    {
+        size_t count = 0;
+        while (count < MAX_SPANS && m_ready[count].load(std::memory_order_acquire))
+        {
+            ++count;
+        }
+        return count;
+    }
+
+    /*
+     * @brief Getter for a span.
+     * @param index Index of the span, below a value returned by SpanCount.
+     * @return Span
+     */
+    const Span &GetSpan(const size_t index) const
+    {
+        return m_spans[index];
+    }
+
+    /*
+     * @brief Value of the Server-Timing header, the durations of the spans with the same
+     *        name are added, followed by the total so far.
+     * @return Header value, e.g. "followees;dur=0.412, tweets;dur=1.203, total;dur=1.9".
+     */
+    std::string ServerTiming() const
+    {
+        std::array<uint64_t, MAX_SPANS> durations{};
+        std::array<const char *, MAX_SPANS> names{};
+        size_t nameCount = 0;
+        size_t spanCount = SpanCount();
+        for (size_t i = 0; i < spanCount; ++i)
+        {
+            size_t j = 0;
+            while (j < nameCount && std::strcmp(names[j], m_spans[i].name) != 0)
+            {
+                ++j;
+            }
+            if (j == nameCount)
+            {
+                names[nameCount++] = m_spans[i].name;
+            }
+            durations[j] += m_spans[i].durationMicros;
+        }
+
+        // Durations in milliseconds with microsecond resolution.
+        char duration[32];
+        std::string header;
+        for (size_t j = 0; j < nameCount; ++j)
+        {
+            std::snprintf(duration, sizeof(duration), ";dur=%.3f, ", durations[j] / 1000.0);
+            header.append(names[j]).append(duration);
+        }
+        std::snprintf(duration, sizeof(duration), ";dur=%.3f", ElapsedMicros() / 1000.0);
+        header.append("total").append(duration);
+        return header;
+    }
+
+    /*
+     * @brief Current trace of the calling thread, set by a Scope.
+     *        Valid until the traced task completes.
+     * @return Trace, nullptr if none.
+     */
+    static RequestTrace *Current()
+    {
+        return current();
+    }
+
+    /*
+     * @brief Measure a synchronous stage.
+     * @param spTrace Trace of the request, nullptr to not measure.
+     * @param name Stage name, a string literal.
+     * @param call Stage to run.
+     * @return Result of the call.
+     */
+    template <typename Call>
+    static auto Measure(const std::shared_ptr<RequestTrace> &spTrace, const char *name, const Call &call) -> decltype(call())
+    {
+        if (!spTrace)
+        {
+            return call();
+        }
+
+        struct Finish
+        {
+            RequestTrace *pTrace;
+            const char *name;
+            Clock::time_point start;
+            ~Finish()
+            {
+                pTrace->Add(name, start);
+            }
+        } finish{spTrace.get(), name, Clock::now()};
+        Scope scope(spTrace.get());
+        return call();
+    }
+
+    /*
+     * @brief Measure an asynchronous stage until its task completes. The trace is the current
+     *        one while the call starts the task.
+     * @param spTrace Trace of the request, nullptr to not measure.
+     * @param name Stage name, a string literal.
+     * @param call Starts the stage, returns its task.
+     * @return Task of the stage.
+     */
+    template <typename Call>
+    static auto MeasureAsync(const std::shared_ptr<RequestTrace> &spTrace, const char *name, const Call &call) -> decltype(call())
+    {
+        if (!spTrace)
+        {
+            return call();
+        }
+
+        using Task = decltype(call());
+        auto start = Clock::now();
+        Task task;
+        {
+            Scope scope(spTrace.get());
+            task = call();
+        }
+        return task.then([spTrace, name, start](Task stageTask) {
+            spTrace->Add(name, start);
+            return stageTask.get();
+        });
+    }
+};
+
+#endif
@@ -0,0 +1,756 @@
+/**
+ * @file      ShardedDatastore.h
+ * @author    Atakan S.
+ * @version   1.0
+ * @brief     Datastore partitioned across several shards by user.
+ *
+ * @copyright Copyright (c) 2020 Atakan SARIOGLU ~ www.atakansarioglu.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _H_SHARDEDDATASTORE_H_
+#define _H_SHARDEDDATASTORE_H_
+
+#include "IDatastore.h"
+#include "ConsistentHashRing.h"
+#include "TweetArena.h"
+#include <pplx/pplxtasks.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * @brief Spreads the records of the users over several datastores, e.g. one RedisDatastore
+ *        per Redis node, by consistent hashing of the user ID. The tweets, followees,
+ *        followers and timeline of a user live on the shard of the user. A call for several
+ *        users sends one batch to each shard involved, the batches run in parallel.
+ *        A follow is written to the shards of both users, so each has the side it owns.
+ *        The unique numbers come from the first shard.
+ */
+class ShardedDatastore : public IDatastore
+{
+private:
+    // Datastore of each shard.
+    std::vector<std::shared_ptr<IDatastore>> m_shards;
+
+    // Placement of the users.
+    ConsistentHashRing m_ring;
+
+    // Users of a shard and their positions in the request.
+    struct Partition
+    {
+        std::vector<int> userIds;
+        std::vector<size_t> positions;
+    };
+
+    /*
+     * @brief Datastore of the shard of a user.
+     * @param userId User
+     * @return Shard datastore.
+     */
+    IDatastore &shardOf(const int userId) const
+    {
+        return *m_shards[m_ring.ShardOf(userId)];
+    }
+
+    /*
+     * @brief Split users by shard.
+     * @param userIdVector Users
+     * @return One partition per shard, empty for the uninvolved ones.
+     */
+    std::vector<Partition> partition(const std::vector<int> &userIdVector) const
+    {
+        std::vector<Partition> partitions(m_shards.size());
+        for (size_t i = 0; i < userIdVector.size(); ++i)
+        {
+            auto &part = partitions[m_ring.ShardOf(userIdVector[i])];
+            part.userIds.push_back(userIdVector[i]);
+            part.positions.push_back(i);
+        }
+        return partitions;
+    }
+
+    /*
+     * @brief Start a batch on each involved shard, all in parallel.
+     * @param partitions Users of each shard.
+     * @param call Starts the batch of a shard, called with the shard index and its partition.
+     * @return Task, true if all batches succeeded.
+     */
+    template <typename Call>
+    static pplx::task<bool> forEachShard(const std::vector<Partition> &partitions, const Call &call)
+    {
+        std::vector<pplx::task<bool>> tasks;
+        for (size_t shard = 0; shard < partitions.size(); ++shard)
+        {
+            if (!partitions[shard].positions.empty())
+            {
+                tasks.push_back(call(shard, partitions[shard]));
+            }
+        }
+        if (tasks.empty())
+        {
+            return pplx::task_from_result(true);
+        }
+        if (tasks.size() == 1)
+        {
+            return tasks.front();
+        }
+        return pplx::when_all(tasks.begin(), tasks.end()).then([](std::vector<bool> results) {
+            return std::find(results.begin(), results.end(), false) == results.end();
+        });
+    }
+
+public:
+    /*
+     * @brief Constructor of the sharded datastore.
+     * @param shards Datastore of each shard.
+     * @param shardNames Unique name of each shard, e.g. its address, which places it on the ring.
+     */
+    ShardedDatastore(const std::vector<std::shared_ptr<IDatastore>> &shards, const std::vector<std::string> &shardNames)
+        : m_shards(shards), m_ring(shardNames) {}
+
+    /*
+     * @brief Connect the shards that are not connected.
+     * @return True if at least one shard is connected, the calls for the others fail on their own.
+     */
+    bool Connect()
+    {
+        bool connected = false;
+        for (auto &spShard : m_shards)
+        {
+            connected = (spShard->IsConnected() || spShard->Connect()) || connected;
+        }
+        return connected;
+    }
+
+    /*
+     * @brief Disconnect all shards.
+     * @return True on success.
+     */
+    bool Disconnect()
+    {
+        bool disconnected = true;
+        for (auto &spShard : m_shards)
+        {
+            disconnected = spShard->Disconnect() && disconnected;
+        }
+        return disconnected;
+    }
+
+    /*
+     * @brief Get connection state. A down shard only fails the calls for its own users.
+     * @return True if at least one shard is connected.
+     */
+    bool IsConnected() const
+    {
+        for (const auto &spShard : m_shards)
+        {
+            if (spShard->IsConnected())
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*
+     * @brief Get a unique number from the first shard.
+     * @return Unique number, -1 on failure.
+     */
+    int GetUniqueNumber()
+    {
+        return m_shards.front()->GetUniqueNumber();
+    }
+
+    /*
+     * @brief Reserve a block of unique numbers on the first shard.
+     * @param count Number of unique numbers.
+     * @return Last number of the block, -1 on failure.
+     */
+    int ReserveUniqueNumbers(const int count)
+    {
+        return m_shards.front()->ReserveUniqueNumbers(count);
+    }
+
+    /*
+     * @brief Add tweet on the shard of the author.
+     * @param userId Author
+     * @param tweetAsString Serialized tweet.
+     * @param maxTweets Keep no more than this number on datastore.
+     * @return True on success.
+     */
+    bool AddTweet(const int userId, const std::string &tweetAsString, int maxTweets = 10)
+    {
+        return shardOf(userId).AddTweet(userId, tweetAsString, maxTweets);
+    }
+
+    /*
+     * @brief Add several tweets, one batch per shard.
+     * @param tweets Author and serialized tweet of each tweet.
+     * @param results Output vector, true for each stored tweet.
+     * @param maxTweets Keep no more than this number on datastore.
+     * @return True if all tweets are stored.
+     */
+    bool AddTweets(const std::vector<std::pair<int, std::string>> &tweets, std::vector<bool> &results, int maxTweets = 10)
+    {
+        auto spResults = std::make_shared<std::vector<bool>>();
+        bool success = AddTweetsAsync(tweets, spResults, maxTweets).get();
+        results = std::move(*spResults);
+        return success;
+    }
+
+    /*
+     * @brief Get the recent tweets of several users, one batch per shard.
+     * @param userIdVector Users
+     * @param tweets Output vector, the tweets of the users one after the other.
+     * @param numberOfTweets Number of tweets for each user, -1 for all tweets.
+     * @return True on success.
+     */
+    bool GetRecentTweets(const std::vector<int> &userIdVector, std::vector<std::string> &tweets, int numberOfTweets = -1)
+    {
+        auto spTweets = std::make_shared<std::vector<std::string>>();
+        bool success = GetRecentTweetsAsync(userIdVector, spTweets, numberOfTweets).get();
+        tweets.insert(tweets.end(), std::make_move_iterator(spTweets->begin()), std::make_move_iterator(spTweets->end()));
+        return success;
+    }
+
+    /*
+     * @brief Get the recent tweets of several users as separate lists, one batch per shard.
+     * @param userIdVector Users
+     * @param tweetLists Output, one list per user in the same order.
+     * @param numberOfTweets Number of tweets for each user, -1 for all tweets.
+     * @return True on success.
+     */
+    bool GetRecentTweetLists(const std::vector<int> &userIdVector, std::vector<std::vector<std::string>> &tweetLists,
+                             int numberOfTweets = -1)
+    {
+        auto spTweetLists = std::make_shared<std::vector<std::vector<std::string>>>();
+        bool success = GetRecentTweetListsAsync(userIdVector, spTweetLists, numberOfTweets).get();
+        tweetLists.insert(tweetLists.end(), std::make_move_iterator(spTweetLists->begin()),
+                          std::make_move_iterator(spTweetLists->end()));
+        return success;
+    }
+
+    /*
+     * @brief Get the followees from the shard of the user.
+     * @param userId User
+     * @param followees Output vector.
+     * @return True on success.
+     */
+    bool GetFollowees(const int userId, std::vector<int> &followees)
+    {
+        return shardOf(userId).GetFollowees(userId, followees);
+    }
+
+    /*
+     * @brief Follow, written to the shards of both users.
+     * @param userId Follower
+     * @param followeeId Followee
+     * @return True on success.
+     */
+    bool AddFollowee(const int userId, const int followeeId)
+    {
+        return AddFolloweeAsync(userId, followeeId).get();
+    }
+
+    /*
+     * @brief Unfollow, written to the shards of both users.
+     * @param userId Follower
+     * @param followeeId Followee
+     * @return True on success.
+     */
+    bool DelFollowee(const int userId, const int followeeId)
+    {
+        return DelFolloweeAsync(userId, followeeId).get();
+    }
+
+    /*
+     * @brief Add the followee to the followees of the follower, on the shard of the follower.
+     * @param userId Follower
+     * @param followeeId Followee
+     * @return True on success.
+     */
+    bool AddFolloweeEdge(const int userId, const int followeeId)
+    {
+        return shardOf(userId).AddFolloweeEdge(userId, followeeId);
+    }
+
+    /*
+     * @brief Add the follower to the followers of the followee, on the shard of the followee.
+     * @param userId Follower
+     * @param followeeId Followee
+     * @return True on success.
+     */
+    bool AddFollowerEdge(const int userId, const int followeeId)
+    {
+        return shardOf(followeeId).AddFollowerEdge(userId, followeeId);
+    }
+
+    /*
+     * @brief Remove the followee from the followees of the follower, on the shard of the follower.
+     * @param userId Follower
+     * @param followeeId Followee
+     * @return True on success.
+     */
+    bool DelFolloweeEdge(const int userId, const int followeeId)
+    {
+        return shardOf(userId).DelFolloweeEdge(userId, followeeId);
+    }
+
+    /*
+     * @brief Remove the follower from the followers of the followee, on the shard of the followee.
+     * @param userId Follower
+     * @param followeeId Followee
+     * @return True on success.
+     */
+    bool DelFollowerEdge(const int userId, const int followeeId)
+    {
+        return shardOf(followeeId).DelFollowerEdge(userId, followeeId);
+    }
+
+    /*
+     * @brief Get the followers from the shard of the user.
+     * @param userId User
+     * @param followers Output vector.
+     * @return True on success.
+     */
+    bool GetFollowers(const int userId, std::vector<int> &followers)
+    {
+        return shardOf(userId).GetFollowers(userId, followers);
+    }
+
+    /*
+     * @brief Get the follower counts of several users, one batch per shard.
+     * @param userIdVector Users
+     * @param counts Output vector, one count per user in the same order.
+     * @return True on success.
+     */
+    bool GetFollowerCounts(const std::vector<int> &userIdVector, std::vector<int> &counts)
+    {
+        auto spCounts = std::make_shared<std::vector<int>>();
+        bool success = GetFollowerCountsAsync(userIdVector, spCounts).get();
+        counts.insert(counts.end(), spCounts->begin(), spCounts->end());
+        return success;
+    }
+
+    /*
+     * @brief Push a tweet into the timelines of several users, one batch per shard.
+     * @param userIdVector Owners of the timelines.
+     * @param tweetAsString Serialized tweet.
+     * @param maxTweets Length of the timelines.
+     * @return True on success.
+     */
+    bool PushTimelines(const std::vector<int> &userIdVector, const std::string &tweetAsString, int maxTweets = 10)
+    {
+        return PushTimelinesAsync(userIdVector, tweetAsString, maxTweets).get();
+    }
+
+    /*
+     * @brief Get the timeline from the shard of the user.
+     * @param userId User
+     * @param tweets Output vector, most recent first.
+     * @param numberOfTweets Number of tweets, -1 for all.
+     * @return True on success.
+     */
+    bool GetTimelineTweets(const int userId, std::vector<std::string> &tweets, int numberOfTweets = -1)
+    {
+        return shardOf(userId).GetTimelineTweets(userId, tweets, numberOfTweets);
+    }
+
+    /*
+     * @brief Replace the timeline on the shard of the user if its head is still the expected one.
+     * @param userId User
+     * @param expectedTweets Head of the timeline as read before.
+     * @param tweets Serialized tweets, most recent first.
+     * @param replaced Output, false if a push changed the timeline since the read.
+     * @return True on success.
+     */
+    bool ReplaceTimelineTweets(const int userId, const std::vector<std::string> &expectedTweets,
+                               const std::vector<std::string> &tweets, bool &replaced)
+    {
+        return shardOf(userId).ReplaceTimelineTweets(userId, expectedTweets, tweets, replaced);
+    }
+
+    /*
+     * @brief Asynchronous GetUniqueNumber.
+     * @return Task, unique number, -1 on failure.
+     */
+    pplx::task<int> GetUniqueNumberAsync()
+    {
+        return m_shards.front()->GetUniqueNumberAsync();
+    }
+
+    /*
+     * @brief Asynchronous ReserveUniqueNumbers.
+     * @param count Number of unique numbers.
+     * @return Task, last number of the block, -1 on failure.
+     */
+    pplx::task<int> ReserveUniqueNumbersAsync(const int count)
+    {
+        return m_shards.front()->ReserveUniqueNumbersAsync(count);
+    }
+
+    /*
+     * @brief Asynchronous AddTweet.
+     * @param userId Author
+     * @param tweetAsString Serialized tweet.
+     * @param maxTweets Keep no more than this number on datastore.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> AddTweetAsync(const int userId, const std::string &tweetAsString, int maxTweets = 10)
+    {
+        return shardOf(userId).AddTweetAsync(userId, tweetAsString, maxTweets);
+    }
+
+    /*
+     * @brief Asynchronous AddTweets, one pipeline per shard in parallel.
+     * @param tweets Author and serialized tweet of each tweet, pushed in order per author.
+     * @param spResults Output vector, true for each stored tweet.
+     * @param maxTweets Keep no more than this number on datastore.
+     * @return Task, true if all tweets are stored.
+     */
+    pplx::task<bool> AddTweetsAsync(const std::vector<std::pair<int, std::string>> &tweets,
+                                    std::shared_ptr<std::vector<bool>> spResults, int maxTweets = 10)
+    {
+        spResults->assign(tweets.size(), false);
+        std::vector<int> authors;
+        authors.reserve(tweets.size());
+        for (const auto &tweet : tweets)
+        {
+            authors.push_back(tweet.first);
+        }
+
+        return forEachShard(partition(authors), [this, &tweets, spResults, maxTweets](size_t shard, const Partition &part) {
+            std::vector<std::pair<int, std::string>> shardTweets;
+            shardTweets.reserve(part.positions.size());
+            for (auto position : part.positions)
+            {
+                shardTweets.push_back(tweets[position]);
+            }
+
+            auto spShardResults = std::make_shared<std::vector<bool>>();
+            return m_shards[shard]->AddTweetsAsync(shardTweets, spShardResults, maxTweets)
+                .then([spResults, spShardResults, positions = part.positions](bool success) {
+                    for (size_t i = 0; i < positions.size() && i < spShardResults->size(); ++i)
+                    {
+                        (*spResults)[positions[i]] = (*spShardResults)[i];
+                    }
+                    return success;
+                });
+        });
+    }
+
+    /*
+     * @brief Asynchronous GetRecentTweets, one pipeline per shard in parallel.
+     * @param userIdVector Users
+     * @param spTweets Output vector, the tweets of the users one after the other.
+     * @param numberOfTweets Number of tweets for each user, -1 for all tweets.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> GetRecentTweetsAsync(const std::vector<int> &userIdVector, std::shared_ptr<std::vector<std::string>> spTweets,
+                                          int numberOfTweets = -1)
+    {
+        auto spTweetLists = std::make_shared<std::vector<std::vector<std::string>>>();
+        return GetRecentTweetListsAsync(userIdVector, spTweetLists, numberOfTweets).then([spTweets, spTweetLists](bool success) {
+            for (auto &tweetList : *spTweetLists)
+            {
+                spTweets->insert(spTweets->end(), std::make_move_iterator(tweetList.begin()),
+                                 std::make_move_iterator(tweetList.end()));
+            }
+            return success;
+        });
+    }
+
+    /*
+     * @brief Asynchronous GetRecentTweetLists, one pipeline per shard in parallel.
+     * @param userIdVector Users
+     * @param spTweetLists Output, one list per user in the same order.
+     * @param numberOfTweets Number of tweets for each user, -1 for all tweets.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> GetRecentTweetListsAsync(const std::vector<int> &userIdVector,
+                                              std::shared_ptr<std::vector<std::vector<std::string>>> spTweetLists,
+                                              int numberOfTweets = -1)
+    {
+        auto spLists = std::make_shared<std::vector<std::vector<std::string>>>(userIdVector.size());
+        return forEachShard(partition(userIdVector), [this, spLists, numberOfTweets](size_t shard, const Partition &part) {
+            auto spShardLists = std::make_shared<std::vector<std::vector<std::string>>>();
+            return m_shards[shard]->GetRecentTweetListsAsync(part.userIds, spShardLists, numberOfTweets)
+                .then([spLists, spShardLists, positions = part.positions](bool success) {
+                    for (size_t i = 0; i < positions.size() && i < spShardLists->size(); ++i)
+                    {
+                        (*spLists)[positions[i]] = std::move((*spShardLists)[i]);
+                    }
+                    return success;
+                });
+        }).then([spLists, spTweetLists](bool success) {
+            if (success)
+            {
+                spTweetLists->insert(spTweetLists->end(), std::make_move_iterator(spLists->begin()),
+                                     std::make_move_iterator(spLists->end()));
+            }
+            return success;
+        });
+    }
+
+    /*
+     * @brief Asynchronous GetRecentTweetLists into a per-request arena, one pipeline per shard
+     *        in parallel, each into an arena of its own that is copied in order once all are done.
+     * @param userIdVector Users
+     * @param spArena Output arena, gets one list per user in the same order.
+     * @param numberOfTweets Number of tweets for each user, -1 for all tweets.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> GetRecentTweetArenaAsync(const std::vector<int> &userIdVector, std::shared_ptr<TweetArena> spArena,
+                                              int numberOfTweets = -1)
+    {
+        auto partitions = partition(userIdVector);
+        auto spShardArenas = std::make_shared<std::vector<std::shared_ptr<TweetArena>>>(m_shards.size());
+
+        // List of each user in the shard arenas, shard and index.
+        auto spPlaces = std::make_shared<std::vector<std::pair<size_t, size_t>>>(userIdVector.size());
+        for (size_t shard = 0; shard < partitions.size(); ++shard)
+        {
+            for (size_t i = 0; i < partitions[shard].positions.size(); ++i)
+            {
+                (*spPlaces)[partitions[shard].positions[i]] = {shard, i};
+            }
+        }
+
+        return forEachShard(partitions, [this, spShardArenas, numberOfTweets](size_t shard, const Partition &part) {
+            (*spShardArenas)[shard] = std::make_shared<TweetArena>();
+            return m_shards[shard]->GetRecentTweetArenaAsync(part.userIds, (*spShardArenas)[shard], numberOfTweets);
+        }).then([spArena, spShardArenas, spPlaces](bool success) {
+            if (!success)
+            {
+                return false;
+            }
+
+            size_t bytes = 0, tweets = 0;
+            for (const auto &spShardArena : *spShardArenas)
+            {
+                if (spShardArena)
+                {
+                    bytes += spShardArena->Bytes();
+                    for (size_t list = 0; list < spShardArena->ListCount(); ++list)
+                    {
+                        tweets += spShardArena->ListSize(list);
+                    }
+                }
+            }
+            spArena->Reserve(bytes, tweets, spPlaces->size());
+
+            for (const auto &place : *spPlaces)
+            {
+                const auto &shardArena = *(*spShardArenas)[place.first];
+                for (size_t position = 0; position < shardArena.ListSize(place.second); ++position)
+                {
+                    spArena->Append(shardArena.At(place.second, position));
+                }
+                spArena->EndList();
+            }
+            return true;
+        });
+    }
+
+    /*
+     * @brief Asynchronous GetFollowees.
+     * @param userId User
+     * @param spFollowees Output vector.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> GetFolloweesAsync(const int userId, std::shared_ptr<std::vector<int>> spFollowees)
+    {
+        return shardOf(userId).GetFolloweesAsync(userId, spFollowees);
+    }
+
+    /*
+     * @brief Asynchronous AddFollowee, the shards of both users in parallel.
+     * @param userId Follower
+     * @param followeeId Followee
+     * @return Task, true on success.
+     */
+    pplx::task<bool> AddFolloweeAsync(const int userId, const int followeeId)
+    {
+        auto &followerShard = shardOf(userId);
+        auto &followeeShard = shardOf(followeeId);
+        if (&followerShard == &followeeShard)
+        {
+            return followerShard.AddFolloweeAsync(userId, followeeId);
+        }
+
+        // Each shard keeps its own side of the follow.
+        std::vector<pplx::task<bool>> tasks = {followerShard.AddFolloweeEdgeAsync(userId, followeeId),
+                                               followeeShard.AddFollowerEdgeAsync(userId, followeeId)};
+        return pplx::when_all(tasks.begin(), tasks.end()).then([](std::vector<bool> results) {
+            return results[0] && results[1];
+        });
+    }
+
+    /*
+     * @brief Asynchronous DelFollowee, the shards of both users in parallel.
+     * @param userId Follower
+     * @param followeeId Followee
+     * @return Task, true on success.
+     */
+    pplx::task<bool> DelFolloweeAsync(const int userId, const int followeeId)
+    {
+        auto &followerShard = shardOf(userId);
+        auto &followeeShard = shardOf(followeeId);
+        if (&followerShard == &followeeShard)
+        {
+            return followerShard.DelFolloweeAsync(userId, followeeId);
+        }
+
+        // Each shard keeps its own side of the follow.
+        std::vector<pplx::task<bool>> tasks = {followerShard.DelFolloweeEdgeAsync(userId, followeeId),
+                                               followeeShard.DelFollowerEdgeAsync(userId, followeeId)};
+        return pplx::when_all(tasks.begin(), tasks.end()).then([](std::vector<bool> results) {
+            return results[0] && results[1];
+        });
+    }
+
+    /*
+     * @brief Asynchronous AddFolloweeEdge.
+     * @param userId Follower
+     * @param followeeId Followee
+     * @return Task, true on success.
+     */
+    pplx::task<bool> AddFolloweeEdgeAsync(const int userId, const int followeeId)
+    {
+        return shardOf(userId).AddFolloweeEdgeAsync(userId, followeeId);
+    }
+
+    /*
+     * @brief Asynchronous AddFollowerEdge.
+     * @param userId Follower
+     * @param followeeId Followee
+     * @return Task, true on success.
+     */
+    pplx::task<bool> AddFollowerEdgeAsync(const int userId, const int followeeId)
+    {
+        return shardOf(followeeId).AddFollowerEdgeAsync(userId, followeeId);
+    }
+
+    /*
+     * @brief Asynchronous DelFolloweeEdge.
+     * @param userId Follower
+     * @param followeeId Followee
+     * @return Task, true on success.
+     */
+    pplx::task<bool> DelFolloweeEdgeAsync(const int userId, const int followeeId)
+    {
+        return shardOf(userId).DelFolloweeEdgeAsync(userId, followeeId);
+    }
+
+    /*
+     * @brief Asynchronous DelFollowerEdge.
+     * @param userId Follower
+     * @param followeeId Followee
+     * @return Task, true on success.
+     */
+    pplx::task<bool> DelFollowerEdgeAsync(const int userId, const int followeeId)
+    {
+        return shardOf(followeeId).DelFollowerEdgeAsync(userId, followeeId);
+    }
+
+    /*
+     * @brief Asynchronous GetFollowers.
+     * @param userId User
+     * @param spFollowers Output vector.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> GetFollowersAsync(const int userId, std::shared_ptr<std::vector<int>> spFollowers)
+    {
+        return shardOf(userId).GetFollowersAsync(userId, spFollowers);
+    }
+
+    /*
+     * @brief Asynchronous GetFollowerCounts, one pipeline per shard in parallel.
+     * @param userIdVector Users
+     * @param spCounts Output vector, one count per user in the same order.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> GetFollowerCountsAsync(const std::vector<int> &userIdVector, std::shared_ptr<std::vector<int>> spCounts)
+    {
+        auto spAllCounts = std::make_shared<std::vector<int>>(userIdVector.size(), 0);
+        return forEachShard(partition(userIdVector), [this, spAllCounts](size_t shard, const Partition &part) {
+            auto spShardCounts = std::make_shared<std::vector<int>>();
+            return m_shards[shard]->GetFollowerCountsAsync(part.userIds, spShardCounts)
+                .then([spAllCounts, spShardCounts, positions = part.positions](bool success) {
+                    for (size_t i = 0; i < positions.size() && i < spShardCounts->size(); ++i)
+                    {
+                        (*spAllCounts)[positions[i]] = (*spShardCounts)[i];
+                    }
+                    return success;
+                });
+        }).then([spAllCounts, spCounts](bool success) {
+            if (success)
+            {
+                spCounts->insert(spCounts->end(), spAllCounts->begin(), spAllCounts->end());
+            }
+            return success;
+        });
+    }
+
+    /*
+     * @brief Asynchronous PushTimelines, one pipeline per shard in parallel.
+     * @param userIdVector Owners of the timelines.
+     * @param tweetAsString Serialized tweet.
+     * @param maxTweets Length of the timelines.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> PushTimelinesAsync(const std::vector<int> &userIdVector, const std::string &tweetAsString, int maxTweets = 10)
+    {
+        return forEachShard(partition(userIdVector), [this, &tweetAsString, maxTweets](size_t shard, const Partition &part) {
+            return m_shards[shard]->PushTimelinesAsync(part.userIds, tweetAsString, maxTweets);
+        });
+    }
+
+    /*
+     * @brief Asynchronous GetTimelineTweets.
+     * @param userId User
+     * @param spTweets Output vector, most recent first.
+     * @param numberOfTweets Number of tweets, -1 for all.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> GetTimelineTweetsAsync(const int userId, std::shared_ptr<std::vector<std::string>> spTweets, int numberOfTweets = -1)
+    {
+        return shardOf(userId).GetTimelineTweetsAsync(userId, spTweets, numberOfTweets);
+    }
+
+    /*
+     * @brief Asynchronous ReplaceTimelineTweets.
+     * @param userId User
+     * @param expectedTweets Head of the timeline as read before.
+     * @param tweets Serialized tweets, most recent first.
+     * @param spReplaced Output, false if a push changed the timeline since the read.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> ReplaceTimelineTweetsAsync(const int userId, const std::vector<std::string> &expectedTweets,
+                                                const std::vector<std::string> &tweets, std::shared_ptr<bool> spReplaced)
+    {
+        return shardOf(userId).ReplaceTimelineTweetsAsync(userId, expectedTweets, tweets, spReplaced);
+    }
+};
+
+#endif
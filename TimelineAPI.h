@@ -30,82 +30,733 @@
 
 #include "Tweet.h"
 #include "IDatastore.h"
-#include <cpprest/json.h>
+#include "CelebrityCache.h"
+#include "TimelineCache.h"
+#include "RequestTrace.h"
+#include "TweetArena.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <queue>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+/*
+ * @brief Where the work of building a timeline is done.
+ *        FanOutOnRead merges the followees' tweets on every read.
+ *        FanOutOnWrite pushes every tweet into the timelines of the followers.
+ *        Hybrid pushes the tweets of regular users and merges the tweets of
+ *        celebrities, i.e. users with many followers, on read.
+ */
+enum class TimelineMode
+{
+    FanOutOnRead,
+    FanOutOnWrite,
+    Hybrid
+};
+
 class TimelineAPI
 {
 private:
     // Datastore object.
     std::shared_ptr<IDatastore> m_spDatastore;
 
+    // Timeline strategy.
+    TimelineMode m_mode;
+
+    // Users with at least this many followers are celebrities in Hybrid mode.
+    std::atomic<int> m_celebrityThreshold;
+
+    // Follower counts against the threshold, read from the datastore once per TTL.
+    CelebrityCache m_celebrityCache;
+
+    // Cache of the responses, optional.
+    std::shared_ptr<TimelineCache> m_spCache;
+
+    // Timeline computation shared by the concurrent requests of a user, joined only while
+    // the timeline of the user was not invalidated since the epoch the computation started at.
+    struct Flight
+    {
+        pplx::task<bool> task;
+        std::shared_ptr<std::string> spTimeline;
+        uint64_t epoch;
+    };
+
+    // Computations in flight keyed by user and number of tweets.
+    std::unordered_map<uint64_t, Flight> m_flights;
+    std::mutex m_flightMutex;
+
+    // Read-merge-replace rounds of a materialized timeline before giving up to the concurrent pushes.
+    static constexpr int REPLACE_ATTEMPTS = 3;
+
+    // The micro benchmarks measure the merge and the response creation directly.
+    friend class TimelineBench;
+
     /*
-     * @brief Create the response string.
-     * @param tweets Tweets to include in the response.
+     * @brief Create the response string, the JSON array is written into a pre-sized buffer
+     *        straight from the stored tweets, malformed ones are left out.
+     * @param tweetsAsString Serialized tweets to include in the response, strings or views.
      * @return Response body.
      */
-    std::string createResponse(const std::vector<Tweet> &tweets) const
+    template <typename TweetStrings>
+    std::string createResponse(const TweetStrings &tweetsAsString) const
     {
-        auto jsonObject = web::json::value::array();
-        for (size_t i = 0; i < tweets.size(); ++i)
+        size_t size = 2;
+        for (const auto &str : tweetsAsString)
+        {
+            size += Tweet::JsonSizeHint(str) + 1;
+        }
+
+        std::string response;
+        response.reserve(size);
+        response.push_back('[');
+        for (const auto &str : tweetsAsString)
+        {
+            size_t mark = response.size();
+            if (mark > 1)
+            {
+                response.push_back(',');
+            }
+            if (!Tweet::AppendJson(str, response))
+            {
+                response.resize(mark);
+            }
+        }
+        response.push_back(']');
+        return response;
+    }
+
+    /*
+     * @brief Create the timeline by a k-way merge of the tweet lists of the users.
+     *        Each list is most recent first, as pushed by the datastore, so the merge
+     *        stops after maxTweets steps. Runs in O(M + KlogM) time where M is the number
+     *        of lists and K is maxTweets, no tweet is parsed or copied. Malformed tweets are skipped.
+     * @param arena Serialized tweets of each followee, most recent first.
+     * @param maxTweets Number of max tweets to return.
+     * @return Views of the most recent serialized tweets in the arena, most recent first.
+     */
+    std::vector<std::string_view> createTimeline(const TweetArena &arena, const int maxTweets) const
+    {
+        // Position in one of the lists and the ID of the tweet there.
+        struct Cursor
+        {
+            int tweetId;
+            size_t list;
+            size_t position;
+
+            bool operator<(const Cursor &other) const
+            {
+                return tweetId < other.tweetId;
+            }
+        };
+
+        // Move a cursor to the next well-formed tweet of its list, false at the end of the list.
+        auto seek = [&arena](Cursor &cursor) {
+            for (; cursor.position < arena.ListSize(cursor.list); ++cursor.position)
+            {
+                cursor.tweetId = Tweet::PeekTweetId(arena.At(cursor.list, cursor.position));
+                if (cursor.tweetId != Tweet::INVALID_TWEET_ID)
+                {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        // Maximum Priority Queue over the heads of the lists.
+        std::vector<Cursor> heads;
+        heads.reserve(arena.ListCount());
+        for (size_t i = 0; i < arena.ListCount(); ++i)
+        {
+            Cursor cursor = {0, i, 0};
+            if (seek(cursor))
+            {
+                heads.push_back(cursor);
+            }
+        }
+        std::priority_queue<Cursor> maxPq(std::less<Cursor>(), std::move(heads));
+
+        // Take the most recent head until the timeline is full.
+        std::vector<std::string_view> timelineTweets;
+        timelineTweets.reserve((maxTweets > 0) ? maxTweets : 0);
+        while (!maxPq.empty() && timelineTweets.size() < static_cast<size_t>(maxTweets))
+        {
+            auto cursor = maxPq.top();
+            maxPq.pop();
+
+            timelineTweets.push_back(arena.At(cursor.list, cursor.position));
+
+            // Advance the cursor.
+            ++cursor.position;
+            if (seek(cursor))
+            {
+                maxPq.push(cursor);
+            }
+        }
+
+        return timelineTweets;
+    }
+
+    /*
+     * @brief Merge tweets that may contain the same tweet more than once.
+     *        Runs in O(NlogN) time, meant for the short lists of the materialized timelines.
+     *        Malformed tweets are left out.
+     * @param tweetsAsString Serialized tweets to merge.
+     * @param maxTweets Number of max tweets to keep.
+     * @return The most recent distinct serialized tweets, most recent first.
+     */
+    std::vector<std::string> mergeDistinct(std::vector<std::string> tweetsAsString, const int maxTweets) const
+    {
+        // Order by the IDs, most recent first.
+        std::vector<std::pair<int, size_t>> order;
+        order.reserve(tweetsAsString.size());
+        for (size_t i = 0; i < tweetsAsString.size(); ++i)
+        {
+            int tweetId = Tweet::PeekTweetId(tweetsAsString[i]);
+            if (tweetId != Tweet::INVALID_TWEET_ID)
+            {
+                order.emplace_back(tweetId, i);
+            }
+        }
+        std::sort(order.begin(), order.end(), std::greater<std::pair<int, size_t>>());
+
+        std::vector<std::string> merged;
+        merged.reserve(order.size());
+        for (size_t i = 0; i < order.size(); ++i)
         {
-            jsonObject[i] = tweets[i].GetJson();
+            if (maxTweets >= 0 && merged.size() >= static_cast<size_t>(maxTweets))
+            {
+                break;
+            }
+            if (i > 0 && order[i].first == order[i - 1].first)
+            {
+                continue;
+            }
+            merged.push_back(std::move(tweetsAsString[order[i].second]));
         }
-        return jsonObject.serialize();
+        return merged;
+    }
+
+    /*
+     * @brief Lazy connection to the datastore.
+     * @return True if connected.
+     */
+    bool connect()
+    {
+        return m_spDatastore->IsConnected() || m_spDatastore->Connect();
     }
 
     /*
-     * @brief Create the timeline by picking most recent tweets in all tweets.
-     *        Runs in O(NlogK) time where N is total tweets and K is maxTweets.
-     * @param tweets All tweets that belong to the users followees.
-     * @return The most recent tweets.
+     * @brief Combine tasks that run in parallel.
+     * @param tasks Tasks to wait for.
+     * @return Task, true if all tasks succeeded.
      */
-    std::vector<Tweet> createTimeline(const std::vector<Tweet> &tweets, const int maxTweets) const
+    static pplx::task<bool> allSucceeded(std::vector<pplx::task<bool>> tasks)
     {
-        // Reference type to use in STL container.
-        using tweetref_t = std::reference_wrapper<const Tweet>;
+        return pplx::when_all(tasks.begin(), tasks.end()).then([](std::vector<bool> results) {
+            return std::find(results.begin(), results.end(), false) == results.end();
+        });
+    }
 
-        // Minimum Priority Queue
-        std::priority_queue<tweetref_t, std::deque<tweetref_t>, std::greater<Tweet>> minPq;
+    /*
+     * @brief Check if the mode keeps materialized timelines.
+     * @return True for FanOutOnWrite and Hybrid.
+     */
+    bool isMaterialized() const
+    {
+        return m_mode != TimelineMode::FanOutOnRead;
+    }
 
-        // Check all the tweets.
-        for (size_t i = 0; i < tweets.size(); ++i)
+    /*
+     * @brief Drop the cached timelines of users once a task changing them completes.
+     * @param changeTask Task changing the timelines.
+     * @param userIdVector Owners of the timelines.
+     * @return Task, result of the change.
+     */
+    pplx::task<bool> invalidateWhenDone(pplx::task<bool> changeTask, std::vector<int> userIdVector)
+    {
+        if (!m_spCache)
         {
-            // Push tweets to the MinPQ only if they are more recent than the oldest tweet in MinPQ.
-            if (minPq.size() < maxTweets || !minPq.empty() && minPq.top().get() < tweets[i])
+            return changeTask;
+        }
+
+        return changeTask.then([this, userIdVector](bool success) {
+            for (auto userId : userIdVector)
             {
-                minPq.push(std::ref(tweets[i]));
+                m_spCache->Invalidate(userId);
             }
+            return success;
+        });
+    }
+
+    /*
+     * @brief Recompute a materialized timeline and replace it only if no push landed since it was read,
+     *        otherwise read and recompute again.
+     * @param userId Owner of the timeline.
+     * @param update Computes the new timeline from the current one, task with false on failure.
+     * @param maxTweets Length of the materialized timelines.
+     * @param attempts Rounds left, fails once all rounds lost to a push.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> replaceTimelineAsync(
+        const int userId,
+        std::function<pplx::task<bool>(std::shared_ptr<std::vector<std::string>>, std::shared_ptr<std::vector<std::string>>)> update,
+        const int maxTweets, const int attempts = REPLACE_ATTEMPTS)
+    {
+        auto spCurrent = std::make_shared<std::vector<std::string>>();
+        auto spUpdated = std::make_shared<std::vector<std::string>>();
+        return m_spDatastore->GetTimelineTweetsAsync(userId, spCurrent, maxTweets)
+            .then([spCurrent, spUpdated, update](bool success) {
+                if (success == false)
+                {
+                    return pplx::task_from_result(false);
+                }
+                return update(spCurrent, spUpdated);
+            })
+            .then([this, userId, spCurrent, spUpdated, update, maxTweets, attempts](bool success) {
+                if (success == false)
+                {
+                    return pplx::task_from_result(false);
+                }
 
-            // Pop the least recent if the size exceeds.
-            if (minPq.size() > maxTweets)
+                auto spReplaced = std::make_shared<bool>(false);
+                return m_spDatastore->ReplaceTimelineTweetsAsync(userId, *spCurrent, *spUpdated, spReplaced)
+                    .then([this, userId, spReplaced, update, maxTweets, attempts](bool success) {
+                        if (success == false || *spReplaced || attempts <= 1)
+                        {
+                            return pplx::task_from_result(success && *spReplaced);
+                        }
+                        return replaceTimelineAsync(userId, update, maxTweets, attempts - 1);
+                    });
+            });
+    }
+
+    /*
+     * @brief Merge the most recent tweets from the tweet lists of several users.
+     * @param userIdVector Users whose tweets are merged.
+     * @param spArena Per-request arena that owns the tweets, must outlive the views.
+     * @param spTimelineTweets Output vector of views into the arena, most recent first.
+     * @param maxTweets Number of max tweets to return.
+     * @param spTrace Trace of the request, optional.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> pullTimelineAsync(const std::vector<int> &userIdVector, std::shared_ptr<TweetArena> spArena,
+                                       std::shared_ptr<std::vector<std::string_view>> spTimelineTweets, const int maxTweets,
+                                       std::shared_ptr<RequestTrace> spTrace = nullptr)
+    {
+        // No user can contribute more than maxTweets, fetch no more than that from each.
+        return RequestTrace::MeasureAsync(spTrace, "tweets", [&]() {
+                   return m_spDatastore->GetRecentTweetArenaAsync(userIdVector, spArena, maxTweets);
+               })
+            .then([this, spArena, spTimelineTweets, maxTweets, spTrace](bool success) {
+                // Create the timeline.
+                if (success)
+                {
+                    *spTimelineTweets = RequestTrace::Measure(spTrace, "merge", [&]() {
+                        return createTimeline(*spArena, maxTweets);
+                    });
+                }
+                return success;
+            });
+    }
+
+    /*
+     * @brief Separate celebrities from regular users by their follower counts, only the uncached counts are read.
+     * @param userIdVector Users to classify.
+     * @param spRegulars Output vector for users below the threshold.
+     * @param spCelebrities Output vector for users at or above the threshold.
+     * @param maxTweets Length of the materialized timelines.
+     * @param pulled Also count the users whose recent tweets were not all pushed as celebrities, for the reads.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> classifyAsync(const std::vector<int> &userIdVector, std::shared_ptr<std::vector<int>> spRegulars,
+                                   std::shared_ptr<std::vector<int>> spCelebrities, const int maxTweets,
+                                   const bool pulled = false)
+    {
+        const int threshold = m_celebrityThreshold;
+        auto spMisses = std::make_shared<std::vector<int>>();
+        for (auto userId : userIdVector)
+        {
+            bool isCelebrity = false;
+            bool isPulled = false;
+            if (m_celebrityCache.Get(userId, threshold, maxTweets, isCelebrity, isPulled))
+            {
+                ((pulled ? isPulled : isCelebrity) ? *spCelebrities : *spRegulars).push_back(userId);
+            }
+            else
             {
-                minPq.pop();
+                spMisses->push_back(userId);
             }
         }
+        if (spMisses->empty())
+        {
+            return pplx::task_from_result(true);
+        }
+
+        auto spCounts = std::make_shared<std::vector<int>>();
+        return m_spDatastore->GetFollowerCountsAsync(*spMisses, spCounts)
+            .then([this, spMisses, spCounts, spRegulars, spCelebrities, threshold, maxTweets, pulled](bool success) {
+                if (success == false || spCounts->size() != spMisses->size())
+                {
+                    return false;
+                }
+
+                for (size_t i = 0; i < spMisses->size(); ++i)
+                {
+                    bool isCelebrity = false;
+                    bool isPulled = false;
+                    m_celebrityCache.Put((*spMisses)[i], (*spCounts)[i], threshold, maxTweets, isCelebrity, isPulled);
+                    ((pulled ? isPulled : isCelebrity) ? *spCelebrities : *spRegulars).push_back((*spMisses)[i]);
+                }
+                return true;
+            });
+    }
+
+    /*
+     * @brief Get the recent tweets of the celebrities followed by the user,
+     *        including the users just dropped below the threshold whose recent tweets were not pushed.
+     * @param userId User
+     * @param spTweetsAsString Output vector for the serialized tweets.
+     * @param spFollowees Output vector for all followees of the user.
+     * @param maxTweets Number of max tweets per celebrity.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> pullCelebritiesAsync(const int userId, std::shared_ptr<std::vector<std::string>> spTweetsAsString,
+                                          std::shared_ptr<std::vector<int>> spFollowees, const int maxTweets)
+    {
+        return m_spDatastore->GetFolloweesAsync(userId, spFollowees)
+            .then([this, spFollowees, spTweetsAsString, maxTweets](bool success) {
+                if (success == false)
+                {
+                    return pplx::task_from_result(false);
+                }
+
+                auto spRegulars = std::make_shared<std::vector<int>>();
+                auto spCelebrities = std::make_shared<std::vector<int>>();
+                return classifyAsync(*spFollowees, spRegulars, spCelebrities, maxTweets, true)
+                    .then([this, spCelebrities, spTweetsAsString, maxTweets](bool success) {
+                        if (success == false || spCelebrities->empty())
+                        {
+                            return pplx::task_from_result(success);
+                        }
+                        return m_spDatastore->GetRecentTweetsAsync(*spCelebrities, spTweetsAsString, maxTweets);
+                    });
+            });
+    }
+
+    /*
+     * @brief Read the materialized timeline, merging the celebrities in Hybrid mode.
+     * @param userId User
+     * @param spTimelineTweets Output vector, most recent first.
+     * @param spDependencies Output vector for the users whose new tweets reach the timeline on read.
+     * @param maxTweets Number of max tweets to return.
+     * @param spTrace Trace of the request, optional.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> readTimelineAsync(const int userId, std::shared_ptr<std::vector<std::string>> spTimelineTweets,
+                                       std::shared_ptr<std::vector<int>> spDependencies, const int maxTweets,
+                                       std::shared_ptr<RequestTrace> spTrace = nullptr)
+    {
+        // The timeline is precomputed, single range read.
+        auto spTweetsAsString = std::make_shared<std::vector<std::string>>();
+        auto timelineTask = RequestTrace::MeasureAsync(spTrace, "timeline", [&]() {
+            return m_spDatastore->GetTimelineTweetsAsync(userId, spTweetsAsString, maxTweets);
+        });
+        if (m_mode != TimelineMode::Hybrid)
+        {
+            return timelineTask.then([spTweetsAsString, spTimelineTweets](bool success) {
+                if (success)
+                {
+                    *spTimelineTweets = std::move(*spTweetsAsString);
+                }
+                return success;
+            });
+        }
+
+        // Pull the celebrities among the followees in parallel.
+        auto spCelebrityTweets = std::make_shared<std::vector<std::string>>();
+        auto celebrityTask = RequestTrace::MeasureAsync(spTrace, "celebrities", [&]() {
+            return pullCelebritiesAsync(userId, spCelebrityTweets, spDependencies, maxTweets);
+        });
+        return allSucceeded({timelineTask, celebrityTask})
+            .then([this, spTweetsAsString, spCelebrityTweets, spTimelineTweets, maxTweets, spTrace](bool success) {
+                if (success)
+                {
+                    // A user crossing the threshold may have tweets on both sides.
+                    spTweetsAsString->insert(spTweetsAsString->end(), spCelebrityTweets->begin(), spCelebrityTweets->end());
+                    *spTimelineTweets = RequestTrace::Measure(spTrace, "merge", [&]() {
+                        return mergeDistinct(std::move(*spTweetsAsString), maxTweets);
+                    });
+                }
+                return success;
+            });
+    }
+
+    /*
+     * @brief Compute the timeline of the user and cache it.
+     * @param userId User
+     * @param spTimeline The output string having the JSON formatted timeline.
+     * @param maxTweets Number of max tweets to return.
+     * @param spTrace Trace of the request, optional.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> computeTimelineAsync(const int userId, std::shared_ptr<std::string> spTimeline, const int maxTweets,
+                                          std::shared_ptr<RequestTrace> spTrace)
+    {
+        if (!connect())
+        {
+            return pplx::task_from_result(false);
+        }
+
+        // Writes invalidating the timeline while it is computed prevent caching it.
+        uint64_t epoch = m_spCache ? m_spCache->Epoch() : 0;
 
-        // Get the objects out of the MinPQ and push to a temporary vector.
-        std::vector<Tweet> timelineTweets;
-        while (!minPq.empty())
+        // Users whose new tweets are not pushed to the timeline, nullptr if unknown.
+        std::shared_ptr<std::vector<int>> spDependencies;
+
+        // The response is written from views into the per-request storage of the tweets,
+        // the arena for merged lists, otherwise the strings read from the datastore.
+        auto spArena = std::make_shared<TweetArena>();
+        auto spOwnedTweets = std::make_shared<std::vector<std::string>>();
+        auto spTimelineTweets = std::make_shared<std::vector<std::string_view>>();
+        pplx::task<bool> timelineTask;
+        if (isMaterialized())
+        {
+            spDependencies = std::make_shared<std::vector<int>>();
+            timelineTask = readTimelineAsync(userId, spOwnedTweets, spDependencies, maxTweets, spTrace);
+        }
+        else if (m_spDatastore->HasServerSideMerge())
+        {
+            // The datastore resolves the followees and merges, single round-trip.
+            // The followees are not known here, so the result is not cached.
+            timelineTask = RequestTrace::MeasureAsync(spTrace, "lua_merge", [&]() {
+                return m_spDatastore->GetMergedTimelineAsync(userId, spOwnedTweets, maxTweets);
+            });
+        }
+        else
         {
-            timelineTweets.push_back(minPq.top().get());
-            minPq.pop();
+            // Get the users followed by the user.
+            auto spFollowees = std::make_shared<std::vector<int>>();
+            spDependencies = spFollowees;
+            timelineTask = RequestTrace::MeasureAsync(spTrace, "followees", [&]() {
+                               return m_spDatastore->GetFolloweesAsync(userId, spFollowees);
+                           })
+                .then([this, userId, spFollowees, spArena, spTimelineTweets, maxTweets, spTrace](bool success) {
+                    if (success == false)
+                    {
+                        return pplx::task_from_result(false);
+                    }
+
+                    // Include senf tweets.
+                    spFollowees->push_back(userId);
+                    return pullTimelineAsync(*spFollowees, spArena, spTimelineTweets, maxTweets, spTrace);
+                });
         }
 
-        // Return the reverse ordered tweets i.e. the most recent goes first.
-        return { timelineTweets.rbegin(), timelineTweets.rend() };
+        return timelineTask.then([this, userId, maxTweets, epoch, spDependencies, spArena, spOwnedTweets, spTimelineTweets,
+                                  spTimeline, spTrace](bool success) {
+            // Create the response string.
+            if (success)
+            {
+                spTimelineTweets->insert(spTimelineTweets->end(), spOwnedTweets->begin(), spOwnedTweets->end());
+                *spTimeline = RequestTrace::Measure(spTrace, "response", [&]() {
+                    return createResponse(*spTimelineTweets);
+                });
+                if (m_spCache && spDependencies)
+                {
+                    m_spCache->Put(userId, maxTweets, *spTimeline, *spDependencies, epoch);
+                }
+            }
+            return success;
+        });
     }
 
 public:
     /*
      * @brief Constructor of TimelineAPI
      * @param spDatastore Dependency injection for Datastore.
+     * @param mode Timeline strategy.
+     * @param celebrityThreshold Follower count that makes a user celebrity in Hybrid mode.
+     * @param spCache Cache of the responses, nullptr disables caching.
+     * @param celebrityTtl Seconds a follower count is used for the classification at most.
      */
-    TimelineAPI(std::shared_ptr<IDatastore> spDatastore)
-        : m_spDatastore(spDatastore) { }
+    TimelineAPI(std::shared_ptr<IDatastore> spDatastore, const TimelineMode mode = TimelineMode::FanOutOnRead,
+                const int celebrityThreshold = 10000, std::shared_ptr<TimelineCache> spCache = nullptr,
+                const double celebrityTtl = 10.0)
+        : m_spDatastore(spDatastore), m_mode(mode), m_celebrityThreshold(celebrityThreshold), m_celebrityCache(celebrityTtl),
+          m_spCache(spCache) { }
+
+    /*
+     * @brief Getter for the timeline strategy.
+     * @return Timeline mode.
+     */
+    TimelineMode GetMode() const
+    {
+        return m_mode;
+    }
+
+    /*
+     * @brief Getter for the celebrity threshold.
+     * @return Follower count that makes a user celebrity.
+     */
+    int GetCelebrityThreshold() const
+    {
+        return m_celebrityThreshold;
+    }
+
+    /*
+     * @brief Setter for the celebrity threshold, applies to the following tweets and reads.
+     * @param celebrityThreshold Follower count that makes a user celebrity.
+     */
+    void SetCelebrityThreshold(const int celebrityThreshold)
+    {
+        m_celebrityThreshold = celebrityThreshold;
+    }
+
+    /*
+     * @brief Get the classification of a user for the Hybrid mode.
+     * @param userId User
+     * @param spFollowerCount Output for the number of followers.
+     * @param spIsCelebrity Output, true if the tweets of the user are merged on read.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> GetClassificationAsync(const int userId, std::shared_ptr<int> spFollowerCount,
+                                            std::shared_ptr<bool> spIsCelebrity)
+    {
+        if (!connect())
+        {
+            return pplx::task_from_result(false);
+        }
+
+        auto spCounts = std::make_shared<std::vector<int>>();
+        return m_spDatastore->GetFollowerCountsAsync({userId}, spCounts)
+            .then([this, spCounts, spFollowerCount, spIsCelebrity](bool success) {
+                if (success == false || spCounts->empty())
+                {
+                    return false;
+                }
+
+                *spFollowerCount = spCounts->front();
+                *spIsCelebrity = *spFollowerCount >= m_celebrityThreshold;
+                return true;
+            });
+    }
+
+    /*
+     * @brief Get the classification of a user for the Hybrid mode.
+     * @param userId User
+     * @param followerCount Output for the number of followers.
+     * @param isCelebrity Output, true if the tweets of the user are merged on read.
+     * @return True on success.
+     */
+    bool GetClassification(const int userId, int &followerCount, bool &isCelebrity)
+    {
+        auto spFollowerCount = std::make_shared<int>(0);
+        auto spIsCelebrity = std::make_shared<bool>(false);
+        if (GetClassificationAsync(userId, spFollowerCount, spIsCelebrity).get() == false)
+        {
+            return false;
+        }
+
+        followerCount = *spFollowerCount;
+        isCelebrity = *spIsCelebrity;
+        return true;
+    }
+
+    /*
+     * @brief Get timeline of the corresponding user without blocking.
+     *        Concurrent requests for the same timeline share one computation.
+     * @param userId User
+     * @param spTimeline The output string having the JSON formatted timeline.
+     * @param maxTweets Number of max tweets to return.
+     * @param spTrace Trace of the request, collects the time of each stage, optional.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> GetTimelineAsync(const int userId, std::shared_ptr<std::string> spTimeline, const int maxTweets = 10,
+                                      std::shared_ptr<RequestTrace> spTrace = nullptr)
+    {
+        // Serve from the cache.
+        if (m_spCache && RequestTrace::Measure(spTrace, "cache", [&]() { return m_spCache->Get(userId, maxTweets, *spTimeline); }))
+        {
+            return pplx::task_from_result(true);
+        }
+
+        // Join the computation in flight unless the user wrote since it started, or register
+        // a new one before it starts so that a computation completing inline still finds itself.
+        auto key = (static_cast<uint64_t>(static_cast<uint32_t>(userId)) << 32) | static_cast<uint32_t>(maxTweets);
+        pplx::task_completion_event<bool> completed;
+        Flight flight;
+        bool joined = false;
+        {
+            std::lock_guard<std::mutex> lock(m_flightMutex);
+            auto it = m_flights.find(key);
+            joined = it != m_flights.end() && (!m_spCache || m_spCache->Unchanged(userId, it->second.epoch));
+            if (joined)
+            {
+                flight = it->second;
+            }
+            else
+            {
+                // A computation started before a write is left to its joined requests.
+                flight = Flight{pplx::create_task(completed), std::make_shared<std::string>(), m_spCache ? m_spCache->Epoch() : 0};
+                m_flights[key] = flight;
+            }
+        }
+
+        if (!joined)
+        {
+            // A throwing computation must still release the joined requests.
+            pplx::task<bool> timelineTask;
+            try
+            {
+                timelineTask = computeTimelineAsync(userId, flight.spTimeline, maxTweets, spTrace);
+            }
+            catch (...)
+            {
+                timelineTask = pplx::task_from_result(false);
+            }
+
+            timelineTask.then([this, key, completed, spShared = flight.spTimeline](pplx::task<bool> computeTask) {
+                bool success = false;
+                try
+                {
+                    success = computeTask.get();
+                }
+                catch (...)
+                {
+                }
+
+                // Later requests start a new computation, or hit the cache. A newer computation
+                // that replaced this one stays registered.
+                {
+                    std::lock_guard<std::mutex> lock(m_flightMutex);
+                    auto it = m_flights.find(key);
+                    if (it != m_flights.end() && it->second.spTimeline == spShared)
+                    {
+                        m_flights.erase(it);
+                    }
+                }
+                completed.set(success);
+            });
+        }
+
+        // A joined request waits for the stages traced by the computing one.
+        auto sharedTask = joined ? RequestTrace::MeasureAsync(spTrace, "coalesced", [&]() { return flight.task; }) : flight.task;
+        return sharedTask.then([spShared = flight.spTimeline, spTimeline](bool success) {
+            if (success)
+            {
+                *spTimeline = *spShared;
+            }
+            return success;
+        });
+    }
 
     /*
      * @brief Get timeline of the corresponding user.
@@ -116,43 +767,209 @@ public:
      */
     bool GetTimeline(int userId, std::string &timeline, const int maxTweets = 10)
     {
-        if (!m_spDatastore->IsConnected() && m_spDatastore->Connect() == false)
+        auto spTimeline = std::make_shared<std::string>();
+        if (GetTimelineAsync(userId, spTimeline, maxTweets).get() == false)
         {
             return false;
         }
 
-        // Get the users followed by the user.
-        std::vector<int> followees;
-        if (m_spDatastore->GetFollowees(userId, followees) == false)
+        timeline = std::move(*spTimeline);
+        return true;
+    }
+
+    /*
+     * @brief Deliver a new tweet to the timelines of the author and the followers.
+     *        Only drops cached timelines in FanOutOnRead mode, celebrities only push to their own timeline.
+     * @param userId Author of the tweet.
+     * @param tweetAsString Serialized tweet.
+     * @param maxTweets Length of the materialized timelines.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> FanOutAsync(const int userId, const std::string &tweetAsString, const int maxTweets = 10)
+    {
+        // The tweet is stored, drop the cached timelines that merge it on read.
+        if (m_spCache)
         {
-            return false;
+            m_spCache->InvalidateDependents(userId);
+            m_spCache->Invalidate(userId);
+        }
+
+        if (!isMaterialized())
+        {
+            return pplx::task_from_result(true);
         }
 
-        // Include senf tweets.
-        followees.push_back(userId);
+        // Push to the followers from the reverse index and to self timeline.
+        auto pushToFollowers = [this, userId, tweetAsString, maxTweets]() {
+            auto spFollowers = std::make_shared<std::vector<int>>();
+            return m_spDatastore->GetFollowersAsync(userId, spFollowers)
+                .then([this, userId, spFollowers, tweetAsString, maxTweets](bool success) {
+                    if (success == false)
+                    {
+                        return pplx::task_from_result(false);
+                    }
 
-        // Get tweets of all users followed by the user.
-        std::vector<std::string> tweetsAsString;
-        if (m_spDatastore->GetRecentTweets(followees, tweetsAsString) == false)
+                    spFollowers->push_back(userId);
+                    return invalidateWhenDone(m_spDatastore->PushTimelinesAsync(*spFollowers, tweetAsString, maxTweets),
+                                              *spFollowers);
+                });
+        };
+
+        if (m_mode != TimelineMode::Hybrid)
         {
-            return false;
+            return pushToFollowers();
         }
 
-        // Deserialize tweets and push to vector.
-        std::vector<Tweet> allTweets;
-        for (const auto &str : tweetsAsString)
+        // Celebrities are merged on read.
+        auto spRegulars = std::make_shared<std::vector<int>>();
+        auto spCelebrities = std::make_shared<std::vector<int>>();
+        return classifyAsync({userId}, spRegulars, spCelebrities, maxTweets)
+            .then([this, userId, tweetAsString, maxTweets, spCelebrities, pushToFollowers](bool success) {
+                if (success == false)
+                {
+                    return pplx::task_from_result(false);
+                }
+                if (!spCelebrities->empty())
+                {
+                    return invalidateWhenDone(m_spDatastore->PushTimelinesAsync({userId}, tweetAsString, maxTweets), {userId});
+                }
+
+                // A user dropped below the threshold is pulled on read until a timeline of tweets was pushed.
+                return pushToFollowers().then([this, userId](bool success) {
+                    if (success)
+                    {
+                        m_celebrityCache.Pushed(userId);
+                    }
+                    return success;
+                });
+            });
+    }
+
+    /*
+     * @brief Merge the recent tweets of a new followee into the timeline of the follower.
+     *        Only drops the cached timeline in FanOutOnRead mode or if the followee is a celebrity in Hybrid mode.
+     * @param followerId Owner of the timeline.
+     * @param followeeId Newly followed user.
+     * @param maxTweets Length of the materialized timelines.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> BackfillAsync(const int followerId, const int followeeId, const int maxTweets = 10)
+    {
+        // The followees changed, drop the cached timeline.
+        if (m_spCache)
         {
-            allTweets.emplace_back(str);
+            m_spCache->Invalidate(followerId);
         }
 
-        // Create the timeline.
-        auto timelineTweets = createTimeline(allTweets, maxTweets);
+        if (!isMaterialized())
+        {
+            return pplx::task_from_result(true);
+        }
 
-        // Create the response string.
-        timeline = createResponse(timelineTweets);
+        // Merge the most recent tweets of the followee into the current timeline.
+        auto backfill = [this, followerId, followeeId, maxTweets]() {
+            auto merge = [this, followeeId, maxTweets](std::shared_ptr<std::vector<std::string>> spCurrent,
+                                                       std::shared_ptr<std::vector<std::string>> spUpdated) {
+                auto spFolloweeTweets = std::make_shared<std::vector<std::string>>();
+                return m_spDatastore->GetRecentTweetsAsync({followeeId}, spFolloweeTweets, maxTweets)
+                    .then([this, spCurrent, spUpdated, spFolloweeTweets, maxTweets](bool success) {
+                        if (success)
+                        {
+                            // A repeated follow must not duplicate the tweets.
+                            std::vector<std::string> tweets(*spCurrent);
+                            tweets.insert(tweets.end(), spFolloweeTweets->begin(), spFolloweeTweets->end());
+                            *spUpdated = mergeDistinct(std::move(tweets), maxTweets);
+                        }
+                        return success;
+                    });
+            };
+            return invalidateWhenDone(replaceTimelineAsync(followerId, merge, maxTweets), {followerId});
+        };
 
-        // Success.
-        return true;
+        if (m_mode != TimelineMode::Hybrid)
+        {
+            return backfill();
+        }
+
+        // Celebrities are merged on read.
+        auto spRegulars = std::make_shared<std::vector<int>>();
+        auto spCelebrities = std::make_shared<std::vector<int>>();
+        return classifyAsync({followeeId}, spRegulars, spCelebrities, maxTweets)
+            .then([spCelebrities, backfill](bool success) {
+                if (success == false || !spCelebrities->empty())
+                {
+                    return pplx::task_from_result(success);
+                }
+                return backfill();
+            });
+    }
+
+    /*
+     * @brief Recompute the materialized timeline from the tweet lists, e.g. after unfollow.
+     *        Only drops the cached timeline in FanOutOnRead mode, celebrities are left out in Hybrid mode.
+     * @param userId Owner of the timeline.
+     * @param maxTweets Length of the materialized timelines.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> RebuildTimelineAsync(const int userId, const int maxTweets = 10)
+    {
+        // The followees changed, drop the cached timeline.
+        if (m_spCache)
+        {
+            m_spCache->Invalidate(userId);
+        }
+
+        if (!isMaterialized())
+        {
+            return pplx::task_from_result(true);
+        }
+
+        // Merge the tweet lists and store the result.
+        auto rebuild = [this, userId, maxTweets](std::vector<int> userIdVector) {
+            // Include self tweets.
+            userIdVector.push_back(userId);
+
+            auto merge = [this, userIdVector, maxTweets](std::shared_ptr<std::vector<std::string>>,
+                                                         std::shared_ptr<std::vector<std::string>> spUpdated) {
+                auto spArena = std::make_shared<TweetArena>();
+                auto spTimelineTweets = std::make_shared<std::vector<std::string_view>>();
+                return pullTimelineAsync(userIdVector, spArena, spTimelineTweets, maxTweets)
+                    .then([spUpdated, spArena, spTimelineTweets](bool success) {
+                        if (success)
+                        {
+                            spUpdated->assign(spTimelineTweets->begin(), spTimelineTweets->end());
+                        }
+                        return success;
+                    });
+            };
+            return invalidateWhenDone(replaceTimelineAsync(userId, merge, maxTweets), {userId});
+        };
+
+        // Get the users followed by the user.
+        auto spFollowees = std::make_shared<std::vector<int>>();
+        return m_spDatastore->GetFolloweesAsync(userId, spFollowees)
+            .then([this, spFollowees, rebuild, maxTweets](bool success) {
+                if (success == false)
+                {
+                    return pplx::task_from_result(false);
+                }
+                if (m_mode != TimelineMode::Hybrid)
+                {
+                    return rebuild(*spFollowees);
+                }
+
+                // Keep only the pushed users in Hybrid mode.
+                auto spRegulars = std::make_shared<std::vector<int>>();
+                auto spCelebrities = std::make_shared<std::vector<int>>();
+                return classifyAsync(*spFollowees, spRegulars, spCelebrities, maxTweets)
+                    .then([spRegulars, rebuild](bool success) {
+                        if (success == false)
+                        {
+                            return pplx::task_from_result(false);
+                        }
+                        return rebuild(*spRegulars);
+                    });
+            });
     }
 };
 
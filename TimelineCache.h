@@ -0,0 +1,385 @@
+/**
+ * @file      TimelineCache.h
+ * @author    Atakan S.
+ * @version   1.0
+ * @brief     Bounded sharded LRU cache of timeline responses.
+ *
+ * @copyright Copyright (c) 2020 Atakan SARIOGLU ~ www.atakansarioglu.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _H_TIMELINECACHE_H_
+#define _H_TIMELINECACHE_H_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class TimelineCache
+{
+private:
+    // Cached response of one user.
+    struct Entry
+    {
+        int userId;
+        int maxTweets;
+        std::string timeline;
+        std::vector<int> dependencies;
+        std::chrono::steady_clock::time_point expiry;
+        uint64_t generation;
+    };
+
+    // Entry removed under the lock of its shard, unlinked from its authors without it.
+    struct Removed
+    {
+        int userId;
+        uint64_t generation;
+        std::vector<int> dependencies;
+    };
+
+    // One stripe of the cache, guarded by its own lock.
+    struct Shard
+    {
+        std::mutex mutex;
+        std::list<Entry> lru;
+        std::unordered_map<int, std::list<Entry>::iterator> entries;
+
+        // Authors of the shard mapped to the cached users whose timeline shows their tweets,
+        // with the generation of the entry that registered, so a newer entry is never unlinked.
+        std::unordered_map<int, std::unordered_map<int, uint64_t>> dependents;
+    };
+
+    std::vector<Shard> m_shards;
+    size_t m_shardCapacity;
+    std::chrono::duration<double> m_ttl;
+
+    // Stamps of the last invalidation per stripe of owners and of authors. A response is not cached
+    // if its owner or one of its authors was invalidated after the computation started.
+    static constexpr size_t EPOCH_STRIPES = 4096;
+    std::atomic<uint64_t> m_epoch;
+    std::array<std::atomic<uint64_t>, EPOCH_STRIPES> m_invalidated{};
+
+    // Generation of the next entry.
+    std::atomic<uint64_t> m_generation;
+
+    /*
+     * @brief Select the shard of a user.
+     * @param userId User
+     * @return Shard reference.
+     */
+    Shard &shardOf(const int userId)
+    {
+        return m_shards[static_cast<unsigned int>(userId) % m_shards.size()];
+    }
+
+    /*
+     * @brief Select the invalidation stamp of an owner or an author.
+     * @param userId User
+     * @param author True for the stamp of the user as author, false as owner of a timeline.
+     * @return Stamp reference.
+     */
+    std::atomic<uint64_t> &stampOf(const int userId, const bool author)
+    {
+        uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(userId)) << 1) | (author ? 1 : 0);
+        return m_invalidated[(key * 0x9E3779B97F4A7C15ULL >> 32) % EPOCH_STRIPES];
+    }
+
+    /*
+     * @brief Record an invalidation with a new epoch.
+     * @param userId User
+     * @param author True if new tweets of the user were written, false if the timeline of the user changed.
+     */
+    void stamp(const int userId, const bool author)
+    {
+        uint64_t epoch = ++m_epoch;
+        auto &stamp = stampOf(userId, author);
+        uint64_t current = stamp;
+        while (current < epoch && !stamp.compare_exchange_weak(current, epoch))
+        {
+        }
+    }
+
+    /*
+     * @brief Check if a timeline computed from the epoch on is still current.
+     * @param userId Owner of the timeline.
+     * @param dependencies Authors of the timeline.
+     * @param epoch Epoch taken before the timeline was computed.
+     * @return False if the owner or an author was invalidated since.
+     */
+    bool current(const int userId, const std::vector<int> &dependencies, const uint64_t epoch)
+    {
+        if (stampOf(userId, false) > epoch)
+        {
+            return false;
+        }
+        for (auto authorId : dependencies)
+        {
+            if (stampOf(authorId, true) > epoch)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*
+     * @brief Remove an entry from its shard, the lock of the shard must be held.
+     * @param shard Shard of the entry.
+     * @param it Entry to remove.
+     * @return Removed entry, to be unlinked without the lock.
+     */
+    Removed erase(Shard &shard, std::list<Entry>::iterator it)
+    {
+        Removed removed{it->userId, it->generation, std::move(it->dependencies)};
+        shard.entries.erase(it->userId);
+        shard.lru.erase(it);
+        return removed;
+    }
+
+    /*
+     * @brief Unlink a removed entry from the dependents of its authors. The registrations of
+     *        a newer entry of the same owner, put meanwhile, are kept.
+     * @param removed Removed entry.
+     */
+    void unlink(const Removed &removed)
+    {
+        for (auto authorId : removed.dependencies)
+        {
+            auto &shard = shardOf(authorId);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.dependents.find(authorId);
+            if (it == shard.dependents.end())
+            {
+                continue;
+            }
+            auto dependent = it->second.find(removed.userId);
+            if (dependent != it->second.end() && dependent->second == removed.generation)
+            {
+                it->second.erase(dependent);
+                if (it->second.empty())
+                {
+                    shard.dependents.erase(it);
+                }
+            }
+        }
+    }
+
+public:
+    /*
+     * @brief Constructor of the cache.
+     * @param capacity Max number of cached timelines, 0 disables the cache.
+     * @param ttl Seconds a cached timeline is served at most, bounds the staleness
+     *            of writes made by other API instances.
+     * @param shardCount Number of independently locked stripes.
+     */
+    TimelineCache(const size_t capacity = 100000, const double ttl = 5.0, const size_t shardCount = 16)
+        : m_shards(shardCount > 0 ? shardCount : 1), m_ttl(ttl), m_epoch(0), m_generation(0)
+    {
+        m_shardCapacity = (capacity + m_shards.size() - 1) / m_shards.size();
+    }
+
+    /*
+     * @brief Current epoch, take it before computing a timeline and pass it to Put.
+     * @return Epoch.
+     */
+    uint64_t Epoch() const
+    {
+        return m_epoch;
+    }
+
+    /*
+     * @brief Check if the timeline of a user was not invalidated since an epoch, e.g. by a
+     *        tweet, follow or unfollow of the user.
+     * @param userId Owner of the timeline.
+     * @param epoch Epoch taken before.
+     * @return True if unchanged since.
+     */
+    bool Unchanged(const int userId, const uint64_t epoch)
+    {
+        return stampOf(userId, false) <= epoch;
+    }
+
+    /*
+     * @brief Get a cached timeline.
+     * @param userId Owner of the timeline.
+     * @param maxTweets Number of max tweets the timeline was requested with.
+     * @param timeline Output for the response body.
+     * @return True on hit.
+     */
+    bool Get(const int userId, const int maxTweets, std::string &timeline)
+    {
+        if (m_shardCapacity == 0)
+        {
+            return false;
+        }
+
+        Removed removed;
+        {
+            auto &shard = shardOf(userId);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.entries.find(userId);
+            if (it == shard.entries.end())
+            {
+                return false;
+            }
+
+            // Serve and refresh the position if still fresh.
+            if (std::chrono::steady_clock::now() < it->second->expiry)
+            {
+                if (it->second->maxTweets != maxTweets)
+                {
+                    return false;
+                }
+
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                timeline = it->second->timeline;
+                return true;
+            }
+            removed = erase(shard, it->second);
+        }
+
+        unlink(removed);
+        return false;
+    }
+
+    /*
+     * @brief Cache a timeline, dropped if its owner or one of its authors was invalidated since the epoch.
+     * @param userId Owner of the timeline.
+     * @param maxTweets Number of max tweets the timeline was requested with.
+     * @param timeline Response body.
+     * @param dependencies Authors whose new tweets invalidate the timeline.
+     * @param epoch Epoch taken before the timeline was computed.
+     */
+    void Put(const int userId, const int maxTweets, const std::string &timeline, const std::vector<int> &dependencies,
+             const uint64_t epoch)
+    {
+        if (m_shardCapacity == 0 || !current(userId, dependencies, epoch))
+        {
+            return;
+        }
+
+        // Register as dependent first, a concurrent invalidation then finds the entry or stamps the author.
+        uint64_t generation = ++m_generation;
+        for (auto authorId : dependencies)
+        {
+            auto &shard = shardOf(authorId);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.dependents[authorId][userId] = generation;
+        }
+
+        std::vector<Removed> removed;
+        bool stale = false;
+        {
+            auto &shard = shardOf(userId);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+
+            // Replace the previous entry, also dropped if the new one is stale.
+            auto it = shard.entries.find(userId);
+            if (it != shard.entries.end())
+            {
+                removed.push_back(erase(shard, it->second));
+            }
+
+            stale = !current(userId, dependencies, epoch);
+            if (!stale)
+            {
+                shard.lru.push_front({userId, maxTweets, timeline, dependencies, std::chrono::steady_clock::now() +
+                                      std::chrono::duration_cast<std::chrono::steady_clock::duration>(m_ttl), generation});
+                shard.entries[userId] = shard.lru.begin();
+
+                // Evict the least recently used.
+                while (shard.lru.size() > m_shardCapacity)
+                {
+                    removed.push_back(erase(shard, std::prev(shard.lru.end())));
+                }
+            }
+        }
+
+        // Roll back the registrations of a stale timeline, the new entry keeps its own otherwise.
+        if (stale)
+        {
+            removed.push_back({userId, generation, dependencies});
+        }
+        for (const auto &entry : removed)
+        {
+            unlink(entry);
+        }
+    }
+
+    /*
+     * @brief Drop the cached timeline of a user, e.g. after follow or unfollow.
+     * @param userId Owner of the timeline.
+     */
+    void Invalidate(const int userId)
+    {
+        stamp(userId, false);
+
+        Removed removed;
+        {
+            auto &shard = shardOf(userId);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.entries.find(userId);
+            if (it == shard.entries.end())
+            {
+                return;
+            }
+            removed = erase(shard, it->second);
+        }
+
+        unlink(removed);
+    }
+
+    /*
+     * @brief Drop the cached timelines showing the tweets of an author, e.g. after a new tweet.
+     * @param authorId Author of the new tweet.
+     */
+    void InvalidateDependents(const int authorId)
+    {
+        stamp(authorId, true);
+
+        std::unordered_map<int, uint64_t> dependents;
+        {
+            auto &shard = shardOf(authorId);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            auto it = shard.dependents.find(authorId);
+            if (it == shard.dependents.end())
+            {
+                return;
+            }
+            dependents.swap(it->second);
+            shard.dependents.erase(it);
+        }
+
+        for (const auto &dependent : dependents)
+        {
+            Invalidate(dependent.first);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,159 @@
+/**
+ * @file      TraceLog.h
+ * @author    Atakan S.
+ * @version   1.0
+ * @brief     Lock-free ring buffer of sampled request traces.
+ *
+ * @copyright Copyright (c) 2020 Atakan SARIOGLU ~ www.atakansarioglu.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _H_TRACELOG_H_
+#define _H_TRACELOG_H_
+
+#include "RequestTrace.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/*
+ * @brief Keeps the most recent sampled traces, every Nth request and every slow one.
+ *        Writers claim a slot with one atomic increment, a slot that is being read or
+ *        written is skipped instead of waited for, so no request ever blocks on the log.
+ */
+class TraceLog
+{
+public:
+    // Copy of a completed trace.
+    struct Record
+    {
+        uint64_t sequence;
+        std::chrono::system_clock::time_point time;
+        const char *name;
+        uint32_t totalMicros;
+        size_t spanCount;
+        std::array<RequestTrace::Span, RequestTrace::MAX_SPANS> spans;
+    };
+
+private:
+    // Slot of the ring, sequence 0 marks an empty one.
+    struct Slot
+    {
+        std::atomic<bool> busy{false};
+        Record record{};
+    };
+
+    // Ring of the records.
+    std::unique_ptr<Slot[]> m_slots;
+    size_t m_capacity;
+
+    // Sequence of the next record, and number of submitted traces.
+    std::atomic<uint64_t> m_next;
+    std::atomic<uint64_t> m_submitted;
+
+    // Every Nth trace is logged, 0 for none.
+    uint64_t m_sampleEvery;
+
+    // Traces at least this long are logged, 0 for none.
+    uint32_t m_slowMicros;
+
+public:
+    /*
+     * @brief Constructor of the log.
+     * @param capacity Number of kept records.
+     * @param sampleEvery Log every Nth trace, 0 to log none by sampling.
+     * @param slowSeconds Log every trace at least this long, 0 to log none by duration.
+     */
+    TraceLog(const size_t capacity = 1024, const uint64_t sampleEvery = 100, const double slowSeconds = 0.1)
+        : m_slots(new Slot[capacity > 0 ? capacity : 1]), m_capacity(capacity > 0 ? capacity : 1), m_next(1),
+          m_submitted(0), m_sampleEvery(sampleEvery), m_slowMicros(static_cast<uint32_t>(slowSeconds * 1e6)) {}
+
+    /*
+     * @brief Offer a completed trace, it is copied if sampled.
+     * @param trace Trace of a completed request.
+     * @return True if logged.
+     */
+    bool Submit(const RequestTrace &trace)
+    {
+        uint32_t totalMicros = trace.ElapsedMicros();
+        uint64_t submitted = m_submitted.fetch_add(1, std::memory_order_relaxed);
+        bool sampled = (m_sampleEvery > 0 && submitted % m_sampleEvery == 0);
+        bool slow = (m_slowMicros > 0 && totalMicros >= m_slowMicros);
+        if (!sampled && !slow)
+        {
+            return false;
+        }
+
+        uint64_t sequence = m_next.fetch_add(1, std::memory_order_relaxed);
+        Slot &slot = m_slots[sequence % m_capacity];
+        if (slot.busy.exchange(true, std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        Record &record = slot.record;
+        record.sequence = sequence;
+        record.time = std::chrono::system_clock::now();
+        record.name = trace.GetName();
+        record.totalMicros = totalMicros;
+        record.spanCount = trace.SpanCount();
+        for (size_t i = 0; i < record.spanCount; ++i)
+        {
+            record.spans[i] = trace.GetSpan(i);
+        }
+        slot.busy.store(false, std::memory_order_release);
+        return true;
+    }
+
+    /*
+     * @brief Copy the logged records.
+     * @return Records, oldest first.
+     */
+    std::vector<Record> Dump() const
+    {
+        std::vector<Record> records;
+        records.reserve(m_capacity);
+        for (size_t i = 0; i < m_capacity; ++i)
+        {
+            Slot &slot = m_slots[i];
+            if (slot.busy.exchange(true, std::memory_order_acquire))
+            {
+                continue;
+            }
+            if (slot.record.sequence != 0)
+            {
+                records.push_back(slot.record);
+            }
+            slot.busy.store(false, std::memory_order_release);
+        }
+
+        std::sort(records.begin(), records.end(), [](const Record &a, const Record &b) {
+            return a.sequence < b.sequence;
+        });
+        return records;
+    }
+};
+
+#endif
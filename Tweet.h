@@ -29,7 +29,25 @@
 #define _H_TWEET_H_
 
 #include <iostream>
+#include <charconv>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
 #include <cpprest/json.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+ * @brief Non-owning view of a binary serialized tweet, valid while the bytes live.
+ */
+struct TweetView
+{
+    int tweetId;
+    int userId;
+    std::string_view content;
+};
 
 class Tweet
 {
@@ -38,7 +56,232 @@ private:
     int m_userId;
     std::string m_content;
 
+    // Binary layout: version, tweetId, userId, content length, content.
+    // Integers are 4 byte little endian, JSON always starts with '{' instead.
+    static constexpr unsigned char BINARY_VERSION = 1;
+    static constexpr size_t BINARY_HEADER_SIZE = 13;
+
+    /*
+     * @brief Append a 4 byte little endian integer.
+     * @param output Output buffer.
+     * @param value Value to append.
+     */
+    static void putInt32(std::string &output, const uint32_t value)
+    {
+        for (int shift = 0; shift < 32; shift += 8)
+        {
+            output.push_back(static_cast<char>((value >> shift) & 0xFF));
+        }
+    }
+
+    /*
+     * @brief Read a 4 byte little endian integer.
+     * @param input Input buffer, at least 4 bytes.
+     * @return Value read.
+     */
+    static uint32_t getInt32(const char *input)
+    {
+        uint32_t value = 0;
+        for (int i = 3; i >= 0; --i)
+        {
+            value = (value << 8) | static_cast<unsigned char>(input[i]);
+        }
+        return value;
+    }
+
+    /*
+     * @brief Check if a serialized tweet uses the binary encoding.
+     * @param serializedTweet Serialized tweet.
+     * @return True if binary, false for legacy JSON.
+     */
+    static bool isBinary(const std::string_view serializedTweet)
+    {
+        return !serializedTweet.empty() && static_cast<unsigned char>(serializedTweet[0]) == BINARY_VERSION;
+    }
+
+    /*
+     * @brief Append a string as a JSON string literal, escaped the same way as cpprest.
+     * @param output Output buffer.
+     * @param begin First byte of the string.
+     * @param size Number of bytes.
+     */
+    static void appendJsonString(std::string &output, const char *begin, const size_t size)
+    {
+        static const char hex[] = "0123456789abcdef";
+        output.push_back('"');
+        const char *end = begin + size;
+        const char *run = begin;
+        for (const char *c = begin; c != end; ++c)
+        {
+            unsigned char ch = static_cast<unsigned char>(*c);
+            if (ch >= 0x20 && ch != '"' && ch != '\\')
+            {
+                continue;
+            }
+
+            // Copy the plain run at once, then the escape.
+            output.append(run, c);
+            run = c + 1;
+            switch (ch)
+            {
+            case '"': output.append("\\\""); break;
+            case '\\': output.append("\\\\"); break;
+            case '\b': output.append("\\b"); break;
+            case '\f': output.append("\\f"); break;
+            case '\n': output.append("\\n"); break;
+            case '\r': output.append("\\r"); break;
+            case '\t': output.append("\\t"); break;
+            default:
+                output.append("\\u00");
+                output.push_back(hex[ch >> 4]);
+                output.push_back(hex[ch & 0x0F]);
+                break;
+            }
+        }
+        output.append(run, end);
+        output.push_back('"');
+    }
+
+    /*
+     * @brief Find the first byte that ends a plain JSON string: a quote, a backslash or a
+     *        control character. Scans 16 bytes at a time with SSE2 where available.
+     * @param begin First byte.
+     * @param end Past the last byte.
+     * @return Position of the byte, end if none.
+     */
+    static const char *findStringEnd(const char *begin, const char *end)
+    {
+#if defined(__SSE2__)
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i control = _mm_set1_epi8(0x1F);
+        while (end - begin >= 16)
+        {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+            __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                                           _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+            int mask = _mm_movemask_epi8(special);
+            if (mask != 0)
+            {
+                return begin + __builtin_ctz(mask);
+            }
+            begin += 16;
+        }
+#endif
+        while (begin != end)
+        {
+            unsigned char ch = static_cast<unsigned char>(*begin);
+            if (ch == '"' || ch == '\\' || ch < 0x20)
+            {
+                break;
+            }
+            ++begin;
+        }
+        return begin;
+    }
+
+    /*
+     * @brief Consume an expected literal.
+     * @param position Current position, advanced on match.
+     * @param end Past the last byte.
+     * @param literal Expected bytes.
+     * @return True on match.
+     */
+    static bool consume(const char *&position, const char *end, const std::string_view literal)
+    {
+        if (static_cast<size_t>(end - position) < literal.size() || std::string_view(position, literal.size()) != literal)
+        {
+            return false;
+        }
+        position += literal.size();
+        return true;
+    }
+
+    /*
+     * @brief Consume a decimal integer.
+     * @param position Current position, advanced on success.
+     * @param end Past the last byte.
+     * @param value Output value.
+     * @return True on success.
+     */
+    static bool consumeInteger(const char *&position, const char *end, int &value)
+    {
+        auto result = std::from_chars(position, end, value);
+        if (result.ec != std::errc() || result.ptr == position)
+        {
+            return false;
+        }
+        position = result.ptr;
+        return true;
+    }
+
+    /*
+     * @brief Parse the legacy JSON form in the exact layout cpprest wrote it,
+     *        {"content":"...","tweetId":N,"userId":N} without whitespace.
+     *        Escaped content, other key orders or any other deviation are rejected,
+     *        such input is left to the generic parser.
+     * @param serializedTweet Serialized tweet.
+     * @param tweetId Output tweet ID.
+     * @param userId Output user ID.
+     * @param content Output content.
+     * @return True if the input has the fixed layout.
+     */
+    static bool parseFixedJson(const std::string_view serializedTweet, int &tweetId, int &userId, std::string_view &content)
+    {
+        const char *position = serializedTweet.data();
+        const char *end = position + serializedTweet.size();
+
+        if (!consume(position, end, "{\"content\":\""))
+        {
+            return false;
+        }
+        const char *contentEnd = findStringEnd(position, end);
+        if (contentEnd == end || *contentEnd != '"')
+        {
+            return false;
+        }
+        content = std::string_view(position, contentEnd - position);
+        position = contentEnd;
+
+        return consume(position, end, "\",\"tweetId\":") && consumeInteger(position, end, tweetId)
+               && consume(position, end, ",\"userId\":") && consumeInteger(position, end, userId)
+               && consume(position, end, "}") && position == end;
+    }
+
+    /*
+     * @brief Append an integer in decimal without a temporary string.
+     * @param output Output buffer.
+     * @param value Value to append.
+     */
+    static void appendInteger(std::string &output, const int value)
+    {
+        char digits[12];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        output.append(digits, result.ptr);
+    }
+
+    /*
+     * @brief Append the JSON object of a tweet in the key order of GetJson().serialize().
+     * @param output Output buffer.
+     * @param content Content, escaped as needed.
+     * @param tweetId Tweet ID.
+     * @param userId User ID.
+     */
+    static void appendFields(std::string &output, const std::string_view content, const int tweetId, const int userId)
+    {
+        output.append("{\"content\":");
+        appendJsonString(output, content.data(), content.size());
+        output.append(",\"tweetId\":");
+        appendInteger(output, tweetId);
+        output.append(",\"userId\":");
+        appendInteger(output, userId);
+        output.push_back('}');
+    }
+
 public:
+    // Returned by PeekTweetId for a malformed tweet, never a valid ID.
+    static constexpr int INVALID_TWEET_ID = -1;
+
     /*
      * @brief Constructor.
      * @param content The text of the tweet.
@@ -46,26 +289,164 @@ public:
      * @param userId User
      */
     Tweet(const std::string &content, const int tweetId, const int userId)
-        : m_content(content), m_tweetId(tweetId), m_userId(userId) {}
+        : m_tweetId(tweetId), m_userId(userId), m_content(content) {}
 
     /*
-     * @brief Converting constructor.
-     * @param serializedTweet Tweet as JSON formatted string.
+     * @brief Converting constructor, reads both the binary and the legacy JSON encoding.
+     * @param serializedTweet Serialized tweet.
      */
     Tweet(const std::string &serializedTweet)
     {
+        TweetView view;
+        if (isBinary(serializedTweet))
+        {
+            if (!View(serializedTweet, view))
+            {
+                throw std::invalid_argument("Malformed binary tweet");
+            }
+            m_tweetId = view.tweetId;
+            m_userId = view.userId;
+            m_content.assign(view.content);
+            return;
+        }
+
+        // Fixed layout first, the generic parser for anything else.
+        std::string_view content;
+        if (parseFixedJson(serializedTweet, m_tweetId, m_userId, content))
+        {
+            m_content.assign(content);
+            return;
+        }
+
         auto tweetJson = web::json::value::parse(serializedTweet);
-        auto content = tweetJson["content"].as_string();
-        auto tweetId = tweetJson["tweetId"].as_integer();
-        auto userId = tweetJson["userId"].as_integer();
-        *this = Tweet(content, tweetId, userId);
+        m_content = tweetJson["content"].as_string();
+        m_tweetId = tweetJson["tweetId"].as_integer();
+        m_userId = tweetJson["userId"].as_integer();
+    }
+
+    /*
+     * @brief View a binary serialized tweet without copying the content.
+     * @param serializedTweet Serialized tweet.
+     * @param view Output view, points into serializedTweet.
+     * @return False if the tweet is not binary or malformed.
+     */
+    static bool View(const std::string_view serializedTweet, TweetView &view)
+    {
+        // Validate the sizes before reading.
+        if (!isBinary(serializedTweet) || serializedTweet.size() < BINARY_HEADER_SIZE
+            || serializedTweet.size() - BINARY_HEADER_SIZE != getInt32(serializedTweet.data() + 9))
+        {
+            return false;
+        }
+        view.tweetId = static_cast<int32_t>(getInt32(serializedTweet.data() + 1));
+        view.userId = static_cast<int32_t>(getInt32(serializedTweet.data() + 5));
+        view.content = serializedTweet.substr(BINARY_HEADER_SIZE);
+        return true;
+    }
+
+    /*
+     * @brief Read the tweet ID of a serialized tweet without parsing the whole object.
+     *        Falls back to the full parse if the ID is not found in compact form.
+     * @param serializedTweet Serialized tweet.
+     * @return Tweet ID, INVALID_TWEET_ID if the tweet is malformed.
+     */
+    static int PeekTweetId(const std::string_view serializedTweet)
+    {
+        // Fixed position in the binary encoding, validated as View does so that a tweet the
+        // merge selects is never dropped when the response is written.
+        if (isBinary(serializedTweet))
+        {
+            TweetView view;
+            return View(serializedTweet, view) ? view.tweetId : INVALID_TWEET_ID;
+        }
+
+        // Keys are unique and quotes in the content are escaped, so the first match is the key.
+        static constexpr std::string_view key = "\"tweetId\":";
+        auto position = serializedTweet.find(key);
+        if (position != std::string_view::npos)
+        {
+            const char *begin = serializedTweet.data() + position + key.size();
+            const char *end = serializedTweet.data() + serializedTweet.size();
+            int tweetId = 0;
+            auto result = std::from_chars(begin, end, tweetId);
+            if (result.ec == std::errc() && result.ptr != end && (*result.ptr == ',' || *result.ptr == '}'))
+            {
+                return tweetId;
+            }
+        }
+
+        try
+        {
+            return Tweet(std::string(serializedTweet)).GetTweetId();
+        }
+        catch (...)
+        {
+            return INVALID_TWEET_ID;
+        }
+    }
+
+    /*
+     * @brief Append a serialized tweet to a JSON document without building a JSON value.
+     *        Binary tweets are written from their fields, legacy JSON tweets in the fixed layout
+     *        are copied as is, other legacy JSON tweets are parsed and written from their fields.
+     *        The keys are in the order of GetJson().serialize().
+     * @param serializedTweet Serialized tweet.
+     * @param output Output buffer.
+     * @return False if the tweet is malformed, nothing is appended then.
+     */
+    static bool AppendJson(const std::string_view serializedTweet, std::string &output)
+    {
+        if (!isBinary(serializedTweet))
+        {
+            int tweetId = 0;
+            int userId = 0;
+            std::string_view content;
+            if (parseFixedJson(serializedTweet, tweetId, userId, content))
+            {
+                output.append(serializedTweet);
+                return true;
+            }
+
+            try
+            {
+                Tweet tweet{std::string(serializedTweet)};
+                appendFields(output, tweet.m_content, tweet.m_tweetId, tweet.m_userId);
+                return true;
+            }
+            catch (...)
+            {
+                return false;
+            }
+        }
+
+        TweetView view;
+        if (!View(serializedTweet, view))
+        {
+            return false;
+        }
+
+        appendFields(output, view.content, view.tweetId, view.userId);
+        return true;
+    }
+
+    /*
+     * @brief Expected size of the JSON form of a serialized tweet, to pre-size buffers.
+     * @param serializedTweet Serialized tweet.
+     * @return Bytes, exact unless the content needs escaping.
+     */
+    static size_t JsonSizeHint(const std::string_view serializedTweet)
+    {
+        // Keys, quotes and two integers of at most 11 characters.
+        return (isBinary(serializedTweet) && serializedTweet.size() >= BINARY_HEADER_SIZE)
+                   ? serializedTweet.size() - BINARY_HEADER_SIZE + 60
+                   : serializedTweet.size();
     }
 
     /*
      * @brief Getter for Content.
      * @return Content string.
      */
-    std::string GetContent() const
+    const std::string &GetContent() const
     {
         return m_content;
     }
@@ -101,6 +482,22 @@ public:
         return tweetJson;
     }
 
+    /*
+     * @brief Serialize in the compact binary encoding, used to store tweets.
+     * @return Binary string.
+     */
+    std::string Serialize() const
+    {
+        std::string serializedTweet;
+        serializedTweet.reserve(BINARY_HEADER_SIZE + m_content.size());
+        serializedTweet.push_back(static_cast<char>(BINARY_VERSION));
+        putInt32(serializedTweet, static_cast<uint32_t>(m_tweetId));
+        putInt32(serializedTweet, static_cast<uint32_t>(m_userId));
+        putInt32(serializedTweet, static_cast<uint32_t>(m_content.size()));
+        serializedTweet.append(m_content);
+        return serializedTweet;
+    }
+
     /*
      * @brief Less operator for std::less
      * @return True if smaller than other.
@@ -30,8 +30,15 @@
 
 #include "Tweet.h"
 #include "IDatastore.h"
+#include "TimelineAPI.h"
+#include "TweetIdAllocator.h"
+#include "RequestTrace.h"
+#include "WriteBehindQueue.h"
 #include <iostream>
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 class TweetAPI
 {
@@ -39,33 +46,204 @@ private:
     // Datastore object.
     std::shared_ptr<IDatastore> m_spDatastore;
 
+    // Timeline service to deliver new tweets, optional.
+    std::shared_ptr<TimelineAPI> m_spTimelineApi;
+
+    // Source of the tweet IDs.
+    std::shared_ptr<TweetIdAllocator> m_spIdAllocator;
+
+    // Write-behind stage, optional.
+    std::shared_ptr<WriteBehindQueue> m_spWriteQueue;
+
 public:
     /*
      * @brief Constructor of TweetAPI, Lazy connection.
      * @param spDatastore Dependency injection for Datastore.
+     * @param spTimelineApi Timeline service for fan-out-on-write, optional.
+     * @param idBlockSize Number of tweet IDs leased from the datastore at once.
+     * @param spWriteQueue Write-behind stage for the tweets, nullptr to write directly.
      */
-    TweetAPI(std::shared_ptr<IDatastore> spDatastore)
-        : m_spDatastore(spDatastore) { }
+    TweetAPI(std::shared_ptr<IDatastore> spDatastore, std::shared_ptr<TimelineAPI> spTimelineApi = nullptr,
+             const int idBlockSize = 1, std::shared_ptr<WriteBehindQueue> spWriteQueue = nullptr)
+        : m_spDatastore(spDatastore), m_spTimelineApi(spTimelineApi),
+          m_spIdAllocator(std::make_shared<TweetIdAllocator>(spDatastore, idBlockSize)), m_spWriteQueue(spWriteQueue) { }
 
-    bool AddTweet(const std::string &content, const int userId)
+    /*
+     * @brief Post a new tweet without blocking.
+     * @param content The text of the tweet.
+     * @param userId Author of the tweet.
+     * @param spTrace Trace of the request, collects the time of each stage, optional.
+     * @return Task, true on success.
+     */
+    pplx::task<bool> AddTweetAsync(const std::string &content, const int userId, std::shared_ptr<RequestTrace> spTrace = nullptr)
     {
         if (!m_spDatastore->IsConnected() && m_spDatastore->Connect() == false)
         {
-            return false;
+            return pplx::task_from_result(false);
         }
 
-        // Obtain unique tweet Id.
-        auto tweetId = m_spDatastore->GetUniqueNumber();
-        if (tweetId == -1)
+        // Obtain unique tweet Id, usually from the leased block without a round-trip.
+        auto spDatastore = m_spDatastore;
+        auto spTimelineApi = m_spTimelineApi;
+        auto spWriteQueue = m_spWriteQueue;
+        return RequestTrace::MeasureAsync(spTrace, "id", [this]() { return m_spIdAllocator->NextAsync(); })
+            .then([spDatastore, spTimelineApi, spWriteQueue, content, userId, spTrace](int tweetId) {
+                if (tweetId == -1)
+                {
+                    return pplx::task_from_result(false);
+                }
+
+                // Create new tweet object and serialize.
+                auto tweetAsString = Tweet(content, tweetId, userId).Serialize();
+
+                // Send to the datastore, or queue for the next group commit.
+                bool queued = true;
+                auto stored = RequestTrace::MeasureAsync(spTrace, "store", [&]() {
+                    if (!spWriteQueue)
+                    {
+                        return spDatastore->AddTweetAsync(userId, tweetAsString);
+                    }
+                    pplx::task<bool> committed;
+                    queued = spWriteQueue->AddTweet(userId, tweetAsString, committed);
+                    return queued ? committed : pplx::task_from_result(false);
+                });
+                if (!queued)
+                {
+                    return pplx::task_from_result(false);
+                }
+
+                auto delivered = stored.then([spTimelineApi, tweetAsString, userId, spTrace](bool success) {
+                    // Deliver to the timelines of the followers.
+                    if (success == false || !spTimelineApi)
+                    {
+                        return pplx::task_from_result(success);
+                    }
+                    return RequestTrace::MeasureAsync(spTrace, "fanout", [&]() {
+                        return spTimelineApi->FanOutAsync(userId, tweetAsString);
+                    });
+                });
+
+                // Queued is enough for ack-on-enqueue, the delivery follows the commit.
+                if (spWriteQueue && spWriteQueue->GetAck() == WriteAck::OnEnqueue)
+                {
+                    return pplx::task_from_result(true);
+                }
+                return delivered;
+            });
+    }
+
+    /*
+     * @brief Post several tweets without blocking. The IDs are consecutive from the same allocator
+     *        as single posts, the tweets are stored with one round-trip or queued like single posts.
+     * @param tweets Author and content of each tweet.
+     * @param spTweetIds Output vector, ID of each posted tweet, -1 for a failed one.
+     * @return Task, true if all tweets are posted.
+     */
+    pplx::task<bool> AddTweetsAsync(const std::vector<std::pair<int, std::string>> &tweets,
+                                    std::shared_ptr<std::vector<int>> spTweetIds)
+    {
+        spTweetIds->assign(tweets.size(), -1);
+        if (tweets.empty())
+        {
+            return pplx::task_from_result(true);
+        }
+        if (!m_spDatastore->IsConnected() && m_spDatastore->Connect() == false)
         {
-            return false;
+            return pplx::task_from_result(false);
         }
 
-        // Create new tweet object and serialize.
-        auto tweetAsString = Tweet(content, tweetId, userId).GetJson().serialize();
+        // Take consecutive IDs for the whole batch.
+        auto spDatastore = m_spDatastore;
+        auto spTimelineApi = m_spTimelineApi;
+        auto spWriteQueue = m_spWriteQueue;
+        return m_spIdAllocator->NextBlockAsync(static_cast<int>(tweets.size()))
+            .then([spDatastore, spTimelineApi, spWriteQueue, tweets, spTweetIds](int firstId) {
+                if (firstId == -1)
+                {
+                    return pplx::task_from_result(false);
+                }
+
+                // Create the tweets in order, IDs ascending.
+                auto spTweetsAsString = std::make_shared<std::vector<std::pair<int, std::string>>>();
+                spTweetsAsString->reserve(tweets.size());
+                for (size_t i = 0; i < tweets.size(); ++i)
+                {
+                    int userId = tweets[i].first;
+                    spTweetsAsString->emplace_back(userId, Tweet(tweets[i].second, firstId + static_cast<int>(i), userId).Serialize());
+                }
+
+                // Send to the datastore in one pipeline, or queue each for the next group commit.
+                pplx::task<std::vector<bool>> stored;
+                std::vector<bool> queued(tweets.size(), false);
+                if (!spWriteQueue)
+                {
+                    auto spResults = std::make_shared<std::vector<bool>>();
+                    stored = spDatastore->AddTweetsAsync(*spTweetsAsString, spResults)
+                                 .then([spResults, count = tweets.size()](bool) {
+                                     spResults->resize(count, false);
+                                     return *spResults;
+                                 });
+                }
+                else
+                {
+                    std::vector<pplx::task<bool>> commits;
+                    for (size_t i = 0; i < spTweetsAsString->size(); ++i)
+                    {
+                        const auto &tweet = (*spTweetsAsString)[i];
+                        pplx::task<bool> committed;
+                        queued[i] = spWriteQueue->AddTweet(tweet.first, tweet.second, committed);
+                        commits.push_back(queued[i] ? committed : pplx::task_from_result(false));
+                    }
+                    stored = pplx::when_all(commits.begin(), commits.end());
+                }
+
+                // Deliver the stored tweets to the timelines of the followers in parallel.
+                auto delivered = stored.then([spTimelineApi, spTweetsAsString](std::vector<bool> results) {
+                    std::vector<pplx::task<bool>> deliveries;
+                    for (size_t i = 0; i < results.size(); ++i)
+                    {
+                        const auto &tweet = (*spTweetsAsString)[i];
+                        if (results[i] == false || !spTimelineApi)
+                        {
+                            deliveries.push_back(pplx::task_from_result(static_cast<bool>(results[i])));
+                        }
+                        else
+                        {
+                            deliveries.push_back(spTimelineApi->FanOutAsync(tweet.first, tweet.second));
+                        }
+                    }
+                    return pplx::when_all(deliveries.begin(), deliveries.end());
+                });
 
-        // Send to the datastore.
-        return m_spDatastore->AddTweet(userId, tweetAsString);
+                // Report the IDs of the posted tweets.
+                auto report = [spTweetIds, firstId](const std::vector<bool> &posted) {
+                    bool allPosted = true;
+                    for (size_t i = 0; i < posted.size(); ++i)
+                    {
+                        (*spTweetIds)[i] = posted[i] ? firstId + static_cast<int>(i) : -1;
+                        allPosted = allPosted && posted[i];
+                    }
+                    return allPosted;
+                };
+
+                // Queued is enough for ack-on-enqueue, the delivery follows the commit.
+                if (spWriteQueue && spWriteQueue->GetAck() == WriteAck::OnEnqueue)
+                {
+                    return pplx::task_from_result(report(queued));
+                }
+                return delivered.then(report);
+            });
+    }
+
+    /*
+     * @brief Post a new tweet.
+     * @param content The text of the tweet.
+     * @param userId Author of the tweet.
+     * @return True on success.
+     */
+    bool AddTweet(const std::string &content, const int userId)
+    {
+        return AddTweetAsync(content, userId).get();
     }
 };
 
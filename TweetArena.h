@@ -0,0 +1,138 @@
+/**
+ * @file      TweetArena.h
+ * @author    Atakan S.
+ * @version   1.0
+ * @brief     Per-request owner of the serialized tweets read from the datastore.
+ *
+ * @copyright Copyright (c) 2020 Atakan SARIOGLU ~ www.atakansarioglu.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _H_TWEETARENA_H_
+#define _H_TWEETARENA_H_
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*
+ * @brief Serialized tweets of one request back to back in one buffer, read through string views.
+ *        The tweets are copied in once. Whether reading them from the datastore allocates per tweet
+ *        depends on the datastore, the in-process one copies straight from its lists, the Redis
+ *        client parses every reply element into its own string first.
+ */
+class TweetArena
+{
+private:
+    // Bytes of all tweet lists back to back.
+    std::string m_bytes;
+
+    // Offset and size of each tweet in m_bytes.
+    std::vector<std::pair<size_t, size_t>> m_spans;
+
+    // Index past the last span of each closed list.
+    std::vector<size_t> m_listEnds;
+
+public:
+    /*
+     * @brief Reserve the storage up front, so filling it does not reallocate.
+     * @param bytes Total size of the tweets.
+     * @param tweets Number of tweets.
+     * @param lists Number of lists.
+     */
+    void Reserve(const size_t bytes, const size_t tweets, const size_t lists)
+    {
+        m_bytes.reserve(bytes);
+        m_spans.reserve(tweets);
+        m_listEnds.reserve(lists);
+    }
+
+    /*
+     * @brief Copy a serialized tweet to the end of the open list.
+     * @param serializedTweet Serialized tweet.
+     */
+    void Append(const std::string_view serializedTweet)
+    {
+        m_spans.emplace_back(m_bytes.size(), serializedTweet.size());
+        m_bytes.append(serializedTweet);
+    }
+
+    /*
+     * @brief Close the open list, the following tweets go to the next list.
+     */
+    void EndList()
+    {
+        m_listEnds.push_back(m_spans.size());
+    }
+
+    /*
+     * @brief Getter for the number of closed lists.
+     * @return Lists
+     */
+    size_t ListCount() const
+    {
+        return m_listEnds.size();
+    }
+
+    /*
+     * @brief Getter for the total size of the tweets.
+     * @return Bytes
+     */
+    size_t Bytes() const
+    {
+        return m_bytes.size();
+    }
+
+    /*
+     * @brief Getter for the number of tweets in a list.
+     * @param list Index of the list.
+     * @return Tweets
+     */
+    size_t ListSize(const size_t list) const
+    {
+        return m_listEnds[list] - (list > 0 ? m_listEnds[list - 1] : 0);
+    }
+
+    /*
+     * @brief View a tweet, valid until the next Append.
+     * @param list Index of the list.
+     * @param position Index in the list.
+     * @return Serialized tweet.
+     */
+    std::string_view At(const size_t list, const size_t position) const
+    {
+        const auto &span = m_spans[(list > 0 ? m_listEnds[list - 1] : 0) + position];
+        return std::string_view(m_bytes.data() + span.first, span.second);
+    }
+
+    /*
+     * @brief Drop all lists, the storage is kept for reuse.
+     */
+    void Clear()
+    {
+        m_bytes.clear();
+        m_spans.clear();
+        m_listEnds.clear();
+    }
+};
+
+#endif
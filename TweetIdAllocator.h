@@ -0,0 +1,147 @@
+/**
+ * @file      TweetIdAllocator.h
+ * @author    Atakan S.
+ * @version   1.0
+ * @brief     Tweet ID allocator leasing blocks of IDs from the datastore.
+ *
+ * @copyright Copyright (c) 2020 Atakan SARIOGLU ~ www.atakansarioglu.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _H_TWEETIDALLOCATOR_H_
+#define _H_TWEETIDALLOCATOR_H_
+
+#include "IDatastore.h"
+#include <pplx/pplxtasks.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+class TweetIdAllocator
+{
+private:
+    // Datastore object.
+    std::shared_ptr<IDatastore> m_spDatastore;
+
+    // Number of IDs leased at once.
+    int m_blockSize;
+
+    // Leased block, m_next up to m_end exclusive.
+    int m_next;
+    int m_end;
+
+    // Lease in flight, shared by all callers waiting for the next block.
+    bool m_leasing;
+    pplx::task<bool> m_lease;
+    std::mutex m_mutex;
+
+public:
+    /*
+     * @brief Constructor of TweetIdAllocator, no lease until the first ID is requested.
+     *        IDs are increasing within a process. With several processes each leases its
+     *        own block, so a smaller block keeps the IDs closer to the posting order.
+     * @param spDatastore Dependency injection for Datastore.
+     * @param blockSize Number of IDs leased with one round-trip, 1 to lease every ID.
+     */
+    TweetIdAllocator(std::shared_ptr<IDatastore> spDatastore, const int blockSize = 1000)
+        : m_spDatastore(spDatastore), m_blockSize(blockSize > 0 ? blockSize : 1),
+          m_next(0), m_end(0), m_leasing(false) {}
+
+    /*
+     * @brief Get the next unique increasing ID, leases a new block if needed.
+     * @return Task with the ID, -1 on error.
+     */
+    pplx::task<int> NextAsync()
+    {
+        return NextBlockAsync(1);
+    }
+
+    /*
+     * @brief Get consecutive unique increasing IDs, leases a new block if the rest of the current one is too short.
+     *        The rest is dropped then, so the IDs handed out later are still greater.
+     * @param count Number of IDs.
+     * @return Task with the first ID, -1 on error.
+     */
+    pplx::task<int> NextBlockAsync(const int count)
+    {
+        pplx::task_completion_event<bool> leased;
+        int leaseSize = 0;
+        pplx::task<bool> lease;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_end - m_next >= count)
+            {
+                int first = m_next;
+                m_next += count;
+                return pplx::task_from_result(first);
+            }
+
+            // Only the first caller leases, the others wait for the same block.
+            if (!m_leasing)
+            {
+                m_leasing = true;
+                m_lease = pplx::create_task(leased);
+                leaseSize = std::max(m_blockSize, count);
+            }
+            lease = m_lease;
+        }
+
+        if (leaseSize > 0)
+        {
+            m_spDatastore->ReserveUniqueNumbersAsync(leaseSize).then([this, leased, leaseSize](pplx::task<int> reserveTask) {
+                int last = -1;
+                try
+                {
+                    last = reserveTask.get();
+                }
+                catch (...)
+                {
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_leasing = false;
+                    if (last != -1)
+                    {
+                        m_next = last - leaseSize + 1;
+                        m_end = last + 1;
+                    }
+                }
+                leased.set(last != -1);
+            });
+        }
+
+        // Take the IDs from the new block, or lease again if others drained it first.
+        return lease.then([this, count](bool success) {
+            return success ? NextBlockAsync(count) : pplx::task_from_result(-1);
+        });
+    }
+
+    /*
+     * @brief Get the next unique increasing ID.
+     * @return Non-negative unique ID on success, -1 on error.
+     */
+    int Next()
+    {
+        return NextAsync().get();
+    }
+};
+
+#endif
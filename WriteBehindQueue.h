@@ -0,0 +1,302 @@
+/**
+ * @file      WriteBehindQueue.h
+ * @author    Atakan S.
+ * @version   1.0
+ * @brief     Write-behind stage committing tweet and follow writes in groups.
+ *
+ * @copyright Copyright (c) 2020 Atakan SARIOGLU ~ www.atakansarioglu.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _H_WRITEBEHINDQUEUE_H_
+#define _H_WRITEBEHINDQUEUE_H_
+
+#include "IDatastore.h"
+#include <pplx/pplxtasks.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*
+ * @brief When a queued write is acknowledged to the client.
+ *        OnEnqueue replies once the write is queued, a read right after may not see it.
+ *        OnCommit replies once the write is committed to the datastore.
+ */
+enum class WriteAck
+{
+    OnEnqueue,
+    OnCommit
+};
+
+class WriteBehindQueue
+{
+private:
+    // Kind of a queued write.
+    enum class WriteType
+    {
+        AddTweet,
+        AddFollowee,
+        DelFollowee
+    };
+
+    // One queued write, the completion event is set when the write is committed.
+    struct Write
+    {
+        WriteType type;
+        int userId;
+        int otherId;
+        std::string tweetAsString;
+        pplx::task_completion_event<bool> committed;
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    // Datastore object.
+    std::shared_ptr<IDatastore> m_spDatastore;
+
+    WriteAck m_ack;
+    size_t m_maxBatch;
+    std::chrono::duration<double> m_maxDelay;
+    size_t m_capacity;
+
+    // Writes in arrival order, the single flusher commits batch after batch so the
+    // writes of each user are committed in the order they were queued.
+    std::deque<Write> m_writes;
+    bool m_stopping;
+    std::mutex m_mutex;
+    std::condition_variable m_queued;
+    std::thread m_flusher;
+
+    /*
+     * @brief Queue a write.
+     * @param write Write to queue.
+     * @param committed Output task, true once the write is committed.
+     * @return False if the queue is full or stopped.
+     */
+    bool enqueue(Write write, pplx::task<bool> &committed)
+    {
+        committed = pplx::create_task(write.committed);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stopping || m_writes.size() >= m_capacity)
+            {
+                return false;
+            }
+            write.queued = std::chrono::steady_clock::now();
+            m_writes.push_back(std::move(write));
+        }
+        m_queued.notify_one();
+        return true;
+    }
+
+    /*
+     * @brief Commit a batch, consecutive tweets go to the datastore in one pipeline.
+     * @param batch Writes in arrival order.
+     */
+    void commit(std::vector<Write> &batch)
+    {
+        bool connected = m_spDatastore->IsConnected() || m_spDatastore->Connect();
+
+        size_t i = 0;
+        while (i < batch.size())
+        {
+            // Run of tweets.
+            size_t end = i;
+            std::vector<std::pair<int, std::string>> tweets;
+            while (end < batch.size() && batch[end].type == WriteType::AddTweet)
+            {
+                tweets.emplace_back(batch[end].userId, std::move(batch[end].tweetAsString));
+                ++end;
+            }
+
+            if (!tweets.empty())
+            {
+                auto spResults = std::make_shared<std::vector<bool>>();
+                try
+                {
+                    if (connected)
+                    {
+                        m_spDatastore->AddTweetsAsync(tweets, spResults).wait();
+                    }
+                }
+                catch (...)
+                {
+                    spResults->clear();
+                }
+                for (size_t j = i; j < end; ++j)
+                {
+                    batch[j].committed.set((j - i) < spResults->size() && (*spResults)[j - i]);
+                }
+                i = end;
+                continue;
+            }
+
+            // Follow writes in order, a follow and unfollow of the same pair must not swap.
+            bool success = false;
+            try
+            {
+                if (connected)
+                {
+                    auto &write = batch[i];
+                    success = (write.type == WriteType::AddFollowee)
+                                  ? m_spDatastore->AddFolloweeAsync(write.userId, write.otherId).get()
+                                  : m_spDatastore->DelFolloweeAsync(write.userId, write.otherId).get();
+                }
+            }
+            catch (...)
+            {
+            }
+            batch[i].committed.set(success);
+            ++i;
+        }
+    }
+
+    /*
+     * @brief Flusher loop, commits when the batch is full or the oldest write waited long enough.
+     *        Drains the queue before it returns.
+     */
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            m_queued.wait(lock, [this] { return m_stopping || !m_writes.empty(); });
+            if (m_writes.empty())
+            {
+                return;
+            }
+
+            // Let the batch grow up to the max delay.
+            auto deadline = m_writes.front().queued + std::chrono::duration_cast<std::chrono::steady_clock::duration>(m_maxDelay);
+            m_queued.wait_until(lock, deadline, [this] { return m_stopping || m_writes.size() >= m_maxBatch; });
+
+            std::vector<Write> batch;
+            size_t count = std::min(m_writes.size(), m_maxBatch);
+            batch.reserve(count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                batch.push_back(std::move(m_writes.front()));
+                m_writes.pop_front();
+            }
+
+            // Producers keep queueing while the batch is committed.
+            lock.unlock();
+            commit(batch);
+            lock.lock();
+        }
+    }
+
+public:
+    /*
+     * @brief Constructor of the queue, starts the flusher.
+     * @param spDatastore Dependency injection for Datastore.
+     * @param ack When the writes are acknowledged.
+     * @param maxBatch Max number of writes committed together.
+     * @param maxDelay Max seconds a write waits for the batch to fill.
+     * @param capacity Max number of queued writes, further writes are rejected.
+     */
+    WriteBehindQueue(std::shared_ptr<IDatastore> spDatastore, const WriteAck ack = WriteAck::OnCommit,
+                     const size_t maxBatch = 256, const double maxDelay = 0.005, const size_t capacity = 65536)
+        : m_spDatastore(spDatastore), m_ack(ack), m_maxBatch(maxBatch > 0 ? maxBatch : 1), m_maxDelay(maxDelay),
+          m_capacity(capacity), m_stopping(false)
+    {
+        m_flusher = std::thread(&WriteBehindQueue::flush, this);
+    }
+
+    WriteBehindQueue(const WriteBehindQueue &) = delete;
+    WriteBehindQueue &operator=(const WriteBehindQueue &) = delete;
+
+    /*
+     * @brief Getter for the acknowledgement mode.
+     * @return Ack mode.
+     */
+    WriteAck GetAck() const
+    {
+        return m_ack;
+    }
+
+    /*
+     * @brief Queue a new tweet.
+     * @param userId Author of the tweet.
+     * @param tweetAsString Serialized tweet.
+     * @param committed Output task, true once the tweet is committed.
+     * @return False if the queue is full or stopped.
+     */
+    bool AddTweet(const int userId, const std::string &tweetAsString, pplx::task<bool> &committed)
+    {
+        return enqueue({WriteType::AddTweet, userId, -1, tweetAsString, {}, {}}, committed);
+    }
+
+    /*
+     * @brief Queue a follow.
+     * @param userId follower
+     * @param followeeId followee
+     * @param committed Output task, true once the follow is committed.
+     * @return False if the queue is full or stopped.
+     */
+    bool AddFollowee(const int userId, const int followeeId, pplx::task<bool> &committed)
+    {
+        return enqueue({WriteType::AddFollowee, userId, followeeId, std::string(), {}, {}}, committed);
+    }
+
+    /*
+     * @brief Queue an unfollow.
+     * @param userId follower
+     * @param followeeId followee
+     * @param committed Output task, true once the unfollow is committed.
+     * @return False if the queue is full or stopped.
+     */
+    bool DelFollowee(const int userId, const int followeeId, pplx::task<bool> &committed)
+    {
+        return enqueue({WriteType::DelFollowee, userId, followeeId, std::string(), {}, {}}, committed);
+    }
+
+    /*
+     * @brief Stop accepting writes, commit the queued ones and join the flusher.
+     */
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_queued.notify_one();
+        if (m_flusher.joinable())
+        {
+            m_flusher.join();
+        }
+    }
+
+    /*
+     * @brief Destructor. Commit the queued writes.
+     */
+    ~WriteBehindQueue()
+    {
+        Stop();
+    }
+};
+
+#endif
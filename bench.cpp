@@ -0,0 +1,346 @@
+/**
+ * @file      bench.cpp
+ * @author    Atakan S.
+ * @version   1.0
+ * @brief     Micro benchmarks of the BabyBird hot paths.
+ *
+ * @copyright Copyright (c) 2020 Atakan SARIOGLU ~ www.atakansarioglu.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#include "Tweet.h"
+#include "TweetArena.h"
+#include "TimelineAPI.h"
+#include "TimelineCache.h"
+#include "InMemoryDatastore.h"
+#include <cpprest/json.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Keeps the compiler from dropping the measured work.
+static volatile size_t g_sink = 0;
+
+// Number of heap allocations made by the process so far.
+static std::atomic<size_t> g_allocations(0);
+
+// Print one JSON object per line instead of the text table.
+static bool g_json = false;
+
+// Only run the benchmarks whose name starts with this.
+static std::string g_filter;
+
+void *operator new(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(size ? size : 1))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+/*
+ * @brief Run a benchmark and print the time and the heap allocations per operation
+ *        and the throughput.
+ * @param name Benchmark name.
+ * @param iterations Number of operations.
+ * @param operation Operation to measure, returns a value folded into the sink.
+ */
+static void run(const std::string &name, const size_t iterations, const std::function<size_t()> &operation)
+{
+    if (name.compare(0, g_filter.size(), g_filter) != 0)
+    {
+        return;
+    }
+
+    // Warm up.
+    for (size_t i = 0; i < iterations / 10 + 1; ++i)
+    {
+        g_sink = g_sink + operation();
+    }
+
+    size_t allocations = g_allocations.load(std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        g_sink = g_sink + operation();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    allocations = g_allocations.load(std::memory_order_relaxed) - allocations;
+
+    double nsPerOp = elapsed.count() / iterations;
+    double allocsPerOp = static_cast<double>(allocations) / iterations;
+    double opsPerSec = nsPerOp > 0 ? 1e9 / nsPerOp : 0;
+    if (g_json)
+    {
+        std::cout << "{\"name\":\"" << name << "\",\"iterations\":" << iterations << ",\"ns_per_op\":" << nsPerOp
+                  << ",\"allocs_per_op\":" << allocsPerOp << ",\"ops_per_sec\":" << opsPerSec << "}" << std::endl;
+    }
+    else
+    {
+        std::cout << name << " " << nsPerOp << " ns/op " << allocsPerOp << " allocs/op " << opsPerSec << " ops/s"
+                  << std::endl;
+    }
+}
+
+/*
+ * @brief Create a tweet content of a given size, plain text like most tweets.
+ * @param size Number of characters.
+ * @return Content
+ */
+static std::string makeContent(const size_t size)
+{
+    static const std::string words = "the quick brown fox jumps over the lazy dog while birds sing ";
+    std::string content;
+    while (content.size() < size)
+    {
+        content.append(words);
+    }
+    content.resize(size);
+    return content;
+}
+
+/*
+ * @brief Tweet deserialization, the generic JSON parser against the fixed layout parser
+ *        and the binary encoding.
+ */
+static void benchTweetParse()
+{
+    for (size_t size : {40, 140, 280})
+    {
+        Tweet tweet(makeContent(size), 123456789, 4242);
+        std::string json = tweet.GetJson().serialize();
+        std::string binary = tweet.Serialize();
+        std::string suffix = "_" + std::to_string(size);
+
+        run("tweet_parse_generic" + suffix, 200000, [&json]() {
+            auto tweetJson = web::json::value::parse(json);
+            return tweetJson["content"].as_string().size() + tweetJson["tweetId"].as_integer() + tweetJson["userId"].as_integer();
+        });
+        run("tweet_parse_fixed" + suffix, 200000, [&json]() {
+            Tweet parsed(json);
+            return parsed.GetContent().size() + parsed.GetTweetId();
+        });
+        run("tweet_parse_binary" + suffix, 200000, [&binary]() {
+            Tweet parsed(binary);
+            return parsed.GetContent().size() + parsed.GetTweetId();
+        });
+    }
+}
+
+/*
+ * @brief Tweet serialization, the binary encoding that is stored, the generic JSON
+ *        serializer and the JSON written straight from the stored bytes.
+ */
+static void benchTweetSerialize()
+{
+    for (size_t size : {40, 140, 280})
+    {
+        Tweet tweet(makeContent(size), 123456789, 4242);
+        std::string binary = tweet.Serialize();
+        std::string suffix = "_" + std::to_string(size);
+
+        run("tweet_serialize_binary" + suffix, 200000, [&tweet]() {
+            return tweet.Serialize().size();
+        });
+        run("tweet_serialize_generic" + suffix, 200000, [&tweet]() {
+            return tweet.GetJson().serialize().size();
+        });
+        run("tweet_serialize_stored" + suffix, 200000, [&binary]() {
+            std::string json;
+            json.reserve(Tweet::JsonSizeHint(binary));
+            Tweet::AppendJson(binary, json);
+            return json.size();
+        });
+    }
+}
+
+/*
+ * @brief Access to the private building blocks of TimelineAPI.
+ */
+class TimelineBench
+{
+private:
+    /*
+     * @brief Fill an arena with the tweet lists of the followees, the tweets of all
+     *        followees interleave in time like on a real timeline.
+     * @param arena Arena to fill.
+     * @param followCount Number of followees, i.e. lists.
+     * @param tweetCount Number of tweets of each followee.
+     */
+    static void fillArena(TweetArena &arena, const int followCount, const int tweetCount)
+    {
+        std::string content = makeContent(140);
+        arena.Reserve(static_cast<size_t>(followCount) * tweetCount * (content.size() + 16),
+                      static_cast<size_t>(followCount) * tweetCount, followCount);
+        for (int list = 0; list < followCount; ++list)
+        {
+            for (int position = 0; position < tweetCount; ++position)
+            {
+                int tweetId = (tweetCount - position) * followCount + list;
+                arena.Append(Tweet(content, tweetId, list).Serialize());
+            }
+            arena.EndList();
+        }
+    }
+
+public:
+    /*
+     * @brief The k-way merge over varied follow and tweet counts.
+     */
+    static void CreateTimeline()
+    {
+        TimelineAPI timelineApi(nullptr);
+        for (int followCount : {10, 100, 1000})
+        {
+            for (int tweetCount : {10, 100})
+            {
+                TweetArena arena;
+                fillArena(arena, followCount, tweetCount);
+                std::string suffix = "_f" + std::to_string(followCount) + "_t" + std::to_string(tweetCount);
+
+                run("create_timeline" + suffix, 1000000 / followCount, [&timelineApi, &arena]() {
+                    return timelineApi.createTimeline(arena, 10).size();
+                });
+            }
+        }
+    }
+
+    /*
+     * @brief The response body of timelines of varied lengths.
+     */
+    static void CreateResponse()
+    {
+        TimelineAPI timelineApi(nullptr);
+        for (int maxTweets : {10, 100})
+        {
+            TweetArena arena;
+            fillArena(arena, 10, maxTweets);
+            auto timeline = timelineApi.createTimeline(arena, maxTweets);
+
+            run("create_response_" + std::to_string(maxTweets), 1000000 / maxTweets, [&timelineApi, &timeline]() {
+                return timelineApi.createResponse(timeline).size();
+            });
+        }
+    }
+
+    /*
+     * @brief Fan-out-on-read timeline of a user against the in-process datastore,
+     *        with and without the response cache.
+     */
+    static void GetTimeline()
+    {
+        for (int followCount : {10, 100, 1000})
+        {
+            auto spDatastore = std::make_shared<InMemoryDatastore>();
+            spDatastore->Connect();
+
+            // User 0 follows users 1 to followCount, which tweet in turns.
+            std::string content = makeContent(140);
+            int tweetId = 0;
+            for (int round = 0; round < 10; ++round)
+            {
+                for (int userId = 1; userId <= followCount; ++userId)
+                {
+                    spDatastore->AddTweet(userId, Tweet(content, ++tweetId, userId).Serialize());
+                }
+            }
+            for (int userId = 1; userId <= followCount; ++userId)
+            {
+                spDatastore->AddFollowee(0, userId);
+            }
+            std::string suffix = "_f" + std::to_string(followCount);
+
+            TimelineAPI uncached(spDatastore);
+            run("get_timeline" + suffix, 100000 / followCount, [&uncached]() {
+                std::string timeline;
+                uncached.GetTimeline(0, timeline);
+                return timeline.size();
+            });
+
+            TimelineAPI cached(spDatastore, TimelineMode::FanOutOnRead, 10000, std::make_shared<TimelineCache>());
+            run("get_timeline_cached" + suffix, 100000, [&cached]() {
+                std::string timeline;
+                cached.GetTimeline(0, timeline);
+                return timeline.size();
+            });
+        }
+    }
+};
+
+/*
+ * @brief Run the benchmarks.
+ *        Usage: babybird_bench [--json] [name prefix]
+ */
+int main(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--json")
+        {
+            g_json = true;
+        }
+        else
+        {
+            g_filter = arg;
+        }
+    }
+
+    benchTweetParse();
+    benchTweetSerialize();
+    TimelineBench::CreateTimeline();
+    TimelineBench::CreateResponse();
+    TimelineBench::GetTimeline();
+    return 0;
+}
@@ -0,0 +1,397 @@
+/**
+ * @file      loadgen.cpp
+ * @author    Atakan S.
+ * @version   1.0
+ * @brief     HTTP load generator of the BabyBird API.
+ *
+ * @copyright Copyright (c) 2020 Atakan SARIOGLU ~ www.atakansarioglu.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a
+ *  copy of this software and associated documentation files (the "Software"),
+ *  to deal in the Software without restriction, including without limitation
+ *  the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ *  and/or sell copies of the Software, and to permit persons to whom the
+ *  Software is furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ *  FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ *  DEALINGS IN THE SOFTWARE.
+ */
+
+#include "LatencyHistogram.h"
+#include <cpprest/http_client.h>
+#include <cpprest/json.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+/*
+ * @brief Settings of a load test, set from the command line.
+ */
+struct LoadSettings
+{
+    std::string url = "http://localhost:8080/api/v1";
+    int users = 10000;
+    int follows = 20;
+    int seedTweets = 1;
+    bool seed = true;
+    int clients = 32;
+    double seconds = 30.0;
+    double tweetRatio = 0.1;
+    double zipf = 1.0;
+    int timeout = 10;
+    uint64_t randomSeed = 1;
+    bool json = false;
+};
+
+/*
+ * @brief Latencies and errors of the requests to an endpoint.
+ */
+struct EndpointStats
+{
+    LatencyHistogram latency;
+    std::atomic<uint64_t> errors{0};
+};
+
+/*
+ * @brief Draws ranks 0..n-1 with a probability proportional to 1/(rank+1)^exponent.
+ */
+class ZipfDistribution
+{
+private:
+    // Cumulative probability of each rank.
+    std::vector<double> m_cdf;
+
+public:
+    /*
+     * @brief Constructor of the distribution.
+     * @param n Number of ranks.
+     * @param exponent Skew, 0 is uniform.
+     */
+    ZipfDistribution(const int n, const double exponent) : m_cdf(n > 0 ? n : 1)
+    {
+        double sum = 0;
+        for (size_t rank = 0; rank < m_cdf.size(); ++rank)
+        {
+            sum += 1.0 / std::pow(static_cast<double>(rank + 1), exponent);
+            m_cdf[rank] = sum;
+        }
+        for (auto &p : m_cdf)
+        {
+            p /= sum;
+        }
+    }
+
+    /*
+     * @brief Draw a rank.
+     * @param random Random number generator.
+     * @return Rank, 0 is the most frequent.
+     */
+    template <typename Random>
+    int operator()(Random &random) const
+    {
+        double p = std::uniform_real_distribution<double>(0.0, 1.0)(random);
+        auto it = std::lower_bound(m_cdf.begin(), m_cdf.end(), p);
+        return static_cast<int>(std::min<size_t>(it - m_cdf.begin(), m_cdf.size() - 1));
+    }
+};
+
+/*
+ * @brief Send a request and count its latency, any status other than 2xx is an error.
+ * @param client HTTP client.
+ * @param method HTTP method.
+ * @param path Path relative to the API URL.
+ * @param body JSON body, null for none.
+ * @param stats Statistics of the endpoint.
+ */
+static void send(web::http::client::http_client &client, const web::http::method &method, const std::string &path,
+                 const web::json::value &body, EndpointStats &stats)
+{
+    auto start = std::chrono::steady_clock::now();
+    bool success = false;
+    try
+    {
+        auto response = body.is_null() ? client.request(method, path).get() : client.request(method, path, body).get();
+        response.extract_string().get();
+        success = (response.status_code() >= 200 && response.status_code() < 300);
+    }
+    catch (...)
+    {
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+    stats.latency.Record(elapsed.count());
+    if (!success)
+    {
+        ++stats.errors;
+    }
+}
+
+/*
+ * @brief Body of a new tweet.
+ * @param userId Author.
+ * @return JSON body.
+ */
+static web::json::value tweetBody(const int userId)
+{
+    auto bodyJson = web::json::value::object();
+    bodyJson["userId"] = web::json::value::number(userId);
+    bodyJson["content"] = web::json::value::string("Load test tweet of user " + std::to_string(userId));
+    return bodyJson;
+}
+
+/*
+ * @brief Run a function on the clients in parallel.
+ * @param settings Settings.
+ * @param work Function of the client index and the HTTP client.
+ */
+template <typename Work>
+static void runClients(const LoadSettings &settings, const Work &work)
+{
+    web::http::client::http_client_config config;
+    config.set_timeout(std::chrono::seconds(settings.timeout));
+
+    std::vector<std::thread> threads;
+    for (int index = 0; index < settings.clients; ++index)
+    {
+        threads.emplace_back([&settings, &config, &work, index]() {
+            web::http::client::http_client client(settings.url, config);
+            work(index, client);
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+}
+
+/*
+ * @brief Print the statistics of an endpoint.
+ * @param settings Settings.
+ * @param name Endpoint name.
+ * @param stats Statistics.
+ * @param seconds Duration of the phase.
+ */
+static void report(const LoadSettings &settings, const std::string &name, const EndpointStats &stats, const double seconds)
+{
+    const auto &latency = stats.latency;
+    double throughput = (seconds > 0) ? latency.Count() / seconds : 0;
+    if (settings.json)
+    {
+        std::cout << "{\"endpoint\":\"" << name << "\",\"requests\":" << latency.Count() << ",\"errors\":" << stats.errors
+                  << ",\"rps\":" << throughput << ",\"p50_us\":" << latency.Percentile(0.5)
+                  << ",\"p99_us\":" << latency.Percentile(0.99) << ",\"p999_us\":" << latency.Percentile(0.999)
+                  << ",\"max_us\":" << latency.Max() << "}" << std::endl;
+    }
+    else
+    {
+        std::cout << name << " requests=" << latency.Count() << " errors=" << stats.errors << " rps=" << throughput
+                  << " p50=" << latency.Percentile(0.5) / 1000.0 << "ms p99=" << latency.Percentile(0.99) / 1000.0
+                  << "ms p999=" << latency.Percentile(0.999) / 1000.0 << "ms max=" << latency.Max() / 1000.0 << "ms"
+                  << std::endl;
+    }
+}
+
+/*
+ * @brief Seed the follow graph and the first tweets. Every user follows the same number of
+ *        users drawn by popularity rank from a Zipf distribution, so the follower counts
+ *        follow a power law: a few celebrities and a long tail of users with few followers.
+ * @param settings Settings.
+ */
+static void seed(const LoadSettings &settings)
+{
+    ZipfDistribution popularity(settings.users, settings.zipf);
+    EndpointStats followStats, tweetStats;
+    auto start = std::chrono::steady_clock::now();
+
+    runClients(settings, [&](const int index, web::http::client::http_client &client) {
+        std::mt19937_64 random(settings.randomSeed * 7919 + index);
+        int follows = std::min(settings.follows, settings.users - 1);
+        for (int userId = 1 + index; userId <= settings.users; userId += settings.clients)
+        {
+            std::unordered_set<int> followees;
+            for (int attempt = 0; static_cast<int>(followees.size()) < follows && attempt < follows * 10; ++attempt)
+            {
+                int followeeId = 1 + popularity(random);
+                if (followeeId != userId && followees.insert(followeeId).second)
+                {
+                    send(client, web::http::methods::PUT,
+                         "/follow/" + std::to_string(userId) + "/" + std::to_string(followeeId),
+                         web::json::value::null(), followStats);
+                }
+            }
+            for (int i = 0; i < settings.seedTweets; ++i)
+            {
+                send(client, web::http::methods::POST, "/tweet", tweetBody(userId), tweetStats);
+            }
+        }
+    });
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    report(settings, "seed_follow", followStats, elapsed.count());
+    report(settings, "seed_tweet", tweetStats, elapsed.count());
+}
+
+/*
+ * @brief Drive the mix of tweets and timeline reads for the configured duration. The active
+ *        users are drawn from a Zipf distribution too, over a shuffled order so the most
+ *        active users are not the most followed ones.
+ * @param settings Settings.
+ */
+static void drive(const LoadSettings &settings)
+{
+    ZipfDistribution activity(settings.users, settings.zipf);
+    std::vector<int> userIds(settings.users);
+    for (int i = 0; i < settings.users; ++i)
+    {
+        userIds[i] = i + 1;
+    }
+    std::mt19937_64 shuffleRandom(settings.randomSeed);
+    std::shuffle(userIds.begin(), userIds.end(), shuffleRandom);
+
+    EndpointStats tweetStats, timelineStats;
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                std::chrono::duration<double>(settings.seconds));
+
+    runClients(settings, [&](const int index, web::http::client::http_client &client) {
+        std::mt19937_64 random(settings.randomSeed * 104729 + index);
+        std::uniform_real_distribution<double> mix(0.0, 1.0);
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            int userId = userIds[activity(random)];
+            if (mix(random) < settings.tweetRatio)
+            {
+                send(client, web::http::methods::POST, "/tweet", tweetBody(userId), tweetStats);
+            }
+            else
+            {
+                send(client, web::http::methods::GET, "/timeline/" + std::to_string(userId), web::json::value::null(),
+                     timelineStats);
+            }
+        }
+    });
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    report(settings, "tweet", tweetStats, elapsed.count());
+    report(settings, "timeline", timelineStats, elapsed.count());
+}
+
+/*
+ * @brief Print the usage.
+ */
+static void usage()
+{
+    std::cout << "Usage: babybird_loadgen [options]\n"
+                 "  --url <url>          API URL, default http://localhost:8080/api/v1\n"
+                 "  --users <n>          Number of users, default 10000\n"
+                 "  --follows <n>        Followees of each user, default 20\n"
+                 "  --seed-tweets <n>    Tweets of each user before the run, default 1\n"
+                 "  --no-seed            Skip seeding, e.g. for a second run on the same data\n"
+                 "  --clients <n>        Concurrent clients, default 32\n"
+                 "  --seconds <s>        Duration of the run, default 30\n"
+                 "  --tweet-ratio <r>    Fraction of requests that post a tweet, default 0.1\n"
+                 "  --zipf <s>           Skew of the followee and user selection, default 1.0\n"
+                 "  --timeout <s>        Request timeout, default 10\n"
+                 "  --random-seed <n>    Seed of the workload, default 1\n"
+                 "  --json               Print one JSON object per endpoint and line"
+              << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    LoadSettings settings;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        try
+        {
+            if (arg == "--url" && hasValue)
+            {
+                settings.url = argv[++i];
+            }
+            else if (arg == "--users" && hasValue)
+            {
+                settings.users = std::stoi(argv[++i]);
+            }
+            else if (arg == "--follows" && hasValue)
+            {
+                settings.follows = std::stoi(argv[++i]);
+            }
+            else if (arg == "--seed-tweets" && hasValue)
+            {
+                settings.seedTweets = std::stoi(argv[++i]);
+            }
+            else if (arg == "--no-seed")
+            {
+                settings.seed = false;
+            }
+            else if (arg == "--clients" && hasValue)
+            {
+                settings.clients = std::stoi(argv[++i]);
+            }
+            else if (arg == "--seconds" && hasValue)
+            {
+                settings.seconds = std::stod(argv[++i]);
+            }
+            else if (arg == "--tweet-ratio" && hasValue)
+            {
+                settings.tweetRatio = std::stod(argv[++i]);
+            }
+            else if (arg == "--zipf" && hasValue)
+            {
+                settings.zipf = std::stod(argv[++i]);
+            }
+            else if (arg == "--timeout" && hasValue)
+            {
+                settings.timeout = std::stoi(argv[++i]);
+            }
+            else if (arg == "--random-seed" && hasValue)
+            {
+                settings.randomSeed = std::stoull(argv[++i]);
+            }
+            else if (arg == "--json")
+            {
+                settings.json = true;
+            }
+            else
+            {
+                usage();
+                return 1;
+            }
+        }
+        catch (...)
+        {
+            usage();
+            return 1;
+        }
+    }
+    if (settings.users < 1 || settings.clients < 1)
+    {
+        usage();
+        return 1;
+    }
+
+    if (settings.seed)
+    {
+        seed(settings);
+    }
+    drive(settings);
+    return 0;
+}
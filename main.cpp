@@ -26,29 +26,304 @@
  */
 
 #include "RedisDatastore.h"
+#include "InMemoryDatastore.h"
 #include "TweetAPI.h"
 #include "FollowAPI.h"
 #include "TimelineAPI.h"
+#include "Metrics.h"
+#include "MeteredDatastore.h"
+#include "AdmissionControl.h"
+#include "ReplicatedDatastore.h"
+#include "ShardedDatastore.h"
+#include "RequestTrace.h"
+#include "TraceLog.h"
+#include <cpprest/containerstream.h>
 #include <cpprest/http_listener.h>
 #include <cpprest/uri.h>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * @brief Reply when an API task completes, without blocking the listener thread.
+ * @param request Request to reply.
+ * @param outcome API task, true on success.
+ * @param onSuccess Sends the reply on success, InternalError is sent otherwise.
+ */
+static void replyWhenDone(const web::http::http_request &request, pplx::task<bool> outcome,
+                          std::function<void(const web::http::http_request &)> onSuccess)
+{
+    outcome.then([request, onSuccess](pplx::task<bool> outcomeTask) {
+        bool success = false;
+        try
+        {
+            success = outcomeTask.get();
+        }
+        catch (...)
+        {
+        }
+
+        if (success)
+        {
+            onSuccess(request);
+        }
+        else
+        {
+            request.reply(web::http::status_codes::InternalError);
+        }
+    });
+}
+
+/*
+ * @brief Reply with a body that is already serialized. Large bodies are moved into a stream
+ *        instead of being copied into the response, sent with their length so it is metered.
+ * @param request Request to reply.
+ * @param body Response body.
+ * @param spTrace Trace of the request, sent in the Server-Timing header, optional.
+ */
+static void replyBody(const web::http::http_request &request, std::string body, std::shared_ptr<RequestTrace> spTrace = nullptr)
+{
+    web::http::http_response response(web::http::status_codes::OK);
+    if (spTrace)
+    {
+        response.headers().add("Server-Timing", spTrace->ServerTiming());
+    }
+    if (body.size() >= RESPONSESTREAM)
+    {
+        auto length = body.size();
+        response.set_body(concurrency::streams::bytestream::open_istream(std::move(body)), length, "text/plain; charset=utf-8");
+    }
+    else
+    {
+        response.set_body(std::move(body), "text/plain; charset=utf-8");
+    }
+    request.reply(response);
+}
+
+/*
+ * @brief Record the latency and the outcome of a request once it is replied,
+ *        server errors count as failures.
+ * @param request Request to measure.
+ * @param operation Metrics of the endpoint.
+ */
+static void meter(const web::http::http_request &request, OperationMetrics &operation)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto pOperation = &operation;
+    request.get_response().then([start, pOperation](pplx::task<web::http::http_response> responseTask) {
+        bool success = false;
+        size_t bytes = 0;
+        try
+        {
+            auto response = responseTask.get();
+            success = (response.status_code() < web::http::status_codes::InternalError);
+            bytes = response.headers().content_length();
+        }
+        catch (...)
+        {
+        }
+        pOperation->Record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count(),
+                           success, bytes);
+    });
+}
+
+/*
+ * @brief Offer the trace of a request to the log once it is replied.
+ * @param request Traced request.
+ * @param spTrace Trace of the request.
+ * @param spTraceLog Log of the sampled traces.
+ */
+static void logTrace(const web::http::http_request &request, std::shared_ptr<RequestTrace> spTrace,
+                     std::shared_ptr<TraceLog> spTraceLog)
+{
+    request.get_response().then([spTrace, spTraceLog](pplx::task<web::http::http_response>) {
+        spTraceLog->Submit(*spTrace);
+    });
+}
+
+/*
+ * @brief Serve a request once admitted, or shed it with 503 and a Retry-After header.
+ *        The slot of an admitted request is released once it is replied.
+ * @param request Request to admit.
+ * @param admission Admission control.
+ * @param endpoint Endpoint of the request.
+ * @param serve Serves the request.
+ */
+static void admit(const web::http::http_request &request, AdmissionControl &admission, AdmissionControl::Endpoint &endpoint,
+                  std::function<void()> serve)
+{
+    auto pAdmission = &admission;
+    auto pEndpoint = &endpoint;
+    admission.Enter(endpoint, [request, pAdmission, pEndpoint, serve](bool admitted) {
+        if (!admitted)
+        {
+            web::http::http_response response(web::http::status_codes::ServiceUnavailable);
+            response.headers().add("Retry-After", "1");
+            request.reply(response);
+            return;
+        }
+
+        request.get_response().then([pAdmission, pEndpoint](pplx::task<web::http::http_response>) {
+            pAdmission->Leave(*pEndpoint);
+        });
+        serve();
+    });
+}
+
+/*
+ * @brief Parse a comma separated list of Redis nodes.
+ * @param nodeList List of host:port entries.
+ * @param nodes Output vector of the host and the port of each node.
+ * @return True on success.
+ */
+static bool parseRedisNodes(const std::string &nodeList, std::vector<std::pair<std::string, int>> &nodes)
+{
+    std::stringstream nodeStream(nodeList);
+    for (std::string node; std::getline(nodeStream, node, ',');)
+    {
+        auto colon = node.rfind(':');
+        if (colon == std::string::npos || colon + 1 == node.size())
+        {
+            std::cerr << "Invalid Redis node " << node << std::endl;
+            return false;
+        }
+        nodes.emplace_back(node.substr(0, colon), std::atoi(node.c_str() + colon + 1));
+    }
+    return !nodes.empty();
+}
 
 int main()
 {
+    // Metrics of the endpoints and the datastore.
+    auto spMetrics = std::make_shared<Metrics>();
+
+    // Sampled and slow request traces, dumped on demand.
+    auto spTraceLog = std::make_shared<TraceLog>(TRACELOG, TRACESAMPLE, TRACESLOW / 1000.0);
+
+    // Follow graph cached in process, the in-process datastore needs none.
+    auto spFollowCache = std::make_shared<FollowGraphCache>(FOLLOWCACHE, FOLLOWCACHETTL);
+
+#ifndef INMEMORY
+    // Redis Datastore connector of one node, calls fail fast while the node times out.
+    auto makeRedis = [&](const std::string &endpoint, const int port, const bool serverSideMerge,
+                         const bool fillFollowCache) {
+        return std::make_shared<RedisDatastore>(endpoint, port, REDISPASS, REDISTIMEOUT / 1000.0, REDISPOOL, serverSideMerge,
+                                                spFollowCache, spMetrics, REDISREADTIMEOUT / 1000.0, CIRCUITFAILURES, CIRCUITBACKOFF,
+                                                fillFollowCache);
+    };
+#endif
+
+#ifdef INMEMORY
+    // Initialize in-process Datastore.
+    std::shared_ptr<IDatastore> spDatastore = std::make_shared<InMemoryDatastore>();
+#elif defined(REDISSHARDS)
+    // Initialize one Redis Datastore connector per shard, users are placed by consistent hashing.
+    std::vector<std::pair<std::string, int>> shardNodes;
+    if (!parseRedisNodes(REDISSHARDS, shardNodes))
+    {
+        return 1;
+    }
+    std::vector<std::shared_ptr<IDatastore>> shards;
+    std::vector<std::string> shardNames;
+    for (const auto &node : shardNodes)
+    {
+        shards.push_back(makeRedis(node.first, node.second, false, true));
+        shardNames.push_back(node.first + ":" + std::to_string(node.second));
+    }
+    std::shared_ptr<IDatastore> spDatastore = std::make_shared<ShardedDatastore>(shards, shardNames);
+#elif defined(REDISLUAMERGE)
+    // Initialize Redis Datastore connector, timelines are merged on Redis.
+    std::shared_ptr<IDatastore> spDatastore = makeRedis(REDISENDP, REDISPORT, true, true);
+#else
     // Initialize Redis Datastore connector.
-    auto spDatastore = std::make_shared<RedisDatastore>(REDISENDP, REDISPORT, REDISPASS);
+    std::shared_ptr<IDatastore> spDatastore = makeRedis(REDISENDP, REDISPORT, false, true);
+#endif
+#if defined(REDISREPLICAS) && !defined(INMEMORY) && !defined(REDISSHARDS)
+    // Spread the reads over the Redis replicas, the writers read their writes from the primary for a while.
+    std::vector<std::pair<std::string, int>> replicaNodes;
+    if (!parseRedisNodes(REDISREPLICAS, replicaNodes))
+    {
+        return 1;
+    }
+    // The replicas read the shared follow cache but never fill it, a lagging replica would cache follows the primary already changed.
+    std::vector<std::shared_ptr<IDatastore>> replicas;
+    for (const auto &node : replicaNodes)
+    {
+        replicas.push_back(makeRedis(node.first, node.second, spDatastore->HasServerSideMerge(), false));
+    }
+    spDatastore = std::make_shared<ReplicatedDatastore>(spDatastore, replicas, READYOURWRITES);
+#endif
+    // Concurrent request limit, lowered when the datastore calls get slow or fail.
+    std::shared_ptr<AdaptiveLimit> spLimit;
+    if (ADMISSIONLIMIT > 0)
+    {
+        spLimit = std::make_shared<AdaptiveLimit>(ADMISSIONMIN, ADMISSIONLIMIT, ADMISSIONTARGET / 1000.0);
+    }
+    spDatastore = std::make_shared<MeteredDatastore>(spDatastore, spMetrics, spLimit);
+
+    // Footprint of the follow graph cache.
+    spMetrics->AddGauge("followcache_entries", "Cached followee and follower sets.", [spFollowCache]() {
+        return static_cast<double>(spFollowCache->Size());
+    });
+    spMetrics->AddGauge("followcache_capacity", "Max number of cached followee and follower sets.", [spFollowCache]() {
+        return static_cast<double>(spFollowCache->Capacity());
+    });
+    spMetrics->AddGauge("followcache_bytes", "Approximate memory footprint of the follow graph cache.", [spFollowCache]() {
+        return static_cast<double>(spFollowCache->MemoryUsage());
+    });
 
     // Create several API backend services.
-    TweetAPI tweetApi(spDatastore);
-    TimelineAPI timelineApi(spDatastore);
-    FollowAPI followApi(spDatastore);
+    auto spTimelineCache = std::make_shared<TimelineCache>(TIMELINECACHE, TIMELINECACHETTL);
+    auto spTimelineApi = std::make_shared<TimelineAPI>(spDatastore, TimelineMode::TIMELINEMODE, CELEBRITYTHRESHOLD, spTimelineCache,
+                                                       CELEBRITYTTL);
+#ifdef WRITEBEHIND
+    // Group commit of the tweet and follow writes.
+    auto spWriteQueue = std::make_shared<WriteBehindQueue>(spDatastore, WriteAck::WRITEACK, WRITEBATCH, WRITEDELAY / 1000.0);
+#else
+    std::shared_ptr<WriteBehindQueue> spWriteQueue;
+#endif
+    TweetAPI tweetApi(spDatastore, spTimelineApi, IDBLOCKSIZE, spWriteQueue);
+    FollowAPI followApi(spDatastore, spTimelineApi, spWriteQueue);
 
     // Start API Server.
     web::uri_builder uri(APIADDR);
     uri.append_path(APIVERS);
     web::http::experimental::listener::http_listener apiServer(uri.to_uri().to_string());
 
+    // Metrics of each endpoint.
+    auto &tweetMetrics = spMetrics->Operation("http", "tweet");
+    auto &tweetsMetrics = spMetrics->Operation("http", "tweets");
+    auto &timelineMetrics = spMetrics->Operation("http", "timeline");
+    auto &classificationMetrics = spMetrics->Operation("http", "classification");
+    auto &followCacheMetrics = spMetrics->Operation("http", "followcache");
+    auto &metricsMetrics = spMetrics->Operation("http", "metrics");
+    auto &tracesMetrics = spMetrics->Operation("http", "traces");
+    auto &followMetrics = spMetrics->Operation("http", "follow");
+    auto &unfollowMetrics = spMetrics->Operation("http", "unfollow");
+
+    // Admission of the endpoints that reach the datastore, the cheap writes have priority.
+    AdmissionControl admission(spLimit, ADMISSIONQUEUE, ADMISSIONWAIT / 1000.0);
+    auto &tweetEndpoint = admission.AddEndpoint("tweet", 1.0, AdmissionPriority::High);
+    auto &followEndpoint = admission.AddEndpoint("follow", 1.0, AdmissionPriority::High);
+    auto &tweetsEndpoint = admission.AddEndpoint("tweets", 0.25, AdmissionPriority::Low);
+    auto &timelineEndpoint = admission.AddEndpoint("timeline", 0.8, AdmissionPriority::Low);
+    auto &classificationEndpoint = admission.AddEndpoint("classification", 0.25, AdmissionPriority::Low);
+    spMetrics->AddGauge("admission_limit", "Concurrent requests allowed, 0 if unlimited.", [&admission]() {
+        return static_cast<double>(admission.Limit());
+    });
+    spMetrics->AddGauge("admission_inflight", "Admitted requests in flight.", [&admission]() {
+        return static_cast<double>(admission.InFlight());
+    });
+    spMetrics->AddGauge("admission_queued", "Requests waiting for admission.", [&admission]() {
+        return static_cast<double>(admission.Queued());
+    });
+
     // Dispatcher for POST requests.
     apiServer.support(web::http::methods::POST, [&](web::http::http_request request) {
         // Sptlit the path.
@@ -57,18 +332,116 @@ int main()
         // Serve TweetAPI request.
         if (uriParts.size() == 1 && uriParts[0] == "tweet")
         {
-            // Parse the JSON body.
-            auto bodyJson = request.extract_json(true).get();
-            if (bodyJson.has_string_field("content") && bodyJson.has_integer_field("userId"))
-            {
-                // Create new Tweet.
-                auto content = bodyJson["content"].as_string();
-                auto userId = bodyJson["userId"].as_integer();
-                request.reply(tweetApi.AddTweet(content, userId) ? 
-                    web::http::status_codes::Created : 
-                    web::http::status_codes::InternalError);
-                return;
-            }
+            meter(request, tweetMetrics);
+            auto spTrace = std::make_shared<RequestTrace>("tweet");
+            logTrace(request, spTrace, spTraceLog);
+
+            admit(request, admission, tweetEndpoint, [&tweetApi, request, spTrace]() {
+                // Parse the JSON body.
+                request.extract_json(true).then([&tweetApi, request, spTrace](pplx::task<web::json::value> bodyTask) {
+                    web::json::value bodyJson;
+                    try
+                    {
+                        bodyJson = bodyTask.get();
+                    }
+                    catch (...)
+                    {
+                        request.reply(web::http::status_codes::BadRequest);
+                        return;
+                    }
+
+                    if (bodyJson.has_string_field("content") && bodyJson.has_integer_field("userId"))
+                    {
+                        // Create new Tweet.
+                        auto content = bodyJson["content"].as_string();
+                        auto userId = bodyJson["userId"].as_integer();
+                        replyWhenDone(request, tweetApi.AddTweetAsync(content, userId, spTrace), [spTrace](const web::http::http_request &request) {
+                            web::http::http_response response(web::http::status_codes::Created);
+                            response.headers().add("Server-Timing", spTrace->ServerTiming());
+                            request.reply(response);
+                        });
+                        return;
+                    }
+
+                    // No API exists for that request.
+                    request.reply(web::http::status_codes::NotFound);
+                });
+            });
+            return;
+        }
+
+        // Serve TweetAPI batch request.
+        if (uriParts.size() == 1 && uriParts[0] == "tweets")
+        {
+            meter(request, tweetsMetrics);
+
+            admit(request, admission, tweetsEndpoint, [&tweetApi, request]() {
+                // Parse the JSON array body.
+                request.extract_json(true).then([&tweetApi, request](pplx::task<web::json::value> bodyTask) {
+                    web::json::value bodyJson;
+                    try
+                    {
+                        bodyJson = bodyTask.get();
+                    }
+                    catch (...)
+                    {
+                        request.reply(web::http::status_codes::BadRequest);
+                        return;
+                    }
+                    if (!bodyJson.is_array())
+                    {
+                        request.reply(web::http::status_codes::BadRequest);
+                        return;
+                    }
+
+                    // Collect the valid items, the others are rejected individually.
+                    auto &items = bodyJson.as_array();
+                    std::vector<std::pair<int, std::string>> tweets;
+                    std::vector<size_t> positions;
+                    for (size_t i = 0; i < items.size(); ++i)
+                    {
+                        auto &item = items.at(i);
+                        if (item.is_object() && item.has_string_field("content") && item.has_integer_field("userId"))
+                        {
+                            tweets.emplace_back(item.at("userId").as_integer(), item.at("content").as_string());
+                            positions.push_back(i);
+                        }
+                    }
+
+                    // Create new Tweets, reply with the outcome of each item in order.
+                    auto spTweetIds = std::make_shared<std::vector<int>>();
+                    auto itemCount = items.size();
+                    tweetApi.AddTweetsAsync(tweets, spTweetIds).then([request, spTweetIds, positions, itemCount](pplx::task<bool> outcomeTask) {
+                        try
+                        {
+                            outcomeTask.wait();
+                        }
+                        catch (...)
+                        {
+                            spTweetIds->assign(positions.size(), -1);
+                        }
+
+                        auto resultsJson = web::json::value::array(itemCount);
+                        for (size_t i = 0; i < itemCount; ++i)
+                        {
+                            resultsJson[i]["status"] = web::json::value::number(web::http::status_codes::BadRequest);
+                        }
+                        for (size_t i = 0; i < positions.size(); ++i)
+                        {
+                            auto &resultJson = resultsJson[positions[i]];
+                            int tweetId = (i < spTweetIds->size()) ? (*spTweetIds)[i] : -1;
+                            resultJson["status"] = web::json::value::number((tweetId == -1) ? web::http::status_codes::InternalError
+                                                                                            : web::http::status_codes::Created);
+                            if (tweetId != -1)
+                            {
+                                resultJson["tweetId"] = web::json::value::number(tweetId);
+                            }
+                        }
+                        request.reply(web::http::status_codes::OK, resultsJson);
+                    });
+                });
+            });
+            return;
         }
 
         // No API exists for that request.
@@ -83,6 +456,10 @@ int main()
         // Serve TimelineAPI request.
         if (uriParts.size() == 2 && uriParts[0] == "timeline")
         {
+            meter(request, timelineMetrics);
+            auto spTrace = std::make_shared<RequestTrace>("timeline");
+            logTrace(request, spTrace, spTraceLog);
+
             // Extract userId.
             int userId = -1;
             try
@@ -96,17 +473,96 @@ int main()
             }
 
             // Get and return timeline for the user.
-            std::string timeline;
-            if (timelineApi.GetTimeline(userId, timeline))
+            admit(request, admission, timelineEndpoint, [spTimelineApi, request, userId, spTrace]() {
+                auto spTimeline = std::make_shared<std::string>();
+                replyWhenDone(request, spTimelineApi->GetTimelineAsync(userId, spTimeline, 10, spTrace),
+                              [spTimeline, spTrace](const web::http::http_request &request) {
+                    replyBody(request, std::move(*spTimeline), spTrace);
+                });
+            });
+            return;
+        }
+
+        // Serve the Hybrid timeline classification of the user.
+        if (uriParts.size() == 2 && uriParts[0] == "classification")
+        {
+            meter(request, classificationMetrics);
+
+            // Extract userId.
+            int userId = -1;
+            try
             {
-                request.reply(web::http::status_codes::OK, timeline);
-                return;
-            } 
-            else
+                userId = std::stoi(uriParts[1]);
+            }
+            catch (...)
             {
-                request.reply(web::http::status_codes::InternalError);
+                request.reply(web::http::status_codes::BadRequest);
                 return;
-            }                
+            }
+
+            admit(request, admission, classificationEndpoint, [spTimelineApi, request, userId]() {
+                // Return the follower count against the threshold.
+                auto spFollowerCount = std::make_shared<int>(0);
+                auto spIsCelebrity = std::make_shared<bool>(false);
+                auto threshold = spTimelineApi->GetCelebrityThreshold();
+                replyWhenDone(request, spTimelineApi->GetClassificationAsync(userId, spFollowerCount, spIsCelebrity),
+                              [userId, spFollowerCount, spIsCelebrity, threshold](const web::http::http_request &request) {
+                    auto classificationJson = web::json::value::object();
+                    classificationJson["userId"] = web::json::value::number(userId);
+                    classificationJson["followers"] = web::json::value::number(*spFollowerCount);
+                    classificationJson["threshold"] = web::json::value::number(threshold);
+                    classificationJson["celebrity"] = web::json::value::boolean(*spIsCelebrity);
+                    request.reply(web::http::status_codes::OK, classificationJson);
+                });
+            });
+            return;
+        }
+
+        // Report the footprint of the follow graph cache for sizing.
+        if (uriParts.size() == 1 && uriParts[0] == "followcache")
+        {
+            meter(request, followCacheMetrics);
+            auto cacheJson = web::json::value::object();
+            cacheJson["entries"] = web::json::value::number(static_cast<uint64_t>(spFollowCache->Size()));
+            cacheJson["capacity"] = web::json::value::number(static_cast<uint64_t>(spFollowCache->Capacity()));
+            cacheJson["bytes"] = web::json::value::number(static_cast<uint64_t>(spFollowCache->MemoryUsage()));
+            request.reply(web::http::status_codes::OK, cacheJson);
+            return;
+        }
+
+        // Dump the logged request traces, oldest first.
+        if (uriParts.size() == 1 && uriParts[0] == "traces")
+        {
+            meter(request, tracesMetrics);
+            auto records = spTraceLog->Dump();
+            auto tracesJson = web::json::value::array(records.size());
+            for (size_t i = 0; i < records.size(); ++i)
+            {
+                const auto &record = records[i];
+                auto &traceJson = tracesJson[i];
+                traceJson["name"] = web::json::value::string(record.name);
+                traceJson["time"] = web::json::value::number(static_cast<int64_t>(
+                    std::chrono::duration_cast<std::chrono::milliseconds>(record.time.time_since_epoch()).count()));
+                traceJson["totalMs"] = web::json::value::number(record.totalMicros / 1000.0);
+                auto spansJson = web::json::value::array(record.spanCount);
+                for (size_t j = 0; j < record.spanCount; ++j)
+                {
+                    spansJson[j]["name"] = web::json::value::string(record.spans[j].name);
+                    spansJson[j]["startMs"] = web::json::value::number(record.spans[j].startMicros / 1000.0);
+                    spansJson[j]["durationMs"] = web::json::value::number(record.spans[j].durationMicros / 1000.0);
+                }
+                traceJson["spans"] = spansJson;
+            }
+            request.reply(web::http::status_codes::OK, tracesJson);
+            return;
+        }
+
+        // Export the metrics in the Prometheus text format.
+        if (uriParts.size() == 1 && uriParts[0] == "metrics")
+        {
+            meter(request, metricsMetrics);
+            request.reply(web::http::status_codes::OK, spMetrics->Prometheus(), "text/plain; version=0.0.4; charset=utf-8");
+            return;
         }
 
         // No API exists for that request.
@@ -120,7 +576,9 @@ int main()
                 
         // Serve FollowAPI request.
         if (uriParts.size() == 3 && uriParts[0] == "follow")
-        {            
+        {
+            meter(request, (request.method() == web::http::methods::PUT) ? followMetrics : unfollowMetrics);
+
             // Extract followerId and followeeId.
             int followerId = -1, followeeId = -1;
             try
@@ -135,21 +593,21 @@ int main()
             }
 
             // Process follow and unfollow requests.
-            if (request.method() == web::http::methods::PUT 
-                && followApi.Follow(followerId, followeeId))
-            {
-                request.reply(web::http::status_codes::Created);
-                return;
-            }
-            else if (request.method() == web::http::methods::DEL 
-                && followApi.Unfollow(followerId, followeeId))
-            {
-                request.reply(web::http::status_codes::NoContent);
-                return;
-            } else {
-                request.reply(web::http::status_codes::InternalError);
-                return;
-            }
+            admit(request, admission, followEndpoint, [&followApi, request, followerId, followeeId]() {
+                if (request.method() == web::http::methods::PUT)
+                {
+                    replyWhenDone(request, followApi.FollowAsync(followerId, followeeId), [](const web::http::http_request &request) {
+                        request.reply(web::http::status_codes::Created);
+                    });
+                }
+                else
+                {
+                    replyWhenDone(request, followApi.UnfollowAsync(followerId, followeeId), [](const web::http::http_request &request) {
+                        request.reply(web::http::status_codes::NoContent);
+                    });
+                }
+            });
+            return;
         }
 
         // No API exists for that request.